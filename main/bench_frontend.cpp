@@ -0,0 +1,392 @@
+// Benchmarks the front-end (tokenizer and parser) and the cold start of a
+// script on synthetic sources. Results are printed as JSON.
+//
+// Usage: wolfscript_bench_frontend [options]
+//   --shape=<mixed|nesting|expressions|functions|strings>  (default: mixed)
+//   --size-kb=<n>       Approximate size of the generated script (default: 1024)
+//   --depth=<n>         Nesting depth of the "nesting" shape (default: 32)
+//   --length=<n>        Operators per expression of the "expressions" shape (default: 64)
+//   --iterations=<n>    Each phase is timed this many times, the best is reported (default: 5)
+//   --threads=<n>       Threads of the batch_parse phase, 0 for one per core (default: 0)
+//   --dump              Print the generated script instead of benchmarking it
+
+#include "../wolfscript/wolfscript.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <functional>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+
+struct bench_options
+{
+	std::string shape{ "mixed" };
+	std::size_t size_kb{ 1024 };
+	std::size_t depth{ 32 };
+	std::size_t length{ 64 };
+	std::size_t iterations{ 5 };
+	std::size_t threads{ 0 };
+	bool dump{ false };
+};
+
+// Generates scripts out of small units that each declare their own
+// uniquely named symbols, so the result can also be interpreted.
+class script_generator
+{
+public:
+	script_generator(const bench_options& pOptions) :
+		mOptions(pOptions)
+	{}
+
+	std::string generate()
+	{
+		const std::size_t target = mOptions.size_kb * 1024;
+		std::size_t unit = 0;
+		while (mResult.size() < target)
+		{
+			if (mOptions.shape == "nesting")
+				add_nesting();
+			else if (mOptions.shape == "expressions")
+				add_expression();
+			else if (mOptions.shape == "functions")
+				add_function();
+			else if (mOptions.shape == "strings")
+				add_string();
+			else
+			{
+				switch (unit++ % 4)
+				{
+				case 0: add_nesting(); break;
+				case 1: add_expression(); break;
+				case 2: add_function(); break;
+				case 3: add_string(); break;
+				}
+			}
+		}
+		return std::move(mResult);
+	}
+
+private:
+	std::string next_name(const char* pPrefix)
+	{
+		return pPrefix + std::to_string(mCounter++);
+	}
+
+	void indent(std::size_t pDepth)
+	{
+		mResult.append(pDepth, '\t');
+	}
+
+	void add_nesting()
+	{
+		const std::string name = next_name("n_");
+		mResult += "var " + name + " = 0;\n";
+		for (std::size_t i = 0; i < mOptions.depth; i++)
+		{
+			indent(i);
+			if (i % 2 == 0)
+				mResult += "if (" + name + " < " + std::to_string(i + 1) + ")\n";
+			else
+				mResult += "while (" + name + " < " + std::to_string(i + 1) + ")\n";
+			indent(i);
+			mResult += "{\n";
+			indent(i + 1);
+			mResult += name + " += 1;\n";
+		}
+		for (std::size_t i = mOptions.depth; i > 0; i--)
+		{
+			indent(i - 1);
+			mResult += "}\n";
+		}
+	}
+
+	void add_expression()
+	{
+		static const char* ops[] = { " + ", " * ", " - ", " / ", " + ", " % " };
+		mResult += "var " + next_name("e_") + " = 1";
+		for (std::size_t i = 0; i < mOptions.length; i++)
+		{
+			mResult += ops[i % 6];
+			// Never zero so there is no division by 0
+			mResult += std::to_string(i % 9 + 1);
+		}
+		mResult += ";\n";
+	}
+
+	void add_function()
+	{
+		const std::string name = next_name("f_");
+		mResult += "function " + name + "(a, b)\n{\n"
+			"\tvar t = a * 2 + b;\n"
+			"\tif (t > 10)\n"
+			"\t\treturn t - 10;\n"
+			"\treturn t;\n"
+			"}\n";
+		if (mCounter % 8 == 0)
+			mResult += name + "(1, 2);\n";
+	}
+
+	void add_string()
+	{
+		mResult += "var " + next_name("s_") + " = \"Lorem ipsum dolor sit amet, consectetur "
+			"adipiscing elit. \\\"Sed\\\" do eiusmod tempor\\tincididunt ut labore\\n\";\n";
+	}
+
+private:
+	const bench_options& mOptions;
+	std::string mResult;
+	std::size_t mCounter{ 0 };
+};
+
+std::size_t count_nodes(const wolfscript::AST_node* pNode)
+{
+	std::size_t count = 1;
+	for (const auto& i : pNode->children)
+		count += count_nodes(i);
+	return count;
+}
+
+// Returns the best time in seconds of several runs of pFunc
+double time_best(std::size_t pIterations, const std::function<void()>& pFunc)
+{
+	double best = 0;
+	for (std::size_t i = 0; i < pIterations; i++)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		pFunc();
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (i == 0 || seconds < best)
+			best = seconds;
+	}
+	return best;
+}
+
+std::size_t peak_rss_kb()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize / 1024;
+	return 0;
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return static_cast<std::size_t>(usage.ru_maxrss) / 1024; // Bytes on macOS
+#else
+	return static_cast<std::size_t>(usage.ru_maxrss);
+#endif
+#endif
+}
+
+// The bindings the generated scripts need to run
+void add_bindings(wolfscript::interpreter& pInterpreter)
+{
+	pInterpreter.add("copy", wolfscript::function([](const std::string& pStr)
+	{
+		return std::string(pStr);
+	}));
+	pInterpreter.add(wolfscript::object_behavior::add, wolfscript::function([](const std::string& l, const std::string& r)
+	{
+		return l + r;
+	}));
+}
+
+bool parse_option(const char* pArg, const char* pName, std::string& pValue)
+{
+	const std::size_t length = std::strlen(pName);
+	if (std::strncmp(pArg, pName, length) != 0 || pArg[length] != '=')
+		return false;
+	pValue = pArg + length + 1;
+	return true;
+}
+
+bool parse_options(int argc, char** argv, bench_options& pOptions)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string value;
+		if (parse_option(argv[i], "--shape", value))
+			pOptions.shape = value;
+		else if (parse_option(argv[i], "--size-kb", value))
+			pOptions.size_kb = std::strtoul(value.c_str(), nullptr, 10);
+		else if (parse_option(argv[i], "--depth", value))
+			pOptions.depth = std::strtoul(value.c_str(), nullptr, 10);
+		else if (parse_option(argv[i], "--length", value))
+			pOptions.length = std::strtoul(value.c_str(), nullptr, 10);
+		else if (parse_option(argv[i], "--iterations", value))
+			pOptions.iterations = std::strtoul(value.c_str(), nullptr, 10);
+		else if (parse_option(argv[i], "--threads", value))
+			pOptions.threads = std::strtoul(value.c_str(), nullptr, 10);
+		else if (std::strcmp(argv[i], "--dump") == 0)
+			pOptions.dump = true;
+		else
+		{
+			std::cerr << "Unknown option \"" << argv[i] << "\"\n";
+			return false;
+		}
+	}
+	if (pOptions.iterations == 0)
+		pOptions.iterations = 1;
+	return true;
+}
+
+// Writes a "name": { ... } object with the time and throughput of a phase
+void print_phase(const char* pName, double pSeconds, double pBytes, double pTokens, double pNodes, bool pLast = false)
+{
+	std::cout << "\t\"" << pName << "\": { \"seconds\": " << pSeconds;
+	if (pBytes > 0)
+		std::cout << ", \"mb_per_s\": " << pBytes / (1024 * 1024) / pSeconds;
+	if (pTokens > 0)
+		std::cout << ", \"tokens_per_s\": " << pTokens / pSeconds;
+	if (pNodes > 0)
+		std::cout << ", \"nodes_per_s\": " << pNodes / pSeconds;
+	std::cout << " }" << (pLast ? "\n" : ",\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	bench_options options;
+	if (!parse_options(argc, argv, options))
+		return 1;
+
+	const std::string source = script_generator(options).generate();
+	if (options.dump)
+	{
+		std::cout << source;
+		return 0;
+	}
+
+	try
+	{
+		// Collect the sizes once up front
+		const std::size_t token_count = wolfscript::tokenize(source).size();
+		std::size_t node_count = 0;
+		std::size_t flat_ast_bytes = 0;
+		{
+			wolfscript::parser parser;
+			const wolfscript::AST_tree tree = parser.parse(source);
+			node_count = count_nodes(tree.get());
+			flat_ast_bytes = wolfscript::AST_flat_tree(tree).memory_usage();
+		}
+
+		const double tokenize_time = time_best(options.iterations, [&]()
+		{
+			wolfscript::tokenize(source);
+		});
+
+		const wolfscript::token_array tokens = wolfscript::tokenize(source);
+		const double parse_time = time_best(options.iterations, [&]()
+		{
+			wolfscript::parser parser;
+			parser.parse(tokens);
+		});
+
+		const wolfscript::compact_token_array compact_tokens(source);
+		const double compact_parse_time = time_best(options.iterations, [&]()
+		{
+			wolfscript::parser parser;
+			parser.parse(compact_tokens);
+		});
+
+		const double stream_parse_time = time_best(options.iterations, [&]()
+		{
+			wolfscript::parser parser;
+			parser.parse(source);
+		});
+
+		// The source is cut at its functions and parsed on several threads
+		const wolfscript::batch_parser batch(options.threads);
+		const double batch_parse_time = time_best(options.iterations, [&]()
+		{
+			batch.parse({ source })[0].get();
+		});
+
+		// Loads the AST from an entry of an on-disk cache instead
+		const wolfscript::script_cache cache(std::filesystem::temp_directory_path() / "wolfscript_bench_cache");
+		{
+			wolfscript::parser parser;
+			cache.store(source, parser.parse(source));
+		}
+		bool cache_hit = true;
+		const double cache_load_time = time_best(options.iterations, [&]()
+		{
+			cache_hit &= static_cast<bool>(cache.load(source));
+		});
+		std::error_code remove_error;
+		std::filesystem::remove(cache.entry_path(source), remove_error);
+
+		const double cold_start_time = time_best(options.iterations, [&]()
+		{
+			wolfscript::interpreter interpreter;
+			add_bindings(interpreter);
+			wolfscript::parser parser;
+			interpreter.interpret(parser.parse(source));
+		});
+
+		// Inserts and removes a space after statements spread over the
+		// source. This is reported as the time of a single edit.
+		wolfscript::incremental_parser document;
+		document.parse(source);
+		std::vector<std::size_t> edit_offsets;
+		const std::size_t edit_stride = source.size() / 1000 + 1;
+		for (std::size_t i = source.find(";\n"); i != std::string::npos; i = source.find(";\n", i + edit_stride))
+			edit_offsets.push_back(i + 1);
+		const double edit_time = time_best(options.iterations, [&]()
+		{
+			for (std::size_t i : edit_offsets)
+			{
+				document.edit(i, 0, " ");
+				document.edit(i, 1, {});
+			}
+		}) / static_cast<double>(std::max<std::size_t>(edit_offsets.size() * 2, 1));
+
+		const double bytes = static_cast<double>(source.size());
+		std::cout << "{\n";
+		std::cout << "\t\"shape\": \"" << options.shape << "\",\n";
+		std::cout << "\t\"source_bytes\": " << source.size() << ",\n";
+		std::cout << "\t\"tokens\": " << token_count << ",\n";
+		std::cout << "\t\"nodes\": " << node_count << ",\n";
+		std::cout << "\t\"iterations\": " << options.iterations << ",\n";
+		std::cout << "\t\"cache_hit\": " << (cache_hit ? "true" : "false") << ",\n";
+		std::cout << "\t\"threads\": " << batch.thread_count() << ",\n";
+		std::cout << "\t\"token_array_bytes\": " << tokens.capacity() * sizeof(wolfscript::token) << ",\n";
+		std::cout << "\t\"compact_token_bytes\": " << compact_tokens.memory_usage() << ",\n";
+		std::cout << "\t\"flat_ast_bytes\": " << flat_ast_bytes << ",\n";
+		print_phase("tokenize", tokenize_time, bytes, static_cast<double>(token_count), 0);
+		print_phase("parse", parse_time, 0, static_cast<double>(token_count), static_cast<double>(node_count));
+		print_phase("compact_parse", compact_parse_time, 0, static_cast<double>(token_count), static_cast<double>(node_count));
+		print_phase("stream_parse", stream_parse_time, bytes, static_cast<double>(token_count), static_cast<double>(node_count));
+		print_phase("batch_parse", batch_parse_time, bytes, static_cast<double>(token_count), static_cast<double>(node_count));
+		print_phase("cache_load", cache_load_time, bytes, 0, static_cast<double>(node_count));
+		print_phase("cold_start", cold_start_time, bytes, 0, 0);
+		print_phase("incremental_edit", edit_time, 0, 0, 0);
+		std::cout << "\t\"peak_rss_kb\": " << peak_rss_kb() << "\n";
+		std::cout << "}\n";
+	}
+	catch (wolfscript::exception::wolf_exception& e)
+	{
+		e.resolve_position(wolfscript::line_index(source));
+		std::cerr << "Error " << e.position.to_string() << ": " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,170 @@
+// Runs scripts with the interpreter alone and with every call compiled by
+// the jit_compiler, and fails if their output differs.
+//
+// Usage: wolfscript_jit_test <script>...
+//
+// A script can hold several cases split by lines of "// ---". Each case is
+// run by its own interpreter, so one that ends with an error doesn't stop
+// the ones after it.
+
+#include "../wolfscript/wolfscript.hpp"
+#include "../wolfscript/language/function.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct run_options
+{
+	const char* name;
+	bool jit;
+	bool bytecode;
+};
+
+const run_options runs[] = {
+	{ "interpreter", false, true },
+	{ "jit", true, true },
+	{ "jit without bytecode", true, false },
+};
+
+std::string load_file_as_string(const std::string& pPath)
+{
+	std::ifstream stream(pPath.c_str());
+	if (!stream.good())
+		return{};
+	std::stringstream sstr;
+	sstr << stream.rdbuf();
+	return sstr.str();
+}
+
+std::vector<std::string> split_cases(const std::string& pSource)
+{
+	std::vector<std::string> cases(1);
+	std::istringstream stream(pSource);
+	std::string line;
+	while (std::getline(stream, line))
+	{
+		if (line.rfind("// ---", 0) == 0)
+			cases.emplace_back();
+		else
+			cases.back() += line + "\n";
+	}
+	return cases;
+}
+
+void add_bindings(wolfscript::interpreter& pInterpreter, std::ostream& pOut)
+{
+	pInterpreter.add_type<int>("int");
+	pInterpreter.add_type<float>("float");
+	pInterpreter.add_type<std::string>("string");
+	pInterpreter.add("copy", wolfscript::function([](const std::string& pStr)
+	{
+		return std::string(pStr);
+	}));
+	pInterpreter.add(wolfscript::object_behavior::add, wolfscript::function([](const std::string& l, int r)
+	{
+		return l + std::to_string(r);
+	}));
+	pInterpreter.add("print", wolfscript::function([&pOut](const std::string& pStr)
+	{
+		pOut << pStr;
+	}));
+	pInterpreter.add("print", wolfscript::function([&pOut](int pInt)
+	{
+		pOut << pInt;
+	}));
+	pInterpreter.add("print_float", wolfscript::function([&pOut](float pFloat)
+	{
+		pOut << pFloat;
+	}));
+	pInterpreter.add("scale", wolfscript::function([](int pValue, int pBy)
+	{
+		return pValue * pBy;
+	}));
+	pInterpreter.add("root", wolfscript::pure_function([](float pValue)
+	{
+		return std::sqrt(pValue);
+	}));
+	pInterpreter.add("fail", wolfscript::function([](int pValue)
+	{
+		if (pValue > 2)
+			throw wolfscript::exception::interpretor_error("Failed by the host");
+		return pValue;
+	}));
+	// Replaces scale with a function that returns another type, which
+	// compiled calls to it have to notice
+	pInterpreter.add("rebind_scale", wolfscript::function([&pInterpreter]()
+	{
+		pInterpreter["scale"] = wolfscript::function([](int pValue, int pBy)
+		{
+			return pValue * pBy + 1000.5f;
+		});
+	}));
+}
+
+std::string run_case(const std::string& pSource, const run_options& pOptions)
+{
+	std::ostringstream out;
+	try
+	{
+		wolfscript::parser parser;
+		wolfscript::AST_tree ast = parser.parse(pSource);
+		wolfscript::interpreter interpreter;
+		interpreter.set_bytecode(pOptions.bytecode);
+		interpreter.set_jit(pOptions.jit);
+		interpreter.set_jit_threshold(0);
+		add_bindings(interpreter, out);
+		interpreter.interpret(ast);
+	}
+	catch (wolfscript::exception::wolf_exception& e)
+	{
+		e.resolve_position(wolfscript::line_index(pSource));
+		out << "\nError " << e.position.to_string() << ": " << e.what() << "\n";
+	}
+	return out.str();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::cerr << "Usage: wolfscript_jit_test <script>...\n";
+		return 2;
+	}
+
+	int failures = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string source = load_file_as_string(argv[i]);
+		if (source.empty())
+		{
+			std::cerr << "Could not load file \"" << argv[i] << "\"\n";
+			return 2;
+		}
+
+		const std::vector<std::string> cases = split_cases(source);
+		for (std::size_t j = 0; j < cases.size(); j++)
+		{
+			const std::string expected = run_case(cases[j], runs[0]);
+			for (std::size_t k = 1; k < std::size(runs); k++)
+			{
+				const std::string result = run_case(cases[j], runs[k]);
+				if (result == expected)
+					continue;
+				std::cout << argv[i] << " case " << j + 1 << ": the " << runs[k].name << " differs from the " << runs[0].name << "\n";
+				std::cout << "--- " << runs[0].name << "\n" << expected << "\n";
+				std::cout << "--- " << runs[k].name << "\n" << result << "\n";
+				++failures;
+			}
+		}
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -23,7 +23,7 @@ int main()
 {
 	wolfscript::parser parser;
 	const std::string code = load_file_as_string("../script.wolf");
-	wolfscript::AST_node::ptr ast = parser.parse(wolfscript::tokenize(code));
+	wolfscript::AST_tree ast = parser.parse(code);
 
 	wolfscript::AST_viewer viewer;
 	ast->visit(&viewer);
@@ -32,11 +32,11 @@ int main()
 	interpreter.add_type<int>("int");
 	interpreter.add_type<float>("float");
 	interpreter.add_type<std::string>("string");
-	interpreter.add("string", wolfscript::function([](const std::string& pStr)
+	interpreter.add("string", wolfscript::pure_function([](const std::string& pStr)
 	{
 		return std::string(pStr);
 	}));
-	interpreter.add("string", wolfscript::function([]()
+	interpreter.add("string", wolfscript::pure_function([]()
 	{
 		return std::string();
 	}));
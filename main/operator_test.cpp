@@ -0,0 +1,98 @@
+// Checks that scripts call the functions of operators the application
+// rebinds, through interpreter::operator[] as well as interpreter::add,
+// after the operator_table found the ones before.
+//
+// Usage: wolfscript_operator_test
+
+#include "../wolfscript/wolfscript.hpp"
+#include "../wolfscript/language/function.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace
+{
+
+const char script[] = R"(
+function f() {
+	print("a" + 1);
+	print("\n");
+}
+f();
+rebind_with_index();
+f();
+add_overload();
+f();
+print("b" + "c");
+print("\n");
+)";
+
+const char expected[] =
+	"a-old-1\n"
+	"a-new-1\n"
+	"a-new-1\n"
+	"b+c\n";
+
+std::string run(bool pBytecode)
+{
+	std::ostringstream out;
+	try
+	{
+		wolfscript::interpreter interpreter;
+		interpreter.set_bytecode(pBytecode);
+		interpreter.add_type<std::string>("string");
+		interpreter.add("copy", wolfscript::function([](const std::string& pStr)
+		{
+			return std::string(pStr);
+		}));
+		interpreter.add("print", wolfscript::function([&out](const std::string& pStr)
+		{
+			out << pStr;
+		}));
+		interpreter.add(wolfscript::object_behavior::add, wolfscript::function([](const std::string& l, int r)
+		{
+			return l + "-old-" + std::to_string(r);
+		}));
+		interpreter.add("rebind_with_index", wolfscript::function([&interpreter]()
+		{
+			interpreter[wolfscript::object_behavior::add] = wolfscript::function([](const std::string& l, int r)
+			{
+				return l + "-new-" + std::to_string(r);
+			});
+		}));
+		interpreter.add("add_overload", wolfscript::function([&interpreter]()
+		{
+			interpreter.add(wolfscript::object_behavior::add, wolfscript::function([](const std::string& l, const std::string& r)
+			{
+				return l + "+" + r;
+			}));
+		}));
+
+		wolfscript::parser parser;
+		wolfscript::AST_tree ast = parser.parse(script);
+		interpreter.interpret(ast);
+	}
+	catch (wolfscript::exception::wolf_exception& e)
+	{
+		out << "Error: " << e.what() << "\n";
+	}
+	return out.str();
+}
+
+} // namespace
+
+int main()
+{
+	int failures = 0;
+	for (bool bytecode : { true, false })
+	{
+		const std::string result = run(bytecode);
+		if (result == expected)
+			continue;
+		std::cout << "Unexpected output " << (bytecode ? "with" : "without") << " bytecode:\n" << result
+			<< "--- expected:\n" << expected;
+		++failures;
+	}
+	return failures == 0 ? 0 : 1;
+}
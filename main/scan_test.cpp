@@ -0,0 +1,184 @@
+// Checks that the scalar, SSE2 and AVX2 scan kernels agree, on their own
+// and through the tokenizer, for randomly generated text. The instruction
+// sets the CPU doesn't support are skipped.
+//
+// Usage: wolfscript_scan_test [--iterations=<n>] [--seed=<n>]
+
+#include "../wolfscript/wolfscript.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct isa_info
+{
+	const char* name;
+	wolfscript::scan_isa isa;
+};
+
+const isa_info isas[] = {
+	{ "scalar", wolfscript::scan_isa::scalar },
+	{ "sse2", wolfscript::scan_isa::sse2 },
+	{ "avx2", wolfscript::scan_isa::avx2 },
+};
+
+// The kernels each look for some of these, the rest is filler
+const char alphabet[] = " \t\n\r_azAZ09\"\\*/+-;(){}.#\x7f\x80\xff";
+
+// Pieces of source that tokenize, with spaces to split them
+const char* const fragments[] = {
+	"var", "function", "return", "while", "x", "_count", "abc123", "1", "42", "3.5", "0.25",
+	"\"\"", "\"text\"", "\"a\\tb\\\\c\\\"d\\n\"", "\"0123456789abcdefghijklmnopqrstuvwxyz0123456789\"",
+	"// comment\n", "/* comment */", "/* * / **/", "+", "-", "*", "/", "==", "!=", "<=", "+=", ";", "(", ")",
+	"{", "}", ",", " ", "  ", "\t", "\n", "\r\n", "                                  ",
+	// Text that doesn't tokenize, so the errors are compared as well
+	"\"unterminated", "\"bad \\q escape\"", "/* unterminated", "@",
+};
+
+bool is_available(wolfscript::scan_isa pIsa)
+{
+#ifdef WOLFSCRIPT_SCAN_X86_64
+	return pIsa != wolfscript::scan_isa::avx2 || wolfscript::detail::cpu_supports_avx2();
+#else
+	return pIsa == wolfscript::scan_isa::scalar;
+#endif
+}
+
+std::string random_text(std::mt19937& pRandom)
+{
+	// Long enough for the vector loops and their tails
+	std::string result(pRandom() % 300, ' ');
+	// Runs of one character give the kernels long stretches to skip
+	const bool runs = pRandom() % 2 == 0;
+	char c = ' ';
+	for (auto& i : result)
+	{
+		if (!runs || pRandom() % 16 == 0)
+			c = alphabet[pRandom() % (sizeof(alphabet) - 1)];
+		i = c;
+	}
+	return result;
+}
+
+std::string random_source(std::mt19937& pRandom)
+{
+	std::string result;
+	const std::size_t count = pRandom() % 64;
+	for (std::size_t i = 0; i < count; i++)
+	{
+		// Mostly text that tokenizes, so the errors don't stop it early
+		std::size_t fragment = pRandom() % std::size(fragments);
+		if (fragment >= std::size(fragments) - 4 && pRandom() % 8 != 0)
+			fragment = 0;
+		result += fragments[fragment];
+		result += ' ';
+	}
+	return result;
+}
+
+// Runs each kernel from every offset of the text. The text is copied to
+// its own allocation so reading past the end can be caught by a sanitizer.
+std::string scan_all(const wolfscript::detail::scan_kernels& pKernels, const std::string& pText)
+{
+	std::ostringstream out;
+	const std::vector<char> text(pText.begin(), pText.end());
+	for (std::size_t i = 0; i <= text.size(); i++)
+	{
+		const char* str = text.data() + i;
+		const std::size_t length = text.size() - i;
+		out << pKernels.find_non_whitespace(str, length) << ','
+			<< pKernels.find_identifier_end(str, length) << ','
+			<< pKernels.find_string_special(str, length) << ','
+			<< pKernels.find_comment_end(str, length) << ' ';
+	}
+	return out.str();
+}
+
+std::string tokenize_all(wolfscript::scan_isa pIsa, const std::string& pSource)
+{
+	wolfscript::set_scan_isa(pIsa);
+	std::ostringstream out;
+	try
+	{
+		for (const auto& i : wolfscript::tokenize(pSource))
+		{
+			out << static_cast<int>(i.type) << ':' << i.offset << ':' << i.text.length() << ':' << i.text << ':';
+			if (const int* value = std::get_if<int>(&i.value))
+				out << *value;
+			else
+				out << std::get<float>(i.value);
+			out << '\n';
+		}
+	}
+	catch (wolfscript::exception::wolf_exception& e)
+	{
+		out << "Error @" << e.offset << ": " << e.what() << '\n';
+	}
+	return out.str();
+}
+
+bool parse_option(const char* pArg, const char* pName, unsigned long& pValue)
+{
+	const std::size_t length = std::strlen(pName);
+	if (std::strncmp(pArg, pName, length) != 0 || pArg[length] != '=')
+		return false;
+	pValue = std::strtoul(pArg + length + 1, nullptr, 10);
+	return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	unsigned long iterations = 2000;
+	unsigned long seed = 1;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!parse_option(argv[i], "--iterations", iterations) && !parse_option(argv[i], "--seed", seed))
+		{
+			std::cerr << "Usage: wolfscript_scan_test [--iterations=<n>] [--seed=<n>]\n";
+			return 2;
+		}
+	}
+
+	std::vector<isa_info> available;
+	for (const auto& i : isas)
+		if (is_available(i.isa))
+			available.push_back(i);
+	for (const auto& i : available)
+		std::cout << "Testing " << i.name << "\n";
+
+	std::mt19937 random(static_cast<std::mt19937::result_type>(seed));
+	for (unsigned long i = 0; i < iterations; i++)
+	{
+		const std::string text = random_text(random);
+		const std::string expected = scan_all(wolfscript::detail::get_scan_kernels(available[0].isa), text);
+		for (std::size_t j = 1; j < available.size(); j++)
+		{
+			if (scan_all(wolfscript::detail::get_scan_kernels(available[j].isa), text) != expected)
+			{
+				std::cout << "The " << available[j].name << " kernels differ from the scalar ones for \"" << text << "\"\n";
+				return 1;
+			}
+		}
+
+		const std::string source = random_source(random);
+		const std::string tokens = tokenize_all(available[0].isa, source);
+		for (std::size_t j = 1; j < available.size(); j++)
+		{
+			if (tokenize_all(available[j].isa, source) != tokens)
+			{
+				std::cout << "The " << available[j].name << " tokens differ from the scalar ones for \"" << source << "\"\n";
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
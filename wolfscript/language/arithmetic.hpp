@@ -63,7 +63,11 @@ value_type arithmetic_binary_operation_impl(token_type pOp, const value_type& pL
 				throw exception::arithmetic_error("Divide by 0");
 			return pLval / r_casted;
 			break;
-		case token_type::mod: return mod_impl(pLval, r_casted); break;
+		case token_type::mod:
+			if (r_casted == 0)
+				throw exception::arithmetic_error("Divide by 0");
+			return mod_impl(pLval, r_casted);
+			break;
 
 		case token_type::less_than: return pLval < r_casted; break;
 		case token_type::less_than_equ_to: return pLval <= r_casted; break;
@@ -98,7 +102,11 @@ value_type arithmetic_binary_operation_impl(token_type pOp, const value_type& pL
 			case token_type::add_assign: pLval += r_casted; return pL;
 			case token_type::sub_assign: pLval -= r_casted; return pL;
 			case token_type::mul_assign: pLval *= r_casted; return pL;
-			case token_type::div_assign: pLval /= r_casted; return pL;
+			case token_type::div_assign:
+				if (r_casted == 0)
+					throw exception::arithmetic_error("Divide by 0");
+				pLval /= r_casted;
+				return pL;
 			}
 		}
 	}
@@ -140,7 +148,7 @@ auto visit_arithmetic(const value_type& pVal, Tcallable&& pCallable)
 } // namespace detail
 
 // Perform a binary operation with 2 value_type object with arithmetic types.
-value_type arithmetic_binary_operation(token_type pOp, const value_type& pL, const value_type& pR)
+inline value_type arithmetic_binary_operation(token_type pOp, const value_type& pL, const value_type& pR)
 {
 	assert(pL.is_arithmetic());
 	assert(pR.is_arithmetic());
@@ -156,7 +164,7 @@ value_type arithmetic_binary_operation(token_type pOp, const value_type& pL, con
 }
 
 // Perform a unary operation with a single value_type object with an arithmetic type.
-value_type arithmetic_unary_operation(token_type pOp, const value_type& pU)
+inline value_type arithmetic_unary_operation(token_type pOp, const value_type& pU)
 {
 	assert(pU.get_type_info().is_arithmetic);
 	auto lvisit = [pOp, &pU](auto& pLtype) -> value_type
@@ -208,7 +216,93 @@ value_type arithmetic_unary_operation(token_type pOp, const value_type& pU)
 	return detail::visit_arithmetic(pU, lvisit);
 }
 
-std::string arithmetic_to_string(const value_type& pVal)
+// The operations above on numbers that aren't boxed in a value_type.
+// They follow the same rules, the right value is cast to the type of the
+// left. Operations that aren't allowed on bools mustn't be given them.
+template <typename Tl, typename Tr>
+bool typed_comparison(token_type pOp, Tl pL, Tr pR)
+{
+	const Tl r = static_cast<Tl>(pR);
+	switch (pOp)
+	{
+	case token_type::equ: return pL == r;
+	case token_type::not_equ: return pL != r;
+	}
+	if constexpr (!std::is_same_v<Tl, bool> && !std::is_same_v<Tr, bool>)
+	{
+		switch (pOp)
+		{
+		case token_type::less_than: return pL < r;
+		case token_type::less_than_equ_to: return pL <= r;
+		case token_type::greater_than: return pL > r;
+		case token_type::greater_than_equ_to: return pL >= r;
+		}
+	}
+	throw exception::arithmetic_error("Unknown operation");
+}
+
+template <typename Tl, typename Tr>
+Tl typed_arithmetic(token_type pOp, Tl pL, Tr pR)
+{
+	if constexpr (!std::is_same_v<Tl, bool> && !std::is_same_v<Tr, bool>)
+	{
+		const Tl r = static_cast<Tl>(pR);
+		switch (pOp)
+		{
+		case token_type::add: return pL + r;
+		case token_type::sub: return pL - r;
+		case token_type::mul: return pL * r;
+		case token_type::div:
+			if (r == 0)
+				throw exception::arithmetic_error("Divide by 0");
+			return pL / r;
+		case token_type::mod:
+			if (r == 0)
+				throw exception::arithmetic_error("Divide by 0");
+			return detail::mod_impl(pL, r);
+		}
+	}
+	throw exception::arithmetic_error("Unknown operation");
+}
+
+template <typename Tl, typename Tr>
+void typed_assignment(token_type pOp, Tl& pL, Tr pR)
+{
+	const Tl r = static_cast<Tl>(pR);
+	if (pOp == token_type::assign)
+	{
+		pL = r;
+		return;
+	}
+	if constexpr (!std::is_same_v<Tl, bool> && !std::is_same_v<Tr, bool>)
+	{
+		switch (pOp)
+		{
+		case token_type::add_assign: pL += r; return;
+		case token_type::sub_assign: pL -= r; return;
+		case token_type::mul_assign: pL *= r; return;
+		case token_type::div_assign:
+			if (r == 0)
+				throw exception::arithmetic_error("Divide by 0");
+			pL /= r;
+			return;
+		}
+	}
+	throw exception::arithmetic_error("Unknown operation");
+}
+
+template <typename T>
+T typed_unary(token_type pOp, T pU)
+{
+	if constexpr (!std::is_same_v<T, bool>)
+	{
+		if (pOp == token_type::sub)
+			return -pU;
+	}
+	return pU;
+}
+
+inline std::string arithmetic_to_string(const value_type& pVal)
 {
 	assert(pVal.is_arithmetic());
 	auto visitor = [](const auto& pVal) -> std::string
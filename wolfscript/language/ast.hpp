@@ -1,10 +1,15 @@
 #pragma once
 
 #include "token.hpp"
+#include "tokenizer.hpp"
+#include "value_type.hpp"
 #include <iostream>
+#include <limits>
 #include <set>
 #include <memory>
+#include <memory_resource>
 #include <list>
+#include <vector>
 
 namespace wolfscript
 {
@@ -47,22 +52,71 @@ struct AST_visitor
 	virtual void dispatch(AST_node_continue*) {}
 };
 
+// Locals live in the slots of the frame of the function they are declared
+// in. These are given out by the resolver. A name that isn't a local of
+// any function around it is left as unresolved_slot.
+constexpr std::uint32_t unresolved_slot = std::numeric_limits<std::uint32_t>::max();
+
+// The slots of a frame that a scope declares its locals in.
+// They are cleared when the scope is left.
+struct slot_range
+{
+	std::uint32_t begin{ 0 };
+	std::uint32_t end{ 0 };
+};
+
+// A variable a function uses from a function around it. Functions keep
+// the variables they capture with them, so they can be used after the
+// function they were declared in has returned.
+struct AST_capture
+{
+	// The slot of the local in the function this one is declared in,
+	// or the capture of that function if the local is from further out
+	std::uint32_t index{ 0 };
+	bool is_capture{ false };
+};
+
+// The type an expression is known to give before it is run.
+// Set by the type_inferrer.
+enum class known_type : unsigned char
+{
+	unknown,
+	boolean,
+	integer,
+	floating,
+};
+
+// Nodes are created in an AST_arena which owns them and their children.
+// They are never destroyed on their own, so everything they hold has to
+// be allocated from the arena or trivially destructible.
 struct AST_node
 {
-	using ptr = std::unique_ptr<AST_node>;
+	// Only valid as long as the arena of the node
+	using ptr = AST_node*;
 
+	AST_node(std::pmr::memory_resource* pResource = std::pmr::get_default_resource()) :
+		children(pResource)
+	{}
 	virtual ~AST_node() {}
 	virtual void visit(AST_visitor*) = 0;
 	virtual bool is_empty() const = 0;
 
-	std::vector<std::unique_ptr<AST_node>> children;
-	token related_token;
+	std::pmr::vector<AST_node*> children;
+	// Offset in the source of the token this node was created from
+	std::uint32_t offset{ unknown_offset };
+	// Set if this is an expression that can be run on numbers that aren't
+	// boxed. For an assignment, this is the type of the local it assigns.
+	known_type inferred{ known_type::unknown };
+	// Set by the loop_hoister if this expression gives the same value on
+	// every pass through a loop. It is kept in this slot once evaluated.
+	std::uint32_t invariant_slot{ unresolved_slot };
 };
 
 template<class T>
 struct AST_node_impl :
 	AST_node
 {
+	using AST_node::AST_node;
 	virtual ~AST_node_impl() {}
 	void visit(AST_visitor* pVisitor) override
 	{
@@ -78,6 +132,8 @@ struct AST_node_impl :
 struct AST_node_empty :
 	AST_node_impl<AST_node_empty>
 {
+	using AST_node_impl::AST_node_impl;
+
 	virtual bool is_empty() const override
 	{
 		return true;
@@ -86,41 +142,84 @@ struct AST_node_empty :
 
 struct AST_node_block :
 	AST_node_impl<AST_node_block>
-{};
+{
+	using AST_node_impl::AST_node_impl;
+
+	slot_range locals;
+};
 
 struct AST_node_variable :
 	AST_node_impl<AST_node_variable>
 {
+	using AST_node_impl::AST_node_impl;
+
 	bool is_const{ false };
 	std::string_view identifier;
+	std::uint32_t slot{ unresolved_slot };
+	// False if nothing but the local can refer to its value, so the value
+	// can be used again once its scope ends. Set by the escape_analyzer.
+	bool escapes{ true };
+};
+
+// The number types an operator was run with so far. The interpreter keeps
+// this for operators the type_inferrer couldn't type, so they can be run
+// on those types directly while the operands keep having them.
+struct operand_feedback
+{
+	known_type left{ known_type::unknown };
+	known_type right{ known_type::unknown };
+	// Set once the operator was run with other operands, it is always
+	// run the generic way after that.
+	bool generic{ false };
+
+	bool is_quickened() const
+	{
+		return left != known_type::unknown && !generic;
+	}
 };
 
 struct AST_node_unary_op :
 	AST_node_impl<AST_node_unary_op>
 {
+	using AST_node_impl::AST_node_impl;
+
 	token_type type;
+	operand_feedback feedback;
 };
 
 struct AST_node_binary_op :
 	AST_node_impl<AST_node_binary_op>
 {
+	using AST_node_impl::AST_node_impl;
+
 	token_type type;
+	operand_feedback feedback;
 };
 
 struct AST_node_member_accessor :
 	AST_node_impl<AST_node_member_accessor>
 {
+	using AST_node_impl::AST_node_impl;
+
 	std::string_view identifier;
 };
 
 struct AST_node_constant :
 	AST_node_impl<AST_node_constant>
 {
+	using AST_node_impl::AST_node_impl;
+
+	// The immutable value interned in the constant_pool of the arena
+	const value_type* value{ nullptr };
+	// The text of the literal as written
+	std::string_view text;
 };
 
 struct AST_node_if :
 	AST_node_impl<AST_node_if>
 {
+	using AST_node_impl::AST_node_impl;
+
 	std::size_t elseif_count{ 0 };
 	// If true, the last child is the else statement
 	bool has_else{ false };
@@ -129,27 +228,61 @@ struct AST_node_if :
 struct AST_node_for :
 	AST_node_impl<AST_node_for>
 {
+	using AST_node_impl::AST_node_impl;
+
+	// The scope of the first statement
+	slot_range locals;
+	// The scope of each pass through the body
+	slot_range body_locals;
+	// The slots of the invariant expressions in the loop
+	slot_range invariants;
 };
 
 struct AST_node_while :
 	AST_node_impl<AST_node_while>
 {
+	using AST_node_impl::AST_node_impl;
+
+	// The scope of each pass through the body
+	slot_range body_locals;
+	// The slots of the invariant expressions in the loop
+	slot_range invariants;
 };
 
 struct AST_node_identifier :
 	AST_node_impl<AST_node_identifier>
 {
+	using AST_node_impl::AST_node_impl;
+
 	std::string_view identifier;
+	// How many functions out the local is declared
+	std::uint32_t depth{ 0 };
+	std::uint32_t slot{ unresolved_slot };
+	// The capture of the function the name is used in, if the depth isn't 0
+	std::uint32_t capture{ 0 };
 };
 
 struct AST_node_function_call :
 	AST_node_impl<AST_node_function_call>
 {
+	using AST_node_impl::AST_node_impl;
+
+	// The function the callee should be, if its body is run straight from
+	// this call. Set by the function_inliner.
+	AST_node_function_declaration* inlined{ nullptr };
+	// The call_cache of this call in the interpreter that ran it last
+	std::uint32_t call_cache{ unresolved_slot };
 };
 
 struct AST_node_function_declaration :
 	AST_node_impl<AST_node_function_declaration>
 {
+	AST_node_function_declaration(std::pmr::memory_resource* pResource = std::pmr::get_default_resource()) :
+		AST_node_impl(pResource),
+		parameters(pResource),
+		captures(pResource)
+	{}
+
 	// This is empty if this is an anonymous function
 	std::string_view identifier;
 
@@ -160,25 +293,37 @@ struct AST_node_function_declaration :
 		bool is_const{ false };
 		token type;
 	};
-	std::vector<param> parameters;
+	std::pmr::vector<param> parameters;
 
 	bool has_return_type{ false };
 	token return_type;
+
+	// Where a named function is declared in the frame around it
+	std::uint32_t slot{ unresolved_slot };
+	// The parameters take the first slots of the frame
+	std::uint32_t frame_size{ 0 };
+	// What the function captures when it is declared. Set by the resolver.
+	std::pmr::vector<AST_capture> captures;
+	// The jit_function of this function in the interpreter that ran it last
+	std::uint32_t jit{ unresolved_slot };
 };
 
 struct AST_node_return :
 	AST_node_impl<AST_node_return>
 {
+	using AST_node_impl::AST_node_impl;
 };
 
 struct AST_node_break :
 	AST_node_impl<AST_node_break>
 {
+	using AST_node_impl::AST_node_impl;
 };
 
 struct AST_node_continue :
 	AST_node_impl<AST_node_continue>
 {
+	using AST_node_impl::AST_node_impl;
 };
 
 // This visitor prints out the AST for debugging
@@ -296,12 +441,15 @@ public:
 	virtual void dispatch(AST_node_constant* pNode)
 	{
 		std::cout << get_indent() << "Constant <";
-		if (pNode->related_token.type == token_type::string)
-			std::cout << std::get<std::string>(pNode->related_token.value);
-		else if (pNode->related_token.type == token_type::integer)
-			std::cout << std::get<int>(pNode->related_token.value);
-		else if (pNode->related_token.type == token_type::floating)
-			std::cout << std::get<float>(pNode->related_token.value);
+		if (pNode->value && pNode->value->get<const std::string>())
+		{
+			// The text of a string is still escaped
+			std::string unescaped;
+			detail::unescape_string(pNode->text, unescaped);
+			std::cout << unescaped;
+		}
+		else
+			std::cout << pNode->text;
 		std::cout << ">\n";
 	}
 
@@ -431,6 +579,23 @@ private:
 	}
 };
 
+// Returns the node if it is an identifier, otherwise nullptr
+inline AST_node_identifier* as_identifier(AST_node* pNode)
+{
+	struct getter :
+		AST_visitor
+	{
+		virtual void dispatch(AST_node_identifier* pNode) override
+		{
+			identifier = pNode;
+		}
+
+		AST_node_identifier* identifier{ nullptr };
+	} g;
+	pNode->visit(&g);
+	return g.identifier;
+}
+
 // Traverses the AST to find symbols not defined locally.
 class AST_nonlocal_symbols_finder :
 	public AST_walker
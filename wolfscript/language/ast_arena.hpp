@@ -0,0 +1,123 @@
+#pragma once
+
+#include "ast.hpp"
+#include "constant_pool.hpp"
+
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace wolfscript
+{
+
+// Owns the nodes, child lists and constants of a parsed script.
+// Nodes are bump allocated next to each other out of large blocks and
+// are never destroyed one by one. The blocks are all released at once
+// when the arena is destroyed.
+class AST_arena
+{
+public:
+	AST_arena() = default;
+	AST_arena(const AST_arena&) = delete;
+	AST_arena& operator=(const AST_arena&) = delete;
+
+	template <typename T>
+	T* create()
+	{
+		static_assert(std::is_base_of_v<AST_node, T>, "Only AST nodes can be created in an arena");
+		return new (mResource.allocate(sizeof(T), alignof(T))) T(&mResource);
+	}
+
+	constant_pool& constants()
+	{
+		return mConstants;
+	}
+
+	// Allocates the child lists of the nodes
+	std::pmr::memory_resource* resource()
+	{
+		return &mResource;
+	}
+
+	// Keeps another arena alive for as long as this one, so nodes of
+	// several parses can be linked into one tree.
+	void adopt(std::unique_ptr<AST_arena> pArena)
+	{
+		mAdopted.push_back(std::move(pArena));
+	}
+
+private:
+	// Starts small and grows geometrically, so the many small trees of an
+	// incremental_parser stay small too
+	std::pmr::monotonic_buffer_resource mResource;
+	constant_pool mConstants;
+	std::vector<std::unique_ptr<AST_arena>> mAdopted;
+};
+
+// The result of a parse. The nodes are only valid as long as the
+// tree that owns their arena.
+class AST_tree
+{
+public:
+	AST_tree() = default;
+	AST_tree(std::unique_ptr<AST_arena> pArena, AST_node* pRoot) :
+		mArena(std::move(pArena)),
+		mRoot(pRoot)
+	{}
+
+	AST_tree(AST_tree&& pOther) noexcept :
+		mArena(std::move(pOther.mArena)),
+		mRoot(pOther.mRoot)
+	{
+		pOther.mRoot = nullptr;
+	}
+
+	AST_tree& operator=(AST_tree&& pOther) noexcept
+	{
+		mArena = std::move(pOther.mArena);
+		mRoot = pOther.mRoot;
+		pOther.mRoot = nullptr;
+		return *this;
+	}
+
+	AST_node* get() const
+	{
+		return mRoot;
+	}
+
+	AST_node* operator->() const
+	{
+		return mRoot;
+	}
+
+	AST_node& operator*() const
+	{
+		return *mRoot;
+	}
+
+	explicit operator bool() const
+	{
+		return mRoot != nullptr;
+	}
+
+	AST_arena& arena() const
+	{
+		return *mArena;
+	}
+
+	// Takes over the nodes of another tree so they can be linked into
+	// this one. The other tree is left empty.
+	void adopt(AST_tree&& pOther)
+	{
+		mArena->adopt(std::move(pOther.mArena));
+		pOther.mRoot = nullptr;
+	}
+
+private:
+	std::unique_ptr<AST_arena> mArena;
+	AST_node* mRoot{ nullptr };
+};
+
+} // namespace wolfscript
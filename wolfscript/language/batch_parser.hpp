@@ -0,0 +1,305 @@
+#pragma once
+
+#include "parser.hpp"
+#include "line_index.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace wolfscript
+{
+
+namespace detail
+{
+
+constexpr bool is_identifier_char(char c)
+{
+	return is_letter(c) || is_digit(c) || c == '_';
+}
+
+// Finds where a source can be cut into pieces that each start with a
+// top-level function declaration and are at least pMin_size long.
+// This is only a quick scan over the text that skips comments and
+// strings, so a piece that doesn't parse on its own has to be checked
+// by parsing the whole source.
+inline std::vector<std::uint32_t> find_function_splits(std::string_view pSource, std::size_t pMin_size)
+{
+	std::vector<std::uint32_t> splits;
+	std::size_t last = 0;
+	std::size_t depth = 0;
+	// The last character that isn't whitespace or a comment.
+	// A declaration can only follow the end of another statement.
+	char previous = ';';
+	std::size_t i = 0;
+	while (i < pSource.length())
+	{
+		const char c = pSource[i];
+		if (is_whitespace(c))
+		{
+			++i;
+		}
+		else if (pSource.compare(i, 2, "//") == 0)
+		{
+			i = pSource.find('\n', i);
+			if (i == std::string_view::npos)
+				break;
+		}
+		else if (pSource.compare(i, 2, "/*") == 0)
+		{
+			i = pSource.find("*/", i + 2);
+			if (i == std::string_view::npos)
+				break;
+			i += 2;
+		}
+		else if (c == '\"')
+		{
+			++i; // Skip "
+			while (i < pSource.length() && pSource[i] != '\"')
+				i += pSource[i] == '\\' ? 2 : 1;
+			if (i >= pSource.length())
+				break;
+			++i; // Skip "
+			previous = c;
+		}
+		else if (is_identifier_char(c))
+		{
+			std::size_t end = i;
+			while (end < pSource.length() && is_identifier_char(pSource[end]))
+				++end;
+			if (depth == 0 && (previous == ';' || previous == '}')
+				&& i > last && i - last >= pMin_size
+				&& pSource.substr(i, end - i) == "function")
+			{
+				// Anonymous functions don't have a name
+				std::size_t name = end;
+				while (name < pSource.length() && is_whitespace(pSource[name]))
+					++name;
+				if (name < pSource.length() && is_letter(pSource[name]))
+				{
+					splits.push_back(static_cast<std::uint32_t>(i));
+					last = i;
+				}
+			}
+			previous = c;
+			i = end;
+		}
+		else
+		{
+			if (c == '{' || c == '(')
+				++depth;
+			else if (c == '}' || c == ')')
+			{
+				// Leave the rest to the parser to complain about
+				if (depth == 0)
+					break;
+				--depth;
+			}
+			previous = c;
+			++i;
+		}
+	}
+	return splits;
+}
+
+} // namespace detail
+
+// The outcome of parsing one source of a batch
+struct batch_result
+{
+	AST_tree tree;
+	// Set instead of the tree if the source didn't parse.
+	// The position of the exception is already resolved.
+	std::exception_ptr error;
+
+	// Returns the tree or throws the tokenization_error or parse_error
+	// of the source.
+	AST_tree& get()
+	{
+		if (error)
+			std::rethrow_exception(error);
+		return tree;
+	}
+};
+
+// Parses many sources at once on a pool of threads. Sources larger than
+// the split size are also cut at their top-level function declarations
+// so the pieces of one large source are parsed in parallel as well.
+// Each source gets an AST_tree of its own that is the same as the one
+// parser::parse(std::string_view) gives, no matter how many threads
+// are used. Like with the parser, the sources MUST outlive the trees.
+class batch_parser
+{
+public:
+	// Uses a thread per core if the thread count is 0
+	batch_parser(std::size_t pThread_count = 0) :
+		mThread_count(pThread_count)
+	{}
+
+	void set_thread_count(std::size_t pCount)
+	{
+		mThread_count = pCount;
+	}
+
+	std::size_t thread_count() const
+	{
+		if (mThread_count != 0)
+			return mThread_count;
+		return std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+	}
+
+	// Sources are cut into pieces of at least this many bytes.
+	// 0 disables cutting sources.
+	void set_split_size(std::size_t pBytes)
+	{
+		mSplit_size = pBytes;
+	}
+
+	std::size_t split_size() const
+	{
+		return mSplit_size;
+	}
+
+	std::vector<batch_result> parse(const std::vector<std::string_view>& pSources) const
+	{
+		std::vector<piece> pieces;
+		for (std::size_t i = 0; i < pSources.size(); i++)
+		{
+			const std::string_view source = pSources[i];
+			std::vector<std::uint32_t> splits;
+			// Too large sources are left for the parser to report
+			if (mSplit_size != 0 && source.length() >= mSplit_size * 2 && source.length() < unknown_offset)
+				splits = detail::find_function_splits(source, mSplit_size);
+			std::uint32_t begin = 0;
+			for (std::size_t j = 0; j <= splits.size(); j++)
+			{
+				const std::uint32_t end = j < splits.size() ? splits[j] : static_cast<std::uint32_t>(source.length());
+				pieces.push_back({ i, source.substr(begin, end - begin), begin, splits.empty() });
+				begin = end;
+			}
+		}
+
+		// The largest pieces go first so no thread is left with a large
+		// one at the end
+		std::vector<std::size_t> order(pieces.size());
+		for (std::size_t i = 0; i < order.size(); i++)
+			order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&](std::size_t l, std::size_t r)
+		{
+			return pieces[l].text.length() > pieces[r].text.length();
+		});
+
+		std::atomic<std::size_t> next{ 0 };
+		auto worker = [&]()
+		{
+			parser p;
+			for (std::size_t i = next++; i < order.size(); i = next++)
+			{
+				piece& job = pieces[order[i]];
+				try
+				{
+					token_stream stream(job.text, job.base);
+					job.tree = p.parse(stream);
+				}
+				catch (exception::wolf_exception& e)
+				{
+					// A source that was cut is parsed again as a whole
+					// to find its error, see merge()
+					if (job.is_whole)
+						e.resolve_position(line_index(job.text));
+					job.error = std::current_exception();
+				}
+				catch (...)
+				{
+					job.error = std::current_exception();
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		const std::size_t thread_count = std::min(this->thread_count(), pieces.size());
+		for (std::size_t i = 1; i < thread_count; i++)
+			threads.emplace_back(worker);
+		worker();
+		for (auto& i : threads)
+			i.join();
+
+		std::vector<batch_result> results(pSources.size());
+		for (std::size_t i = 0; i < pieces.size();)
+		{
+			const std::size_t source = pieces[i].source;
+			std::size_t end = i;
+			while (end < pieces.size() && pieces[end].source == source)
+				++end;
+			results[source] = merge(pSources[source], pieces.data() + i, pieces.data() + end);
+			i = end;
+		}
+		return results;
+	}
+
+private:
+	struct piece
+	{
+		std::size_t source;
+		std::string_view text;
+		// Offset of the piece in its source
+		std::uint32_t base;
+		bool is_whole;
+		AST_tree tree{};
+		std::exception_ptr error{};
+	};
+
+	// Links the statements of the pieces of a source into one tree
+	static batch_result merge(std::string_view pSource, piece* pBegin, piece* pEnd)
+	{
+		batch_result result;
+		if (pEnd - pBegin == 1)
+		{
+			result.tree = std::move(pBegin->tree);
+			result.error = pBegin->error;
+			return result;
+		}
+
+		for (piece* i = pBegin; i != pEnd; ++i)
+		{
+			// The source was cut in the wrong place or it really has an error.
+			// Either way, parsing all of it gives the right result.
+			if (i->error)
+			{
+				try
+				{
+					parser p;
+					result.tree = p.parse(pSource);
+				}
+				catch (...)
+				{
+					result.error = std::current_exception();
+				}
+				return result;
+			}
+		}
+
+		result.tree = std::move(pBegin->tree);
+		auto& statements = result.tree->children;
+		std::size_t count = 0;
+		for (piece* i = pBegin; i != pEnd; ++i)
+			count += i == pBegin ? statements.size() : i->tree->children.size();
+		statements.reserve(count);
+		for (piece* i = pBegin + 1; i != pEnd; ++i)
+		{
+			statements.insert(statements.end(), i->tree->children.begin(), i->tree->children.end());
+			result.tree.adopt(std::move(i->tree));
+		}
+		return result;
+	}
+
+private:
+	std::size_t mThread_count;
+	std::size_t mSplit_size{ 64 * 1024 };
+};
+
+} // namespace wolfscript
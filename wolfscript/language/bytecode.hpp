@@ -0,0 +1,673 @@
+#pragma once
+
+#include "ast.hpp"
+#include "token.hpp"
+#include "type_inferrer.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#if defined(__GNUC__)
+// Each instruction jumps straight to the code of the next one
+#define WOLFSCRIPT_THREADED_DISPATCH
+#endif
+
+namespace wolfscript
+{
+
+// The instructions of the bytecode. r[] are the registers of the function,
+// which hold the values of the expressions being evaluated, and n[] are its
+// number registers, which hold numbers that aren't boxed. a, b and c are
+// the operands of the instruction. An instruction that jumps takes the
+// target from c.
+enum class opcode : unsigned char
+{
+	// r[a] = the value of the constant
+	constant,
+	// r[a] = void
+	void_value,
+	// r[a] = the value of the identifier
+	load,
+	// r[a] = r[b] with the unary operator applied
+	unary,
+	// unary for the operand type the operator was quickened for. It is
+	// rewritten back to unary if r[b] doesn't have it.
+	quick_unary,
+	// r[a] = r[b] and r[c] with the binary operator applied
+	binary,
+	// binary for the operand types the operator was quickened for
+	quick_binary,
+	// r[a] = the member of r[b]
+	member,
+	// r[a] = r[b] called with the c arguments after it
+	call,
+	// Declares the function with bytecode b, r[a] = the function if it is
+	// anonymous
+	function,
+	// Declares the variable with r[b]
+	declare,
+	// Declares the variable with n[b]
+	number_declare,
+	// n[a] = the number in b
+	number_constant,
+	// n[a] = the number in the identifier. Jumps if it holds no number of
+	// the type.
+	number_load,
+	// n[a] = n[b] with the unary operator applied
+	number_unary,
+	// n[a] = n[b] and n[c] with the binary operator applied
+	number_binary,
+	// Assigns n[b] to the identifier in place, r[a] = the identifier.
+	// Jumps if it holds no number of the type.
+	number_assign,
+	// r[a] = n[b] boxed
+	box,
+	jump,
+	// Jumps if r[b] is false
+	jump_if_false,
+	// Jumps if n[b] is false
+	number_jump_if_false,
+	// Clears the locals in the slots from a up to b
+	clear_locals,
+	// r[a] = the value of the invariant in slot b and jumps, if it was
+	// evaluated in this run of its loop
+	invariant,
+	// Keeps r[b] as the value of the invariant in slot a
+	store_invariant,
+	// Returns r[b]
+	return_value,
+	return_void,
+
+	count
+};
+
+// The result of an instruction isn't kept if this is its register
+constexpr std::uint32_t no_register = std::numeric_limits<std::uint32_t>::max();
+
+struct instruction
+{
+	// Rewritten while running when an operator is quickened
+	mutable opcode op;
+	token_type token{ token_type::unknown };
+	// The types of the number operands
+	known_type left{ known_type::unknown };
+	known_type right{ known_type::unknown };
+	std::uint32_t a{ 0 };
+	std::uint32_t b{ 0 };
+	std::uint32_t c{ 0 };
+	// The node this was compiled from
+	AST_node* node{ nullptr };
+};
+
+// The bytecode of a function, or of the root of a tree
+struct bytecode_function
+{
+	std::vector<instruction> code;
+	// The offset in the source of the statement of each instruction
+	std::vector<std::uint32_t> offsets;
+	std::uint32_t registers{ 0 };
+	std::uint32_t numbers{ 0 };
+	// The functions declared in this one
+	std::vector<std::shared_ptr<const bytecode_function>> functions;
+};
+
+// Compiles a tree to the bytecode the interpreter runs on its register
+// machine. The other passes have to be run on the tree first. The bytecode
+// refers to the nodes, so the tree has to outlive it.
+//
+// An expression the type_inferrer typed is compiled twice, once on number
+// registers and once on values. The number instructions jump to the other
+// code if a name doesn't hold the type inferred for it. Typed expressions
+// don't change anything, so they can always be run again that way.
+class bytecode_compiler :
+	private AST_visitor
+{
+public:
+	std::shared_ptr<const bytecode_function> compile(AST_node* pRoot)
+	{
+		return compile_function(pRoot);
+	}
+
+private:
+	// A place in the code that is jumped to
+	struct label
+	{
+		bool placed{ false };
+		std::uint32_t target{ 0 };
+		// The jumps to it before it was placed
+		std::vector<std::size_t> jumps;
+	};
+
+	struct loop
+	{
+		// The scopes of the loop start here
+		std::size_t scope;
+		label* exit;
+		label* next;
+	};
+
+	// What is being compiled of the current function
+	struct function_state
+	{
+		bytecode_function* code{ nullptr };
+		std::uint32_t registers{ 0 };
+		std::uint32_t numbers{ 0 };
+		std::vector<slot_range> scopes;
+		std::vector<loop> loops;
+		std::uint32_t offset{ unknown_offset };
+		// Set while compiling an expression again after its number code
+		bool values_only{ false };
+	};
+
+	// Compiles typed expressions to number instructions. The result is
+	// left in the first number register that was free.
+	class number_compiler :
+		public AST_visitor
+	{
+	public:
+		number_compiler(bytecode_compiler& pCompiler, label& pFail) :
+			mCompiler(pCompiler),
+			mFail(pFail)
+		{}
+
+		std::uint32_t compile(AST_node* pNode)
+		{
+			const std::uint32_t result = mCompiler.mState.numbers;
+			bool valid = false;
+			if (pNode->inferred != known_type::unknown)
+			{
+				const bool outer = std::exchange(mValid, false);
+				pNode->visit(this);
+				valid = std::exchange(mValid, outer);
+			}
+			if (!valid)
+			{
+				mCompiler.emit(opcode::jump);
+				mCompiler.jumps_to(mFail);
+				mCompiler.mState.numbers = result;
+				mCompiler.allocate_number();
+			}
+			return result;
+		}
+
+	private:
+		virtual void dispatch(AST_node_constant* pNode) override
+		{
+			scalar number;
+			if (!pNode->value || !unbox(*pNode->value, pNode->inferred, number))
+				return;
+			instruction& i = mCompiler.emit(opcode::number_constant, mCompiler.allocate_number(), 0, 0, pNode);
+			static_assert(sizeof(scalar) == sizeof(i.b), "The number has to fit in an operand");
+			std::memcpy(&i.b, &number, sizeof(scalar));
+			mValid = true;
+		}
+
+		virtual void dispatch(AST_node_identifier* pNode) override
+		{
+			mCompiler.emit(opcode::number_load, mCompiler.allocate_number(), 0, 0, pNode).left = pNode->inferred;
+			mCompiler.jumps_to(mFail);
+			mValid = true;
+		}
+
+		virtual void dispatch(AST_node_unary_op* pNode) override
+		{
+			const std::uint32_t u = compile(pNode->children[0]);
+			instruction& i = mCompiler.emit(opcode::number_unary, u, u, 0, pNode);
+			i.token = pNode->type;
+			i.left = pNode->inferred;
+			mValid = true;
+		}
+
+		virtual void dispatch(AST_node_binary_op* pNode) override
+		{
+			if (is_assignment(pNode->type))
+				return;
+			const std::uint32_t l = compile(pNode->children[0]);
+			const std::uint32_t r = compile(pNode->children[1]);
+			instruction& i = mCompiler.emit(opcode::number_binary, l, l, r, pNode);
+			i.token = pNode->type;
+			i.left = pNode->children[0]->inferred;
+			i.right = pNode->children[1]->inferred;
+			mCompiler.mState.numbers = r;
+			mValid = true;
+		}
+
+	private:
+		bytecode_compiler& mCompiler;
+		label& mFail;
+		bool mValid{ false };
+	};
+
+private:
+	std::shared_ptr<bytecode_function> compile_function(AST_node* pBody)
+	{
+		auto code = std::make_shared<bytecode_function>();
+		function_state state = std::exchange(mState, function_state{});
+		mState.code = code.get();
+		compile_statement(pBody);
+		emit(opcode::return_void);
+		mState = std::move(state);
+		return code;
+	}
+
+	// Compiles the node so its value ends up in the register
+	void compile_value(AST_node* pNode, std::uint32_t pRegister)
+	{
+		const std::uint32_t destination = std::exchange(mDestination, pRegister);
+		pNode->visit(this);
+		mDestination = destination;
+	}
+
+	void compile_statement(AST_node* pNode)
+	{
+		compile_value(pNode, no_register);
+	}
+
+	// Compiles a condition that jumps to the label if it is false
+	void compile_test(AST_node* pNode, label& pFalse)
+	{
+		if (pNode->inferred != known_type::unknown && !mState.values_only)
+		{
+			label fail, done;
+			const std::uint32_t n = compile_number(pNode, fail);
+			emit(opcode::number_jump_if_false, 0, n, 0, pNode).left = pNode->inferred;
+			jumps_to(pFalse);
+			mState.numbers = n;
+			emit(opcode::jump);
+			jumps_to(done);
+			place(fail);
+			compile_values_only([&]() { compile_test(pNode, pFalse); });
+			place(done);
+			return;
+		}
+		const std::uint32_t r = allocate();
+		compile_value(pNode, r);
+		emit(opcode::jump_if_false, 0, r, 0, pNode);
+		jumps_to(pFalse);
+		mState.registers = r;
+	}
+
+	std::uint32_t compile_number(AST_node* pNode, label& pFail)
+	{
+		number_compiler compiler(*this, pFail);
+		return compiler.compile(pNode);
+	}
+
+	// Compiles an expression on values, after the code that runs it on
+	// numbers
+	template <typename T>
+	void compile_values_only(T&& pCompile)
+	{
+		const bool values_only = std::exchange(mState.values_only, true);
+		pCompile();
+		mState.values_only = values_only;
+	}
+
+	// Compiles an expression the loop_hoister could have found invariant
+	template <typename T>
+	void compile_expression(AST_node* pNode, T&& pCompile)
+	{
+		if (pNode->invariant_slot == unresolved_slot)
+		{
+			pCompile();
+			return;
+		}
+
+		// The value is needed to keep it
+		const std::uint32_t destination = mDestination;
+		if (mDestination == no_register)
+			mDestination = allocate();
+		label done;
+		emit(opcode::invariant, mDestination, pNode->invariant_slot, 0, pNode);
+		jumps_to(done);
+		pCompile();
+		emit(opcode::store_invariant, pNode->invariant_slot, mDestination, 0, pNode);
+		place(done);
+		if (destination == no_register)
+			mState.registers = mDestination;
+		mDestination = destination;
+	}
+
+	// Statements give nothing if they are used as a value
+	void give_void()
+	{
+		if (mDestination != no_register)
+			emit(opcode::void_value, mDestination);
+	}
+
+	virtual void dispatch(AST_node_empty*) override
+	{
+		give_void();
+	}
+
+	virtual void dispatch(AST_node_block* pNode) override
+	{
+		mState.scopes.push_back(pNode->locals);
+		for (const auto& i : pNode->children)
+		{
+			// Errors are reported at the statement of the innermost block
+			const std::uint32_t offset = std::exchange(mState.offset, i->offset);
+			compile_statement(i);
+			mState.offset = offset;
+		}
+		mState.scopes.pop_back();
+		clear_locals(pNode->locals);
+		give_void();
+	}
+
+	virtual void dispatch(AST_node_variable* pNode) override
+	{
+		AST_node* value = pNode->children[0];
+		if (value->inferred != known_type::unknown && !mState.values_only)
+		{
+			label fail, done;
+			const std::uint32_t n = compile_number(value, fail);
+			emit(opcode::number_declare, 0, n, 0, pNode).left = value->inferred;
+			mState.numbers = n;
+			emit(opcode::jump);
+			jumps_to(done);
+			place(fail);
+			compile_values_only([&]() { declare(pNode); });
+			place(done);
+		}
+		else
+		{
+			declare(pNode);
+		}
+		give_void();
+	}
+
+	virtual void dispatch(AST_node_unary_op* pNode) override
+	{
+		auto compile = [&]()
+		{
+			const std::uint32_t u = allocate();
+			compile_value(pNode->children[0], u);
+			emit(opcode::unary, mDestination, u, 0, pNode).token = pNode->type;
+			mState.registers = u;
+		};
+		compile_expression(pNode, [&]()
+		{
+			if (pNode->inferred != known_type::unknown && !mState.values_only)
+				compile_typed(pNode, compile);
+			else
+				compile();
+		});
+	}
+
+	virtual void dispatch(AST_node_binary_op* pNode) override
+	{
+		auto compile = [&]()
+		{
+			const std::uint32_t l = allocate();
+			compile_value(pNode->children[0], l);
+			const std::uint32_t r = allocate();
+			compile_value(pNode->children[1], r);
+			emit(opcode::binary, mDestination, l, r, pNode).token = pNode->type;
+			mState.registers = l;
+		};
+		compile_expression(pNode, [&]()
+		{
+			if (pNode->inferred == known_type::unknown || mState.values_only)
+				compile();
+			else if (is_assignment(pNode->type))
+				compile_typed_assignment(pNode, compile);
+			else
+				compile_typed(pNode, compile);
+		});
+	}
+
+	virtual void dispatch(AST_node_member_accessor* pNode) override
+	{
+		compile_expression(pNode, [&]()
+		{
+			const std::uint32_t object = allocate();
+			compile_value(pNode->children[0], object);
+			emit(opcode::member, mDestination, object, 0, pNode);
+			mState.registers = object;
+		});
+	}
+
+	virtual void dispatch(AST_node_constant* pNode) override
+	{
+		emit(opcode::constant, mDestination, 0, 0, pNode);
+	}
+
+	virtual void dispatch(AST_node_identifier* pNode) override
+	{
+		emit(opcode::load, mDestination, 0, 0, pNode);
+	}
+
+	virtual void dispatch(AST_node_function_call* pNode) override
+	{
+		compile_expression(pNode, [&]()
+		{
+			// The callee and the arguments take registers one after another
+			const std::uint32_t callee = allocate();
+			compile_value(pNode->children[0], callee);
+			for (std::size_t i = 1; i < pNode->children.size(); i++)
+				compile_value(pNode->children[i], allocate());
+			emit(opcode::call, mDestination, callee, static_cast<std::uint32_t>(pNode->children.size() - 1), pNode);
+			mState.registers = callee;
+		});
+	}
+
+	virtual void dispatch(AST_node_if* pNode) override
+	{
+		label done;
+		const std::size_t count = pNode->elseif_count + 1;
+		for (std::size_t i = 0; i < count; i++)
+		{
+			label next;
+			compile_test(pNode->children[i * 2], next);
+			compile_statement(pNode->children[i * 2 + 1]);
+			if (i + 1 < count || pNode->has_else)
+			{
+				emit(opcode::jump);
+				jumps_to(done);
+			}
+			place(next);
+		}
+		if (pNode->has_else)
+			compile_statement(pNode->children.back());
+		place(done);
+		give_void();
+	}
+
+	virtual void dispatch(AST_node_for* pNode) override
+	{
+		clear_locals(pNode->invariants);
+		mState.scopes.push_back(pNode->locals);
+		compile_statement(pNode->children[0]);
+
+		label condition, next, exit;
+		place(condition);
+		if (!pNode->children[1]->is_empty())
+			compile_test(pNode->children[1], exit);
+		compile_loop_body(pNode->children[3], pNode->body_locals, exit, next);
+		compile_statement(pNode->children[2]);
+		emit(opcode::jump);
+		jumps_to(condition);
+
+		place(exit);
+		mState.scopes.pop_back();
+		clear_locals(pNode->locals);
+		clear_locals(pNode->invariants);
+		give_void();
+	}
+
+	virtual void dispatch(AST_node_while* pNode) override
+	{
+		clear_locals(pNode->invariants);
+
+		label condition, next, exit;
+		place(condition);
+		compile_test(pNode->children[0], exit);
+		compile_loop_body(pNode->children[1], pNode->body_locals, exit, next);
+		emit(opcode::jump);
+		jumps_to(condition);
+
+		place(exit);
+		clear_locals(pNode->invariants);
+		give_void();
+	}
+
+	virtual void dispatch(AST_node_function_declaration* pNode) override
+	{
+		const std::uint32_t index = static_cast<std::uint32_t>(mState.code->functions.size());
+		mState.code->functions.push_back(compile_function(pNode->children[0]));
+		emit(opcode::function, mDestination, index, 0, pNode);
+	}
+
+	virtual void dispatch(AST_node_return* pNode) override
+	{
+		const std::uint32_t r = allocate();
+		compile_value(pNode->children[0], r);
+		emit(opcode::return_value, 0, r, 0, pNode);
+		mState.registers = r;
+	}
+
+	virtual void dispatch(AST_node_break*) override
+	{
+		leave_loop(true);
+	}
+
+	virtual void dispatch(AST_node_continue*) override
+	{
+		leave_loop(false);
+	}
+
+private:
+	// Runs the expression on numbers and boxes the result
+	template <typename T>
+	void compile_typed(AST_node* pNode, T&& pCompile)
+	{
+		label fail, done;
+		const std::uint32_t n = compile_number(pNode, fail);
+		if (mDestination != no_register)
+			emit(opcode::box, mDestination, n, 0, pNode).left = pNode->inferred;
+		mState.numbers = n;
+		emit(opcode::jump);
+		jumps_to(done);
+		place(fail);
+		compile_values_only(pCompile);
+		place(done);
+	}
+
+	// Assigns a number to a local or a global in place
+	template <typename T>
+	void compile_typed_assignment(AST_node_binary_op* pNode, T&& pCompile)
+	{
+		label fail, done;
+		const std::uint32_t n = compile_number(pNode->children[1], fail);
+		instruction& i = emit(opcode::number_assign, mDestination, n, 0, as_identifier(pNode->children[0]));
+		i.token = pNode->type;
+		i.left = pNode->inferred;
+		i.right = pNode->children[1]->inferred;
+		jumps_to(fail);
+		mState.numbers = n;
+		emit(opcode::jump);
+		jumps_to(done);
+		place(fail);
+		compile_values_only(pCompile);
+		place(done);
+	}
+
+	void declare(AST_node_variable* pNode)
+	{
+		const std::uint32_t r = allocate();
+		compile_value(pNode->children[0], r);
+		emit(opcode::declare, 0, r, 0, pNode);
+		mState.registers = r;
+	}
+
+	void compile_loop_body(AST_node* pBody, const slot_range& pLocals, label& pExit, label& pNext)
+	{
+		mState.loops.push_back({ mState.scopes.size(), &pExit, &pNext });
+		mState.scopes.push_back(pLocals);
+		compile_statement(pBody);
+		mState.scopes.pop_back();
+		mState.loops.pop_back();
+		place(pNext);
+		clear_locals(pLocals);
+	}
+
+	// Breaking leaves the scopes of the loop, continuing only the ones in
+	// its body. Outside a loop, either ends the function.
+	void leave_loop(bool pBreak)
+	{
+		if (mState.loops.empty())
+		{
+			emit(opcode::return_void);
+			return;
+		}
+		const loop& current = mState.loops.back();
+		const std::size_t last = pBreak ? current.scope : current.scope + 1;
+		for (std::size_t i = mState.scopes.size(); i > last; i--)
+			clear_locals(mState.scopes[i - 1]);
+		emit(opcode::jump);
+		jumps_to(pBreak ? *current.exit : *current.next);
+	}
+
+	void clear_locals(const slot_range& pRange)
+	{
+		if (pRange.begin < pRange.end)
+			emit(opcode::clear_locals, pRange.begin, pRange.end);
+	}
+
+	// The reference is only valid until the next instruction is emitted
+	instruction& emit(opcode pOp, std::uint32_t pA = 0, std::uint32_t pB = 0, std::uint32_t pC = 0, AST_node* pNode = nullptr)
+	{
+		instruction i;
+		i.op = pOp;
+		i.a = pA;
+		i.b = pB;
+		i.c = pC;
+		i.node = pNode;
+		mState.code->code.push_back(i);
+		mState.code->offsets.push_back(mState.offset);
+		return mState.code->code.back();
+	}
+
+	// The last instruction emitted jumps to the label
+	void jumps_to(label& pLabel)
+	{
+		if (pLabel.placed)
+			mState.code->code.back().c = pLabel.target;
+		else
+			pLabel.jumps.push_back(mState.code->code.size() - 1);
+	}
+
+	// The next instruction emitted is where the label jumps to
+	void place(label& pLabel)
+	{
+		pLabel.placed = true;
+		pLabel.target = static_cast<std::uint32_t>(mState.code->code.size());
+		for (auto i : pLabel.jumps)
+			mState.code->code[i].c = pLabel.target;
+	}
+
+	std::uint32_t allocate()
+	{
+		mState.code->registers = std::max(mState.code->registers, mState.registers + 1);
+		return mState.registers++;
+	}
+
+	std::uint32_t allocate_number()
+	{
+		mState.code->numbers = std::max(mState.code->numbers, mState.numbers + 1);
+		return mState.numbers++;
+	}
+
+private:
+	function_state mState;
+	// Where the value of the node being compiled goes
+	std::uint32_t mDestination{ no_register };
+};
+
+} // namespace wolfscript
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "callable.hpp"
+#include "cast.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace wolfscript
+{
+
+// The inline cache of a call site. It keeps the overload the site called
+// for each callee and set of argument types it was called with, and the
+// casts of the arguments to its parameters. A call with a callee and
+// argument types that are in the cache doesn't have to find the overload.
+class call_cache
+{
+public:
+	// A site called with more callees or argument types than this is
+	// megamorphic. It isn't cached anymore.
+	static constexpr std::size_t max_entries = 4;
+
+	struct entry
+	{
+		// Keeps the callee alive so its data can't be taken by another
+		value_type callee;
+		// The version of the overloader the overload was found in
+		std::uint32_t version{ 0 };
+		std::vector<type_info> types;
+		const callable* function{ nullptr };
+		// The cast of each argument, empty if it is passed as it is
+		std::vector<cast_function> casts;
+
+		value_type call(arg_list& pArgs) const
+		{
+			const callable* func = function;
+			for (std::size_t i = 0; i < casts.size(); i++)
+				if (casts[i])
+					pArgs[i] = casts[i](func->parameter_types[i], std::move(pArgs[i]));
+			return func->function(pArgs);
+		}
+	};
+
+	call_cache(const void* pSite) :
+		mSite(pSite)
+	{}
+
+	// The node of the call this is the cache of
+	const void* get_site() const
+	{
+		return mSite;
+	}
+
+	bool is_megamorphic() const
+	{
+		return mMegamorphic;
+	}
+
+	// Returns nullptr if the call isn't in the cache
+	const entry* find(const value_type& pCallee, const arg_list& pArgs) const
+	{
+		for (const auto& i : mEntries)
+			if (&i.callee.get_data() == &pCallee.get_data()
+				&& i.version == get_version(pCallee)
+				&& has_types(i, pArgs))
+				return &i;
+		return nullptr;
+	}
+
+	// Keeps the overload a call was resolved to. Returns nullptr if the site
+	// became megamorphic.
+	const entry* add(const value_type& pCallee, const arg_list& pArgs,
+		const callable& pFunction, const cast_list& pCast_list)
+	{
+		// Overloads found before a function was added to the callee
+		// aren't valid anymore
+		mEntries.erase(std::remove_if(mEntries.begin(), mEntries.end(), [&pCallee](const entry& pEntry)
+		{
+			return &pEntry.callee.get_data() == &pCallee.get_data() && pEntry.version != get_version(pCallee);
+		}), mEntries.end());
+
+		if (mEntries.size() >= max_entries)
+		{
+			mMegamorphic = true;
+			mEntries.clear();
+			return nullptr;
+		}
+
+		entry& new_entry = mEntries.emplace_back();
+		new_entry.callee = pCallee;
+		new_entry.version = get_version(pCallee);
+		new_entry.function = &pFunction;
+		new_entry.types.reserve(pArgs.size());
+		for (const auto& i : pArgs)
+			new_entry.types.push_back(i.get_type_info());
+		new_entry.casts.reserve(pFunction.parameter_types.size());
+		for (std::size_t i = 0; i < pFunction.parameter_types.size() && i < pArgs.size(); i++)
+			new_entry.casts.push_back(pCast_list.prepare(pFunction.parameter_types[i], new_entry.types[i]));
+		return &new_entry;
+	}
+
+private:
+	static std::uint32_t get_version(const value_type& pCallee)
+	{
+		if (auto overloader = pCallee.get<const callable_overloader>())
+			return overloader->get_version();
+		return 0;
+	}
+
+	// The overload and casts only depend on the type and constness of the
+	// arguments
+	static bool has_types(const entry& pEntry, const arg_list& pArgs)
+	{
+		if (pEntry.types.size() != pArgs.size())
+			return false;
+		for (std::size_t i = 0; i < pArgs.size(); i++)
+		{
+			const type_info& type = pArgs[i].get_type_info();
+			if (pEntry.types[i].stdtypeinfo != type.stdtypeinfo
+				|| pEntry.types[i].is_const != type.is_const)
+				return false;
+		}
+		return true;
+	}
+
+private:
+	const void* mSite;
+	std::vector<entry> mEntries;
+	bool mMegamorphic{ false };
+};
+
+} // namespace wolfscript
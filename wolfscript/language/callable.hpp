@@ -3,6 +3,9 @@
 #include "value_type.hpp"
 #include "cast.hpp"
 
+#include <cstdint>
+#include <memory>
+#include <optional>
 #include <vector>
 #include <functional>
 #include <queue>
@@ -13,6 +16,29 @@ namespace wolfscript
 using arg_list = std::vector<value_type>;
 using generic_function = std::function<value_type(const arg_list&)>;
 
+struct AST_node_function_declaration;
+struct bytecode_function;
+struct jit_function;
+
+// A variable captured by functions declared in a script. It is shared by
+// the functions and the frame it is declared in, and is empty until its
+// declaration is run.
+using captured_value = std::shared_ptr<std::optional<value_type>>;
+
+// Where a function declared in a script comes from
+struct script_function
+{
+	AST_node_function_declaration* declaration{ nullptr };
+	// The variables it uses from the functions around it, in the order of
+	// the captures of the declaration
+	std::vector<captured_value> captures;
+	// Set if the function was compiled to bytecode
+	std::shared_ptr<const bytecode_function> code;
+	// Set if the function can be compiled to native code, see jit_compiler.
+	// It is owned by the interpreter.
+	jit_function* native{ nullptr };
+};
+
 // This type wraps a function type that can be called in-script
 struct callable
 {
@@ -26,6 +52,11 @@ struct callable
 	// If true, this callable can take any number of parameters
 	bool generic_arity{ false };
 
+	// Set by the application if the function has no side effects and its
+	// result only depends on its arguments. A call to it can then be
+	// evaluated once for a loop, see loop_hoister.
+	bool is_pure{ false };
+
 	// Check if this function can be call with these parameters.
 	// Returns 1 or greater if this function can be called with the specified
 	// parameters.
@@ -63,6 +94,9 @@ struct callable
 	// Allows a callable to be converted back into its original std::function
 	// form without creating many more delegates affecting performance.
 	value_type original_function;
+
+	// Only set if this function was declared in a script
+	script_function script;
 };
 
 // This stores all functions that are of the same identifier but with a
@@ -75,6 +109,7 @@ public:
 	void add(const callable_overloader& pOther) const
 	{
 		mCallables.insert(mCallables.end(), pOther.mCallables.begin(), pOther.mCallables.end());
+		++mVersion;
 	}
 
 	// Add a callable to the overloader
@@ -82,6 +117,14 @@ public:
 	{
 		assert(pCallable.get<const callable>());
 		mCallables.push_back(pCallable);
+		++mVersion;
+	}
+
+	// Changes every time a callable is added, so an overload found before
+	// can be known to still be the best
+	std::uint32_t get_version() const
+	{
+		return mVersion;
 	}
 
 	// Find the best overload for this set of parameters
@@ -107,6 +150,20 @@ public:
 		return *result;
 	}
 
+	bool empty() const
+	{
+		return mCallables.empty();
+	}
+
+	// True if every function of the overloader is pure
+	bool is_pure() const
+	{
+		for (auto& i : mCallables)
+			if (!i.get<const callable>()->is_pure)
+				return false;
+		return true;
+	}
+
 	const callable& find(const arg_list& pArgs, const cast_list& pCast_list) const
 	{
 		std::vector<type_info> types;
@@ -118,6 +175,7 @@ public:
 
 private:
 	mutable std::vector<value_type> mCallables;
+	mutable std::uint32_t mVersion{ 0 };
 };
 
 } // namespace wolfscript
@@ -32,17 +32,22 @@ public:
 		return static_cast<bool>(find(pTo, pFrom));
 	}
 
-	// Find a function that can cast the 2 types. If none are found,
-	// this function will return an empty function
-	cast_function find(type_info pTo, type_info pFrom) const
+	// Check if a value of a type can be used as the other without casting
+	static bool is_kept(type_info pTo, type_info pFrom)
 	{
 		// Check for const correctness
-		bool correct_const = (pFrom.is_const && pTo.is_const) || (!pFrom.is_const && pTo.is_const) ||
-			(!pFrom.is_const && !pTo.is_const);
+		const bool correct_const = pTo.is_const || !pFrom.is_const;
 
 		// Check for the same type or generic type
-		if (pTo.bare_equal(type_info::create<value_type>()) ||
-			(pTo.bare_equal(pFrom) && correct_const))
+		return pTo.bare_equal(type_info::create<value_type>()) ||
+			(pTo.bare_equal(pFrom) && correct_const);
+	}
+
+	// Find a function that can cast the 2 types. If none are found,
+	// this function will return an empty function
+	cast_function find(type_info pTo, type_info pFrom) const
+	{
+		if (is_kept(pTo, pFrom))
 		{
 			// Just return a mirroring function
 			return [](type_info, value_type pVal) -> value_type
@@ -51,7 +56,7 @@ public:
 			};
 		}
 
-		if (!correct_const)
+		if (pFrom.is_const && !pTo.is_const)
 			return {};
 
 		// Find the appropriate casting function
@@ -62,10 +67,31 @@ public:
 		return {};
 	}
 
+	// Find the function that does the same as cast() for these 2 types, so
+	// a cast done many times doesn't have to search for it again. It is
+	// empty if the value is used as it is. The types have to be castable.
+	cast_function prepare(type_info pTo, type_info pFrom) const
+	{
+		if (pTo.is_arithmetic && pFrom.is_arithmetic)
+		{
+			if (pTo.bare_equal(typeid(bool)))
+				return &cast_number<bool>;
+			if (pTo.bare_equal(typeid(int)))
+				return &cast_number<int>;
+			if (pTo.bare_equal(typeid(unsigned int)))
+				return &cast_number<unsigned int>;
+			if (pTo.bare_equal(typeid(float)))
+				return &cast_number<float>;
+		}
+		if (is_kept(pTo, pFrom))
+			return {};
+		return find(pTo, pFrom);
+	}
+
 	template <typename T>
 	T cast(const value_type& pFrom) const
 	{
-		return *cast(type_info::create<const T>(), pFrom).get<T>();
+		return *cast(type_info::create<const T>(), pFrom).template get<T>();
 	}
 
 	// Cast 2 values. This will throw if there is no such cast.
@@ -97,6 +123,16 @@ public:
 	}
 
 private:
+	// Numbers are always copied when they are cast
+	template <typename T>
+	static value_type cast_number(type_info, value_type pFrom)
+	{
+		return detail::visit_arithmetic(pFrom, [](auto& pValue) -> value_type
+		{
+			return static_cast<T>(pValue);
+		});
+	}
+
 	struct cast_entry
 	{
 		bool explicit_cast{ false };
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "tokenizer.hpp"
+#include "line_index.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace wolfscript
+{
+
+// A compact alternative to token_array.
+// Tokens are stored as parallel arrays of types, source offsets and
+// literal indices, which take less than a quarter of the memory of a
+// token. The text of a token is recovered from the source and its
+// position is only computed when asked for. Like token_array, this only
+// references the source, so it MUST outlive this object.
+class compact_token_array
+{
+public:
+	// A distinct literal. Numbers hold their value, strings are kept as
+	// their raw text like the text of a string token.
+	struct literal
+	{
+		std::string_view text;
+		std::variant<int, float> value;
+	};
+
+	compact_token_array() = default;
+
+	// Tokenizes the source.
+	// This will throw a tokenization_error exception on an error.
+	compact_token_array(std::string_view pSource) :
+		mSource(pSource)
+	{
+		token_stream stream(pSource);
+		token t;
+		do {
+			t = stream.next();
+			push_back(t);
+		} while (t.type != token_type::eof);
+
+		mTypes.shrink_to_fit();
+		mOffsets.shrink_to_fit();
+		mLiteral_indices.shrink_to_fit();
+		mLiteral_lookup = {};
+	}
+
+	std::size_t size() const
+	{
+		return mTypes.size();
+	}
+
+	token_type type(std::size_t pIndex) const
+	{
+		return mTypes[pIndex];
+	}
+
+	// The offset of the first character of the token in the source
+	std::uint32_t offset(std::size_t pIndex) const
+	{
+		return mOffsets[pIndex];
+	}
+
+	std::string_view text(std::size_t pIndex) const
+	{
+		const token_type type = mTypes[pIndex];
+		const std::uint32_t offset = mOffsets[pIndex];
+		switch (type)
+		{
+		case token_type::identifier:
+			return mSource.substr(offset, detail::active_scan_kernels()->find_identifier_end(
+				mSource.data() + offset, mSource.length() - offset));
+		case token_type::integer:
+		case token_type::floating:
+		case token_type::string:
+			return mLiterals[mLiteral_indices[pIndex]].text;
+		default:
+			return mSource.substr(offset, detail::spelling_length(type));
+		}
+	}
+
+	// Gets the literal of an integer, floating, or string token
+	const literal& get_literal(std::size_t pIndex) const
+	{
+		return mLiterals[mLiteral_indices[pIndex]];
+	}
+
+	// Computes the line and column of a token
+	text_position position(std::size_t pIndex) const
+	{
+		return lines().position(mOffsets[pIndex]);
+	}
+
+	// The line index of the source, built the first time it is needed
+	const line_index& lines() const
+	{
+		if (mLines.empty())
+			mLines.build(mSource);
+		return mLines;
+	}
+
+	// Rebuilds a full token
+	token get(std::size_t pIndex) const
+	{
+		token t(mTypes[pIndex]);
+		t.text = text(pIndex);
+		t.offset = mOffsets[pIndex];
+		if (t.type == token_type::integer || t.type == token_type::floating)
+			t.value = get_literal(pIndex).value;
+		return t;
+	}
+
+	// The number of bytes used by the token storage
+	std::size_t memory_usage() const
+	{
+		return mTypes.capacity() * sizeof(token_type)
+			+ mOffsets.capacity() * sizeof(std::uint32_t)
+			+ mLiteral_indices.capacity() * sizeof(std::uint32_t)
+			+ mLiterals.capacity() * sizeof(literal)
+			+ mLines.memory_usage();
+	}
+
+private:
+	void push_back(const token& pToken)
+	{
+		const std::uint32_t offset = pToken.offset;
+
+		std::uint32_t literal_index = 0;
+		if (pToken.type == token_type::integer ||
+			pToken.type == token_type::floating ||
+			pToken.type == token_type::string)
+		{
+			// Strings are looked up with their quotes so "1" and 1 are different
+			const std::string_view key = pToken.type == token_type::string ?
+				mSource.substr(offset, pToken.text.length() + 2) : pToken.text;
+			auto[iter, inserted] = mLiteral_lookup.emplace(key, static_cast<std::uint32_t>(mLiterals.size()));
+			if (inserted)
+				mLiterals.push_back({ pToken.text, pToken.value });
+			literal_index = iter->second;
+		}
+
+		mTypes.push_back(pToken.type);
+		mOffsets.push_back(offset);
+		mLiteral_indices.push_back(literal_index);
+	}
+
+private:
+	std::string_view mSource;
+	std::vector<token_type> mTypes;
+	std::vector<std::uint32_t> mOffsets;
+	// Index into mLiterals for literal tokens. Unused for every other token.
+	std::vector<std::uint32_t> mLiteral_indices;
+	std::vector<literal> mLiterals;
+	// Only used while tokenizing to deduplicate literals by their text
+	std::unordered_map<std::string_view, std::uint32_t> mLiteral_lookup;
+	mutable line_index mLines;
+};
+
+// Hands out the tokens of a compact_token_array to the parser.
+// The array must outlive this object.
+class compact_token_source :
+	public token_source
+{
+public:
+	compact_token_source(const compact_token_array& pTokens) :
+		mTokens(&pTokens)
+	{}
+
+	token next() override
+	{
+		if (mIndex >= mTokens->size())
+			return token(token_type::eof);
+		return mTokens->get(mIndex++);
+	}
+
+private:
+	const compact_token_array* mTokens;
+	std::size_t mIndex{ 0 };
+};
+
+} // namespace wolfscript
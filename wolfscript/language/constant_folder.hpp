@@ -0,0 +1,400 @@
+#pragma once
+
+#include "ast_arena.hpp"
+#include "arithmetic.hpp"
+#include "exception.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <set>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace wolfscript
+{
+
+namespace detail
+{
+
+// Finds the names used where their value could be changed. That is when
+// they are assigned to, incremented, or handed to a function or member
+// that could take them by reference, or returned to a caller that could.
+class mutated_names_finder :
+	public AST_walker
+{
+public:
+	virtual void dispatch(AST_node_unary_op* pNode) override
+	{
+		const bool modifies = pNode->type == token_type::increment || pNode->type == token_type::decrement;
+		visit(pNode->children[0], modifies);
+	}
+
+	virtual void dispatch(AST_node_binary_op* pNode) override
+	{
+		visit(pNode->children[0], is_assignment(pNode->type));
+		visit(pNode->children[1], false);
+	}
+
+	virtual void dispatch(AST_node_member_accessor* pNode) override
+	{
+		visit(pNode->children[0], could_change(pNode));
+	}
+
+	virtual void dispatch(AST_node_function_call* pNode) override
+	{
+		const bool changes = could_change(pNode);
+		for (std::size_t i = 0; i < pNode->children.size(); i++)
+			visit(pNode->children[i], changes && i > 0);
+	}
+
+	virtual void dispatch(AST_node_return* pNode) override
+	{
+		visit(pNode->children[0], true);
+	}
+
+	virtual void dispatch(AST_node_identifier* pNode) override
+	{
+		if (pNode == mMutable)
+			mNames.insert(pNode->identifier);
+	}
+
+	const std::set<std::string_view>& get_names() const
+	{
+		return mNames;
+	}
+
+protected:
+	// False if the function can't change its object or arguments
+	virtual bool could_change(AST_node_member_accessor*) const
+	{
+		return true;
+	}
+
+	virtual bool could_change(AST_node_function_call*) const
+	{
+		return true;
+	}
+
+private:
+	void visit(AST_node* pNode, bool pMutable)
+	{
+		mMutable = pMutable ? pNode : nullptr;
+		pNode->visit(this);
+	}
+
+private:
+	std::set<std::string_view> mNames;
+	// The node being visited if its value could be changed
+	AST_node* mMutable{ nullptr };
+};
+
+struct constant_getter :
+	AST_visitor
+{
+	virtual void dispatch(AST_node_constant* pNode) override
+	{
+		value = pNode->value;
+	}
+
+	const value_type* value{ nullptr };
+};
+
+} // namespace detail
+
+// Replaces operations on constants with their result and removes the
+// branches of if and while statements that can never be taken. The
+// locals declared const with a constant are replaced by it where they
+// are used in the function they are declared in.
+//
+// Only operations on arithmetic values are folded, since the operators
+// of other types are functions that could do anything. An operation that
+// fails, like a division by 0, is left alone so it fails when it is run.
+// Constants are immutable, so nothing is folded where its value could be
+// changed, like an argument or a value that is returned. A copy is made
+// of the result of an operation there when it runs.
+class constant_folder :
+	private AST_walker
+{
+public:
+	// The tree has to be resolved first. The nodes that take the place
+	// of others are created in pArena, the arena of the tree.
+	void fold(AST_node* pRoot, AST_arena& pArena)
+	{
+		detail::mutated_names_finder finder;
+		pRoot->visit(&finder);
+		mMutated_names = &finder.get_names();
+		mArena = &pArena;
+		mSlots.clear();
+		mStatement = nullptr;
+		fold(pRoot, false);
+		mMutated_names = nullptr;
+	}
+
+private:
+	struct slot
+	{
+		// Set while the local holds this constant
+		const value_type* constant{ nullptr };
+		bool declared{ false };
+	};
+
+private:
+	virtual void dispatch(AST_node_block* pNode) override
+	{
+		for (auto& i : pNode->children)
+		{
+			mStatement = i;
+			i = fold(i, false);
+		}
+		mResult = pNode;
+	}
+
+	virtual void dispatch(AST_node_variable* pNode) override
+	{
+		// A declaration that is a statement of its scope is always run
+		// before anything after it in the scope
+		const bool always_run = pNode == mStatement;
+		pNode->children[0] = fold(pNode->children[0], false);
+		mResult = pNode;
+
+		slot* s = get_slot(pNode->slot);
+		if (!s)
+			return;
+		// A local that is declared again isn't a constant anymore
+		s->constant = nullptr;
+		if (!s->declared && always_run && pNode->is_const
+			&& mMutated_names->find(pNode->identifier) == mMutated_names->end())
+			s->constant = get_arithmetic(pNode->children[0]);
+		s->declared = true;
+	}
+
+	virtual void dispatch(AST_node_unary_op* pNode) override
+	{
+		const bool is_mutable = mMutable;
+		const bool modifies = pNode->type == token_type::increment || pNode->type == token_type::decrement;
+		pNode->children[0] = fold(pNode->children[0], modifies);
+		mResult = pNode;
+
+		const value_type* value = get_arithmetic(pNode->children[0]);
+		if (is_mutable || modifies || !value)
+			return;
+		try
+		{
+			replace(pNode, arithmetic_unary_operation(pNode->type, *value));
+		}
+		catch (exception::wolf_exception&)
+		{
+			// Left to fail when it is run
+		}
+	}
+
+	virtual void dispatch(AST_node_binary_op* pNode) override
+	{
+		const bool is_mutable = mMutable;
+		const bool assigns = is_assignment(pNode->type);
+		pNode->children[0] = fold(pNode->children[0], assigns);
+		pNode->children[1] = fold(pNode->children[1], false);
+		mResult = pNode;
+
+		const value_type* l = get_arithmetic(pNode->children[0]);
+		const value_type* r = get_arithmetic(pNode->children[1]);
+		if (is_mutable || assigns || !l || !r)
+			return;
+		try
+		{
+			replace(pNode, arithmetic_binary_operation(pNode->type, *l, *r));
+		}
+		catch (exception::wolf_exception&)
+		{
+			// Left to fail when it is run
+		}
+	}
+
+	virtual void dispatch(AST_node_member_accessor* pNode) override
+	{
+		pNode->children[0] = fold(pNode->children[0], true);
+		mResult = pNode;
+	}
+
+	virtual void dispatch(AST_node_identifier* pNode) override
+	{
+		if (mMutable || pNode->depth != 0)
+			return;
+		if (slot* s = get_slot(pNode->slot); s && s->constant)
+			mResult = create_constant(s->constant, pNode->offset);
+	}
+
+	virtual void dispatch(AST_node_function_call* pNode) override
+	{
+		for (auto& i : pNode->children)
+			i = fold(i, true);
+		mResult = pNode;
+	}
+
+	virtual void dispatch(AST_node_if* pNode) override
+	{
+		auto& children = pNode->children;
+		for (auto& i : children)
+			i = fold(i, false);
+		mResult = pNode;
+
+		// Keep the branches that could be taken. A branch that is always
+		// taken becomes the else statement.
+		AST_node* otherwise = pNode->has_else ? children.back() : nullptr;
+		std::size_t kept = 0;
+		for (std::size_t i = 0; i < pNode->elseif_count + 1; i++)
+		{
+			const std::optional<bool> condition = get_condition(children[i * 2]);
+			if (condition && !*condition)
+				continue;
+			if (condition)
+			{
+				otherwise = children[i * 2 + 1];
+				break;
+			}
+			children[kept * 2] = children[i * 2];
+			children[kept * 2 + 1] = children[i * 2 + 1];
+			++kept;
+		}
+
+		if (kept == 0)
+		{
+			mResult = otherwise ? otherwise : create_empty(pNode->offset);
+			// Errors are still reported where the if statement is
+			mResult->offset = pNode->offset;
+			return;
+		}
+		children.resize(kept * 2);
+		if (otherwise)
+			children.push_back(otherwise);
+		pNode->elseif_count = kept - 1;
+		pNode->has_else = otherwise != nullptr;
+	}
+
+	virtual void dispatch(AST_node_for* pNode) override
+	{
+		// The first statement is always run before the rest
+		mStatement = pNode->children[0];
+		for (auto& i : pNode->children)
+			i = fold(i, false);
+		mResult = pNode;
+	}
+
+	virtual void dispatch(AST_node_while* pNode) override
+	{
+		for (auto& i : pNode->children)
+			i = fold(i, false);
+		mResult = pNode;
+
+		const std::optional<bool> condition = get_condition(pNode->children[0]);
+		if (condition && !*condition)
+			mResult = create_empty(pNode->offset);
+	}
+
+	virtual void dispatch(AST_node_function_declaration* pNode) override
+	{
+		if (!pNode->identifier.empty())
+		{
+			if (slot* s = get_slot(pNode->slot))
+			{
+				s->constant = nullptr;
+				s->declared = true;
+			}
+		}
+
+		// The body has a frame of its own
+		std::vector<slot> slots;
+		std::swap(slots, mSlots);
+		pNode->children[0] = fold(pNode->children[0], false);
+		std::swap(slots, mSlots);
+		mResult = pNode;
+	}
+
+	virtual void dispatch(AST_node_return* pNode) override
+	{
+		pNode->children[0] = fold(pNode->children[0], true);
+		mResult = pNode;
+	}
+
+private:
+	// Returns the node that takes the place of pNode.
+	// pMutable is true if the value of the node could be changed.
+	AST_node* fold(AST_node* pNode, bool pMutable)
+	{
+		mResult = pNode;
+		mMutable = pMutable;
+		pNode->visit(this);
+		return mResult;
+	}
+
+	slot* get_slot(std::uint32_t pSlot)
+	{
+		if (pSlot == unresolved_slot)
+			return nullptr;
+		if (pSlot >= mSlots.size())
+			mSlots.resize(pSlot + 1);
+		return &mSlots[pSlot];
+	}
+
+	static const value_type* get_arithmetic(AST_node* pNode)
+	{
+		detail::constant_getter getter;
+		pNode->visit(&getter);
+		if (getter.value && getter.value->is_arithmetic())
+			return getter.value;
+		return nullptr;
+	}
+
+	// Conditions are cast to bool like the interpreter does
+	static std::optional<bool> get_condition(AST_node* pNode)
+	{
+		if (const value_type* value = get_arithmetic(pNode))
+			return detail::visit_arithmetic(*value, [](auto pValue) { return static_cast<bool>(pValue); });
+		return std::nullopt;
+	}
+
+	void replace(AST_node* pNode, const value_type& pValue)
+	{
+		constant_pool& pool = mArena->constants();
+		std::size_t index;
+		if (const int* value = pValue.get<const int>())
+			index = pool.add(*value);
+		else if (const float* value = pValue.get<const float>())
+			index = pool.add(*value);
+		else if (const bool* value = pValue.get<const bool>())
+			index = pool.add(*value);
+		else
+			return;
+		mResult = create_constant(&pool[index], pNode->offset);
+	}
+
+	AST_node* create_constant(const value_type* pValue, std::uint32_t pOffset)
+	{
+		auto node = mArena->create<AST_node_constant>();
+		node->value = pValue;
+		node->offset = pOffset;
+		return node;
+	}
+
+	AST_node* create_empty(std::uint32_t pOffset)
+	{
+		auto node = mArena->create<AST_node_empty>();
+		node->offset = pOffset;
+		return node;
+	}
+
+private:
+	AST_arena* mArena{ nullptr };
+	const std::set<std::string_view>* mMutated_names{ nullptr };
+	// The locals of the frame of the function being folded
+	std::vector<slot> mSlots;
+	// The statement of a block or the first statement of a for loop being folded
+	AST_node* mStatement{ nullptr };
+	// What takes the place of the node that was just folded
+	AST_node* mResult{ nullptr };
+	// True if the value of the node being folded could be changed
+	bool mMutable{ false };
+};
+
+} // namespace wolfscript
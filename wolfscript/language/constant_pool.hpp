@@ -0,0 +1,91 @@
+#pragma once
+
+#include "value_type.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace wolfscript
+{
+
+// Stores the literals of a compilation unit.
+// Each distinct literal is stored once as an immutable value_type that
+// can be handed out by the interpreter without allocating. Constants
+// never move, so nodes can point to them.
+class constant_pool
+{
+public:
+	std::size_t add(int pValue)
+	{
+		return intern(mIntegers, pValue, pValue);
+	}
+
+	std::size_t add(float pValue)
+	{
+		// Floats are compared by their bits so 0.0 and -0.0 stay distinct
+		std::uint32_t bits;
+		static_assert(sizeof(bits) == sizeof(pValue));
+		std::memcpy(&bits, &pValue, sizeof(bits));
+		return intern(mFloats, bits, pValue);
+	}
+
+	// Only made by folding constant expressions, there are no bool literals
+	std::size_t add(bool pValue)
+	{
+		return intern(mBools, pValue, pValue);
+	}
+
+	std::size_t add(std::string_view pValue)
+	{
+		auto iter = mStrings.find(pValue);
+		if (iter != mStrings.end())
+			return iter->second;
+		const std::size_t index = mConstants.size();
+		mConstants.emplace_back(const_value(std::string(pValue)));
+		// The key views the string owned by the constant
+		mStrings.emplace(*mConstants.back().get<const std::string>(), index);
+		return index;
+	}
+
+	const value_type& operator[](std::size_t pIndex) const
+	{
+		return mConstants[pIndex];
+	}
+
+	std::size_t size() const
+	{
+		return mConstants.size();
+	}
+
+	void clear()
+	{
+		mConstants.clear();
+		mIntegers.clear();
+		mFloats.clear();
+		mBools.clear();
+		mStrings.clear();
+	}
+
+private:
+	template <typename Tkey, typename T>
+	std::size_t intern(std::unordered_map<Tkey, std::size_t>& pMap, Tkey pKey, T pValue)
+	{
+		auto[iter, inserted] = pMap.emplace(pKey, mConstants.size());
+		if (inserted)
+			mConstants.emplace_back(const_value(pValue));
+		return iter->second;
+	}
+
+private:
+	std::deque<value_type> mConstants;
+	std::unordered_map<int, std::size_t> mIntegers;
+	std::unordered_map<std::uint32_t, std::size_t> mFloats;
+	std::unordered_map<bool, std::size_t> mBools;
+	std::unordered_map<std::string_view, std::size_t> mStrings;
+};
+
+} // namespace wolfscript
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "ast.hpp"
+#include "loop_hoister.hpp"
+
+#include <cstdint>
+#include <set>
+#include <utility>
+
+namespace wolfscript
+{
+
+// Finds the locals whose value can't be referred to by anything but the
+// local. Their value is only copied out of them, so the interpreter can
+// keep it in the frame when the scope of the local ends and use it again
+// the next time the local is declared, instead of making a new one.
+//
+// A value escapes when the local is captured by a function, or is handed
+// to a function or member or returned, since those get the value itself.
+// Incrementing or assigning to a local gives the local itself too.
+// The interpreter still checks that nothing refers to the value before
+// it is used again.
+class escape_analyzer :
+	private AST_walker
+{
+public:
+	// The tree has to be resolved first
+	void analyze(AST_node* pRoot)
+	{
+		enter_function(pRoot);
+	}
+
+private:
+	virtual void dispatch(AST_node_variable* pNode) override
+	{
+		AST_walker::dispatch(pNode);
+		pNode->escapes = mEscaping.count(pNode->slot) > 0;
+	}
+
+	virtual void dispatch(AST_node_member_accessor* pNode) override
+	{
+		escape(pNode->children[0]);
+		AST_walker::dispatch(pNode);
+	}
+
+	virtual void dispatch(AST_node_function_call* pNode) override
+	{
+		for (auto i : pNode->children)
+			escape(i);
+		AST_walker::dispatch(pNode);
+	}
+
+	virtual void dispatch(AST_node_return* pNode) override
+	{
+		escape(pNode->children[0]);
+		AST_walker::dispatch(pNode);
+	}
+
+	virtual void dispatch(AST_node_function_declaration* pNode) override
+	{
+		// The body has a frame of its own
+		if (mMarking)
+			enter_function(pNode->children[0]);
+	}
+
+private:
+	// Finds the locals the body of a function hands out before marking
+	// its declarations
+	void enter_function(AST_node* pBody)
+	{
+		detail::captured_slots_finder captured;
+		pBody->visit(&captured);
+		std::set<std::uint32_t> escaping = captured.get_slots();
+		std::swap(escaping, mEscaping);
+
+		const bool marking = std::exchange(mMarking, false);
+		pBody->visit(this);
+		mMarking = true;
+		pBody->visit(this);
+		mMarking = marking;
+
+		std::swap(escaping, mEscaping);
+	}
+
+	// The node is used where what it gives can be kept
+	void escape(AST_node* pNode)
+	{
+		if (mMarking)
+			return;
+		if (AST_node_identifier* identifier = as_identifier(pNode))
+		{
+			if (identifier->depth == 0 && identifier->slot != unresolved_slot)
+				mEscaping.insert(identifier->slot);
+			return;
+		}
+
+		struct local_getter :
+			AST_visitor
+		{
+			virtual void dispatch(AST_node_unary_op* pNode) override
+			{
+				if (pNode->type == token_type::increment || pNode->type == token_type::decrement)
+					local = pNode->children[0];
+			}
+
+			virtual void dispatch(AST_node_binary_op* pNode) override
+			{
+				if (is_assignment(pNode->type))
+					local = pNode->children[0];
+			}
+
+			AST_node* local{ nullptr };
+		} getter;
+		pNode->visit(&getter);
+		if (getter.local)
+			escape(getter.local);
+	}
+
+private:
+	// The slots of the function being analyzed whose value escapes
+	std::set<std::uint32_t> mEscaping;
+	// False while the locals that escape are being found
+	bool mMarking{ false };
+};
+
+} // namespace wolfscript
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "token.hpp"
+#include "line_index.hpp"
 #include <exception>
+#include <stdexcept>
 #include <vector>
 
 namespace wolfscript::exception
@@ -15,12 +17,23 @@ struct wolf_exception :
 		std::runtime_error(pMsg)
 	{}
 
-	wolf_exception(const std::string& pMsg, text_position pPosition) :
+	wolf_exception(const std::string& pMsg, std::uint32_t pOffset) :
 		std::runtime_error(pMsg),
-		position(pPosition)
+		offset(pOffset)
 	{}
 
-	text_position position;
+	// Fills in the position from the offset if it isn't known yet
+	void resolve_position(const line_index& pLines)
+	{
+		if (position == unknown_position)
+			position = pLines.position(offset);
+	}
+
+	// Offset in the source where the error occurred
+	std::uint32_t offset{ unknown_offset };
+	// Only known once resolve_position() is called. The parser does
+	// this when it is given the source.
+	text_position position{ unknown_position };
 };
 
 struct tokenization_error :
@@ -30,8 +43,8 @@ struct tokenization_error :
 		wolf_exception(pMsg)
 	{}
 
-	tokenization_error(const std::string& pMsg, text_position pPosition) :
-		wolf_exception(pMsg, pPosition)
+	tokenization_error(const std::string& pMsg, std::uint32_t pOffset) :
+		wolf_exception(pMsg, pOffset)
 	{}
 };
 
@@ -43,7 +56,7 @@ struct parse_error :
 	{}
 
 	parse_error(const std::string& pMsg, token pToken) :
-		wolf_exception(pMsg, pToken.position),
+		wolf_exception(pMsg, pToken.offset),
 		current_token(pToken)
 	{}
 
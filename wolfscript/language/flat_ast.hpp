@@ -0,0 +1,923 @@
+#pragma once
+
+#include "ast.hpp"
+#include "ast_arena.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace wolfscript
+{
+
+enum class AST_kind : unsigned char
+{
+	empty,
+	block,
+	variable,
+	unary_op,
+	binary_op,
+	member_accessor,
+	constant,
+	identifier,
+	function_call,
+	if_statement,
+	for_statement,
+	while_statement,
+	function_declaration,
+	return_statement,
+	break_statement,
+	continue_statement,
+};
+
+namespace detail
+{
+
+// Appends values to a buffer as they are in memory. Data written on
+// one kind of machine can only be read back on the same kind.
+class binary_writer
+{
+public:
+	binary_writer(std::string& pBuffer) :
+		mBuffer(pBuffer)
+	{}
+
+	template <typename T>
+	void write(T pValue)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be written");
+		mBuffer.append(reinterpret_cast<const char*>(&pValue), sizeof(T));
+	}
+
+	void write_bytes(std::string_view pBytes)
+	{
+		write(static_cast<std::uint32_t>(pBytes.length()));
+		mBuffer.append(pBytes);
+	}
+
+	void write_raw(const void* pData, std::size_t pSize)
+	{
+		mBuffer.append(static_cast<const char*>(pData), pSize);
+	}
+
+private:
+	std::string& mBuffer;
+};
+
+// Reads what a binary_writer wrote. A read past the end fails and
+// leaves the value as 0.
+class binary_reader
+{
+public:
+	binary_reader(std::string_view pData) :
+		mData(pData)
+	{}
+
+	template <typename T>
+	bool read(T& pValue)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be read");
+		if (mData.length() < sizeof(T))
+		{
+			pValue = T{};
+			return false;
+		}
+		std::memcpy(&pValue, mData.data(), sizeof(T));
+		mData.remove_prefix(sizeof(T));
+		return true;
+	}
+
+	bool read(bool& pValue)
+	{
+		unsigned char value;
+		if (!read(value) || value > 1)
+			return false;
+		pValue = value != 0;
+		return true;
+	}
+
+	bool read_bytes(std::string_view& pBytes)
+	{
+		std::uint32_t length;
+		if (!read(length) || mData.length() < length)
+			return false;
+		pBytes = mData.substr(0, length);
+		mData.remove_prefix(length);
+		return true;
+	}
+
+	bool read_raw(void* pData, std::size_t pSize)
+	{
+		if (mData.length() < pSize)
+			return false;
+		std::memcpy(pData, mData.data(), pSize);
+		mData.remove_prefix(pSize);
+		return true;
+	}
+
+	// Reads the size of a list and checks that there is enough data
+	// left for it, so damaged data can't make the reader allocate
+	// huge lists.
+	bool read_count(std::uint32_t& pCount, std::size_t pItem_size)
+	{
+		return read(pCount) && pCount <= mData.length() / pItem_size;
+	}
+
+	bool at_end() const
+	{
+		return mData.empty();
+	}
+
+private:
+	std::string_view mData;
+};
+
+} // namespace detail
+
+// A compact, read-only copy of an AST for keeping many scripts around.
+// Nodes are stored in pre-order in one array and refer to each other by
+// index. The first child of a node directly follows it and the next
+// sibling follows the end of its subtree. Anything that only some kinds
+// of nodes have is kept in a side table indexed by the payload of the
+// node. Like the AST it was made from, this refers to the source text,
+// so the source MUST outlive this object.
+class AST_flat_tree
+{
+public:
+	using index = std::uint32_t;
+
+	struct node
+	{
+		std::uint32_t offset;
+		// One past the last node of the subtree
+		index end;
+		// Index into the side table for the kind, or the value itself
+		// for small payloads like the operator of an operation.
+		std::uint32_t payload;
+		AST_kind kind;
+	};
+
+	struct variable_info
+	{
+		std::string_view identifier;
+		bool is_const;
+	};
+
+	struct constant_info
+	{
+		// Index of the value in the table of distinct values
+		std::uint32_t value;
+		std::string_view text;
+	};
+
+	struct function_info
+	{
+		std::string_view identifier;
+		// Range in the parameter table
+		std::uint32_t first_parameter;
+		std::uint32_t parameter_count;
+		bool has_return_type;
+		token return_type;
+	};
+
+	using param = AST_node_function_declaration::param;
+
+	AST_flat_tree() = default;
+
+	AST_flat_tree(const AST_node* pRoot)
+	{
+		value_indices indices;
+		flatten(pRoot, indices);
+		mNodes.shrink_to_fit();
+		mIdentifiers.shrink_to_fit();
+		mVariables.shrink_to_fit();
+		mConstants.shrink_to_fit();
+		mValues.shrink_to_fit();
+		mFunctions.shrink_to_fit();
+		mParameters.shrink_to_fit();
+	}
+
+	AST_flat_tree(const AST_tree& pTree) :
+		AST_flat_tree(pTree.get())
+	{}
+
+	std::size_t size() const
+	{
+		return mNodes.size();
+	}
+
+	const node& operator[](index pIndex) const
+	{
+		return mNodes[pIndex];
+	}
+
+	AST_kind kind(index pIndex) const
+	{
+		return mNodes[pIndex].kind;
+	}
+
+	std::uint32_t offset(index pIndex) const
+	{
+		return mNodes[pIndex].offset;
+	}
+
+	// Returns the end of the subtree if the node has no children
+	index first_child(index pIndex) const
+	{
+		return pIndex + 1;
+	}
+
+	index next_sibling(index pIndex) const
+	{
+		return mNodes[pIndex].end;
+	}
+
+	std::size_t child_count(index pIndex) const
+	{
+		std::size_t count = 0;
+		for (index i = first_child(pIndex); i < mNodes[pIndex].end; i = next_sibling(i))
+			++count;
+		return count;
+	}
+
+	index child(index pIndex, std::size_t pChild) const
+	{
+		index i = first_child(pIndex);
+		for (; pChild > 0; --pChild)
+			i = next_sibling(i);
+		return i;
+	}
+
+	// For unary and binary operations
+	token_type operation(index pIndex) const
+	{
+		return static_cast<token_type>(mNodes[pIndex].payload);
+	}
+
+	// For identifiers and member accessors
+	std::string_view identifier(index pIndex) const
+	{
+		return mIdentifiers[mNodes[pIndex].payload];
+	}
+
+	const variable_info& variable(index pIndex) const
+	{
+		return mVariables[mNodes[pIndex].payload];
+	}
+
+	const constant_info& constant(index pIndex) const
+	{
+		return mConstants[mNodes[pIndex].payload];
+	}
+
+	const value_type& constant_value(index pIndex) const
+	{
+		return mValues[constant(pIndex).value];
+	}
+
+	const function_info& function(index pIndex) const
+	{
+		return mFunctions[mNodes[pIndex].payload];
+	}
+
+	const param& parameter(const function_info& pFunction, std::size_t pIndex) const
+	{
+		return mParameters[pFunction.first_parameter + pIndex];
+	}
+
+	// If statements store the number of "else if"s and whether there is an else
+	std::size_t elseif_count(index pIndex) const
+	{
+		return mNodes[pIndex].payload >> 1;
+	}
+
+	bool has_else(index pIndex) const
+	{
+		return (mNodes[pIndex].payload & 1) != 0;
+	}
+
+	// Rebuilds a regular AST of a subtree so it can be used with an
+	// AST_visitor. The result has its own constants, but it still
+	// refers to the same source text.
+	AST_tree expand(index pIndex = 0) const
+	{
+		if (mNodes.empty())
+			return{};
+		auto arena = std::make_unique<AST_arena>();
+		constant_copies copies(mValues.size(), nullptr);
+		AST_node* root = expand_node(*arena, copies, pIndex);
+		return AST_tree(std::move(arena), root);
+	}
+
+	// Visits a subtree with a regular AST_visitor, like AST_walker.
+	// The nodes are only valid during the visit.
+	void visit(AST_visitor* pVisitor, index pIndex = 0) const
+	{
+		if (auto tree = expand(pIndex))
+			tree->visit(pVisitor);
+	}
+
+	// Writes the tree to the end of pBuffer so it can be loaded again
+	// with read(). The text the tree refers to is only stored as ranges
+	// of pSource. Returns false if it refers to any text outside of it.
+	bool write(std::string& pBuffer, std::string_view pSource) const
+	{
+		detail::binary_writer writer(pBuffer);
+		const auto write_view = [&](std::string_view pView)
+		{
+			// Views without any text, like the name of an anonymous function
+			if (pView.data() == nullptr)
+			{
+				writer.write(unknown_offset);
+				writer.write(std::uint32_t{ 0 });
+				return true;
+			}
+			if (pView.data() < pSource.data() || pView.data() + pView.length() > pSource.data() + pSource.length())
+				return false;
+			writer.write(static_cast<std::uint32_t>(pView.data() - pSource.data()));
+			writer.write(static_cast<std::uint32_t>(pView.length()));
+			return true;
+		};
+		const auto write_token = [&](const token& pToken)
+		{
+			writer.write(pToken.type);
+			writer.write(pToken.offset);
+			writer.write(static_cast<unsigned char>(pToken.value.index()));
+			if (const int* i = std::get_if<int>(&pToken.value))
+				writer.write(*i);
+			else
+				writer.write(std::get<float>(pToken.value));
+			return write_view(pToken.text);
+		};
+
+		// The nodes are written as they are in memory so they can be
+		// read back in one go
+		writer.write(static_cast<std::uint32_t>(mNodes.size()));
+		for (const auto& i : mNodes)
+		{
+			// Clear the padding so a tree is always written the same
+			node record;
+			std::memset(&record, 0, sizeof(record));
+			record.offset = i.offset;
+			record.end = i.end;
+			record.payload = i.payload;
+			record.kind = i.kind;
+			writer.write_raw(&record, sizeof(record));
+		}
+
+		writer.write(static_cast<std::uint32_t>(mIdentifiers.size()));
+		for (const auto& i : mIdentifiers)
+			if (!write_view(i))
+				return false;
+
+		writer.write(static_cast<std::uint32_t>(mVariables.size()));
+		for (const auto& i : mVariables)
+		{
+			writer.write(i.is_const);
+			if (!write_view(i.identifier))
+				return false;
+		}
+
+		writer.write(static_cast<std::uint32_t>(mValues.size()));
+		for (const auto& i : mValues)
+		{
+			if (const int* value = i.get<const int>())
+			{
+				writer.write(constant_tag::integer);
+				writer.write(*value);
+			}
+			else if (const float* value = i.get<const float>())
+			{
+				writer.write(constant_tag::floating);
+				writer.write(*value);
+			}
+			else if (const std::string* value = i.get<const std::string>())
+			{
+				writer.write(constant_tag::string);
+				writer.write_bytes(*value);
+			}
+			else
+				return false;
+		}
+
+		writer.write(static_cast<std::uint32_t>(mConstants.size()));
+		for (const auto& i : mConstants)
+		{
+			writer.write(i.value);
+			if (!write_view(i.text))
+				return false;
+		}
+
+		writer.write(static_cast<std::uint32_t>(mFunctions.size()));
+		for (const auto& i : mFunctions)
+		{
+			writer.write(i.first_parameter);
+			writer.write(i.parameter_count);
+			writer.write(i.has_return_type);
+			if (!write_view(i.identifier) || !write_token(i.return_type))
+				return false;
+		}
+
+		writer.write(static_cast<std::uint32_t>(mParameters.size()));
+		for (const auto& i : mParameters)
+		{
+			writer.write(i.has_type);
+			writer.write(i.is_const);
+			if (!write_view(i.identifier) || !write_token(i.type))
+				return false;
+		}
+		return true;
+	}
+
+	// Replaces this tree with one written by write() for the same source.
+	// Everything is checked, so data that is damaged or was written for
+	// another source only makes this return false and leave the tree empty.
+	bool read(std::string_view pData, std::string_view pSource)
+	{
+		*this = AST_flat_tree{};
+		if (!read_impl(pData, pSource))
+		{
+			*this = AST_flat_tree{};
+			return false;
+		}
+		return true;
+	}
+
+	std::size_t memory_usage() const
+	{
+		return mNodes.capacity() * sizeof(node)
+			+ mIdentifiers.capacity() * sizeof(std::string_view)
+			+ mVariables.capacity() * sizeof(variable_info)
+			+ mConstants.capacity() * sizeof(constant_info)
+			+ mValues.capacity() * sizeof(value_type)
+			+ mFunctions.capacity() * sizeof(function_info)
+			+ mParameters.capacity() * sizeof(param);
+	}
+
+private:
+	enum class constant_tag : unsigned char
+	{
+		integer,
+		floating,
+		string,
+	};
+
+	bool read_impl(std::string_view pData, std::string_view pSource)
+	{
+		detail::binary_reader reader(pData);
+		const auto read_view = [&](std::string_view& pView)
+		{
+			std::uint32_t offset, length;
+			if (!reader.read(offset) || !reader.read(length))
+				return false;
+			if (offset == unknown_offset && length == 0)
+			{
+				pView = {};
+				return true;
+			}
+			if (offset > pSource.length() || length > pSource.length() - offset)
+				return false;
+			pView = pSource.substr(offset, length);
+			return true;
+		};
+		const auto read_token = [&](token& pToken)
+		{
+			unsigned char value_index;
+			if (!reader.read(pToken.type) || !reader.read(pToken.offset) || !reader.read(value_index))
+				return false;
+			if (pToken.type >= token_type::count)
+				return false;
+			if (value_index == 0)
+			{
+				int value;
+				if (!reader.read(value))
+					return false;
+				pToken.value = value;
+			}
+			else if (value_index == 1)
+			{
+				float value;
+				if (!reader.read(value))
+					return false;
+				pToken.value = value;
+			}
+			else
+				return false;
+			return read_view(pToken.text);
+		};
+
+		// The smallest each item can be is used to check the counts
+		static_assert(std::is_trivially_copyable_v<node>, "Nodes are read as they are in memory");
+		std::uint32_t count;
+		if (!reader.read_count(count, sizeof(node)))
+			return false;
+		mNodes.resize(count);
+		if (!reader.read_raw(mNodes.data(), count * sizeof(node)))
+			return false;
+
+		if (!reader.read_count(count, 8))
+			return false;
+		mIdentifiers.resize(count);
+		for (auto& i : mIdentifiers)
+			if (!read_view(i))
+				return false;
+
+		if (!reader.read_count(count, 9))
+			return false;
+		mVariables.resize(count);
+		for (auto& i : mVariables)
+			if (!reader.read(i.is_const) || !read_view(i.identifier))
+				return false;
+
+		if (!reader.read_count(count, 5))
+			return false;
+		mValues.resize(count);
+		for (auto& i : mValues)
+		{
+			constant_tag tag;
+			if (!reader.read(tag))
+				return false;
+			if (tag == constant_tag::integer)
+			{
+				int value;
+				if (!reader.read(value))
+					return false;
+				i = const_value(value);
+			}
+			else if (tag == constant_tag::floating)
+			{
+				float value;
+				if (!reader.read(value))
+					return false;
+				i = const_value(value);
+			}
+			else if (tag == constant_tag::string)
+			{
+				std::string_view value;
+				if (!reader.read_bytes(value))
+					return false;
+				i = const_value(std::string(value));
+			}
+			else
+				return false;
+		}
+
+		if (!reader.read_count(count, 12))
+			return false;
+		mConstants.resize(count);
+		for (auto& i : mConstants)
+		{
+			if (!reader.read(i.value) || i.value >= mValues.size() || !read_view(i.text))
+				return false;
+		}
+
+		if (!reader.read_count(count, 31))
+			return false;
+		mFunctions.resize(count);
+		for (auto& i : mFunctions)
+		{
+			if (!reader.read(i.first_parameter) || !reader.read(i.parameter_count) || !reader.read(i.has_return_type)
+				|| !read_view(i.identifier) || !read_token(i.return_type))
+				return false;
+		}
+
+		if (!reader.read_count(count, 24))
+			return false;
+		mParameters.resize(count);
+		for (auto& i : mParameters)
+			if (!reader.read(i.has_type) || !reader.read(i.is_const) || !read_view(i.identifier) || !read_token(i.type))
+				return false;
+
+		return reader.at_end() && is_valid();
+	}
+
+	// Checks that every index in the nodes is in range, that the
+	// subtrees nest and that every node has as many children as the
+	// parser gives it, so nothing can go out of bounds when it is used.
+	// The text of a string constant also has to be one the tokenizer
+	// accepts, as it is unescaped again by the AST_viewer.
+	bool is_valid() const
+	{
+		if (mNodes.empty() || mNodes[0].end != mNodes.size())
+			return false;
+		for (const auto& i : mConstants)
+			if (mValues[i.value].get<const std::string>() && !detail::is_string_text(i.text))
+				return false;
+		for (index i = 0; i < mNodes.size(); i++)
+		{
+			const node& n = mNodes[i];
+			if (n.end <= i || n.end > mNodes.size())
+				return false;
+			// The children are checked before they are visited themselves
+			std::size_t children = 0;
+			for (index c = first_child(i); c < n.end; c = next_sibling(c), ++children)
+				if (mNodes[c].end <= c || mNodes[c].end > n.end)
+					return false;
+
+			switch (n.kind)
+			{
+			case AST_kind::empty:
+			case AST_kind::identifier:
+			case AST_kind::constant:
+			case AST_kind::break_statement:
+			case AST_kind::continue_statement:
+				if (children != 0)
+					return false;
+				break;
+			case AST_kind::variable:
+			case AST_kind::unary_op:
+			case AST_kind::member_accessor:
+			case AST_kind::return_statement:
+			case AST_kind::function_declaration:
+				if (children != 1)
+					return false;
+				break;
+			case AST_kind::binary_op:
+			case AST_kind::while_statement:
+				if (children != 2)
+					return false;
+				break;
+			case AST_kind::for_statement:
+				if (children != 4)
+					return false;
+				break;
+			case AST_kind::if_statement:
+				if (children != 2 + elseif_count(i) * 2 + (has_else(i) ? 1 : 0))
+					return false;
+				break;
+			case AST_kind::function_call:
+				if (children == 0)
+					return false;
+				break;
+			case AST_kind::block:
+				break;
+			default:
+				return false;
+			}
+
+			switch (n.kind)
+			{
+			case AST_kind::unary_op:
+			case AST_kind::binary_op:
+				if (n.payload >= static_cast<std::uint32_t>(token_type::count))
+					return false;
+				break;
+			case AST_kind::member_accessor:
+			case AST_kind::identifier:
+				if (n.payload >= mIdentifiers.size())
+					return false;
+				break;
+			case AST_kind::variable:
+				if (n.payload >= mVariables.size())
+					return false;
+				break;
+			case AST_kind::constant:
+				if (n.payload >= mConstants.size())
+					return false;
+				break;
+			case AST_kind::function_declaration:
+			{
+				if (n.payload >= mFunctions.size())
+					return false;
+				const function_info& info = mFunctions[n.payload];
+				if (info.first_parameter > mParameters.size()
+					|| info.parameter_count > mParameters.size() - info.first_parameter)
+					return false;
+				break;
+			}
+			default:
+				break;
+			}
+		}
+		return true;
+	}
+
+	// The copy in the arena of each distinct value that was expanded
+	using constant_copies = std::vector<const value_type*>;
+
+	// Adds a constant to the pool of an arena. Only the types the parser
+	// makes constants of are supported.
+	const value_type* copy_constant(AST_arena& pArena, constant_copies& pCopies, std::uint32_t pValue) const
+	{
+		if (!pCopies[pValue])
+			pCopies[pValue] = add_constant(pArena.constants(), mValues[pValue]);
+		return pCopies[pValue];
+	}
+
+	static const value_type* add_constant(constant_pool& pPool, const value_type& pValue)
+	{
+		if (const int* value = pValue.get<const int>())
+			return &pPool[pPool.add(*value)];
+		if (const float* value = pValue.get<const float>())
+			return &pPool[pPool.add(*value)];
+		if (const std::string* value = pValue.get<const std::string>())
+			return &pPool[pPool.add(std::string_view(*value))];
+		return nullptr;
+	}
+
+	// The index in mValues of each value of the constants of an AST
+	using value_indices = std::unordered_map<const value_type*, std::uint32_t>;
+
+	// Fills in the kind and payload of a node while it is flattened
+	class flattener :
+		public AST_visitor
+	{
+	public:
+		flattener(AST_flat_tree& pTree, value_indices& pValue_indices, node& pNode) :
+			mTree(pTree),
+			mValue_indices(pValue_indices),
+			mNode(pNode)
+		{}
+
+		void dispatch(AST_node_empty*) override { set(AST_kind::empty); }
+		void dispatch(AST_node_block*) override { set(AST_kind::block); }
+		void dispatch(AST_node_function_call*) override { set(AST_kind::function_call); }
+		void dispatch(AST_node_for*) override { set(AST_kind::for_statement); }
+		void dispatch(AST_node_while*) override { set(AST_kind::while_statement); }
+		void dispatch(AST_node_return*) override { set(AST_kind::return_statement); }
+		void dispatch(AST_node_break*) override { set(AST_kind::break_statement); }
+		void dispatch(AST_node_continue*) override { set(AST_kind::continue_statement); }
+
+		void dispatch(AST_node_variable* pNode) override
+		{
+			set(AST_kind::variable, mTree.mVariables.size());
+			mTree.mVariables.push_back({ pNode->identifier, pNode->is_const });
+		}
+
+		void dispatch(AST_node_unary_op* pNode) override
+		{
+			set(AST_kind::unary_op, static_cast<std::size_t>(pNode->type));
+		}
+
+		void dispatch(AST_node_binary_op* pNode) override
+		{
+			set(AST_kind::binary_op, static_cast<std::size_t>(pNode->type));
+		}
+
+		void dispatch(AST_node_member_accessor* pNode) override
+		{
+			set(AST_kind::member_accessor, mTree.mIdentifiers.size());
+			mTree.mIdentifiers.push_back(pNode->identifier);
+		}
+
+		void dispatch(AST_node_identifier* pNode) override
+		{
+			set(AST_kind::identifier, mTree.mIdentifiers.size());
+			mTree.mIdentifiers.push_back(pNode->identifier);
+		}
+
+		void dispatch(AST_node_constant* pNode) override
+		{
+			set(AST_kind::constant, mTree.mConstants.size());
+			// Constants from the same pool share their value
+			auto[iter, inserted] = mValue_indices.try_emplace(pNode->value, static_cast<std::uint32_t>(mTree.mValues.size()));
+			if (inserted)
+				mTree.mValues.push_back(pNode->value ? *pNode->value : value_type{});
+			mTree.mConstants.push_back({ iter->second, pNode->text });
+		}
+
+		void dispatch(AST_node_if* pNode) override
+		{
+			set(AST_kind::if_statement, (pNode->elseif_count << 1) | (pNode->has_else ? 1 : 0));
+		}
+
+		void dispatch(AST_node_function_declaration* pNode) override
+		{
+			set(AST_kind::function_declaration, mTree.mFunctions.size());
+			function_info info;
+			info.identifier = pNode->identifier;
+			info.first_parameter = static_cast<std::uint32_t>(mTree.mParameters.size());
+			info.parameter_count = static_cast<std::uint32_t>(pNode->parameters.size());
+			info.has_return_type = pNode->has_return_type;
+			info.return_type = pNode->return_type;
+			mTree.mFunctions.push_back(info);
+			mTree.mParameters.insert(mTree.mParameters.end(), pNode->parameters.begin(), pNode->parameters.end());
+		}
+
+	private:
+		void set(AST_kind pKind, std::size_t pPayload = 0)
+		{
+			mNode.kind = pKind;
+			mNode.payload = static_cast<std::uint32_t>(pPayload);
+		}
+
+	private:
+		AST_flat_tree& mTree;
+		value_indices& mValue_indices;
+		node& mNode;
+	};
+
+	void flatten(const AST_node* pNode, value_indices& pValue_indices)
+	{
+		const index i = static_cast<index>(mNodes.size());
+		mNodes.push_back({ pNode->offset, 0, 0, AST_kind::empty });
+		// Visiting doesn't change the node, it only needs to know its type
+		flattener f(*this, pValue_indices, mNodes[i]);
+		const_cast<AST_node*>(pNode)->visit(&f);
+		for (const AST_node* c : pNode->children)
+			flatten(c, pValue_indices);
+		mNodes[i].end = static_cast<index>(mNodes.size());
+	}
+
+	AST_node* expand_node(AST_arena& pArena, constant_copies& pCopies, index pIndex) const
+	{
+		const node& n = mNodes[pIndex];
+		AST_node* result = nullptr;
+		switch (n.kind)
+		{
+		case AST_kind::empty: result = pArena.create<AST_node_empty>(); break;
+		case AST_kind::block: result = pArena.create<AST_node_block>(); break;
+		case AST_kind::function_call: result = pArena.create<AST_node_function_call>(); break;
+		case AST_kind::for_statement: result = pArena.create<AST_node_for>(); break;
+		case AST_kind::while_statement: result = pArena.create<AST_node_while>(); break;
+		case AST_kind::return_statement: result = pArena.create<AST_node_return>(); break;
+		case AST_kind::break_statement: result = pArena.create<AST_node_break>(); break;
+		case AST_kind::continue_statement: result = pArena.create<AST_node_continue>(); break;
+		case AST_kind::variable:
+		{
+			auto node = pArena.create<AST_node_variable>();
+			node->identifier = variable(pIndex).identifier;
+			node->is_const = variable(pIndex).is_const;
+			result = node;
+			break;
+		}
+		case AST_kind::unary_op:
+		{
+			auto node = pArena.create<AST_node_unary_op>();
+			node->type = operation(pIndex);
+			result = node;
+			break;
+		}
+		case AST_kind::binary_op:
+		{
+			auto node = pArena.create<AST_node_binary_op>();
+			node->type = operation(pIndex);
+			result = node;
+			break;
+		}
+		case AST_kind::member_accessor:
+		{
+			auto node = pArena.create<AST_node_member_accessor>();
+			node->identifier = identifier(pIndex);
+			result = node;
+			break;
+		}
+		case AST_kind::identifier:
+		{
+			auto node = pArena.create<AST_node_identifier>();
+			node->identifier = identifier(pIndex);
+			result = node;
+			break;
+		}
+		case AST_kind::constant:
+		{
+			auto node = pArena.create<AST_node_constant>();
+			node->value = copy_constant(pArena, pCopies, constant(pIndex).value);
+			node->text = constant(pIndex).text;
+			result = node;
+			break;
+		}
+		case AST_kind::if_statement:
+		{
+			auto node = pArena.create<AST_node_if>();
+			node->elseif_count = elseif_count(pIndex);
+			node->has_else = has_else(pIndex);
+			result = node;
+			break;
+		}
+		case AST_kind::function_declaration:
+		{
+			auto node = pArena.create<AST_node_function_declaration>();
+			const function_info& info = function(pIndex);
+			node->identifier = info.identifier;
+			node->parameters.assign(mParameters.begin() + info.first_parameter,
+				mParameters.begin() + info.first_parameter + info.parameter_count);
+			node->has_return_type = info.has_return_type;
+			node->return_type = info.return_type;
+			result = node;
+			break;
+		}
+		}
+		result->offset = n.offset;
+		result->children.reserve(child_count(pIndex));
+		for (index i = first_child(pIndex); i < n.end; i = next_sibling(i))
+			result->children.push_back(expand_node(pArena, pCopies, i));
+		return result;
+	}
+
+private:
+	std::vector<node> mNodes;
+	std::vector<std::string_view> mIdentifiers;
+	std::vector<variable_info> mVariables;
+	std::vector<constant_info> mConstants;
+	std::vector<value_type> mValues;
+	std::vector<function_info> mFunctions;
+	std::vector<param> mParameters;
+};
+
+} // namespace wolfscript
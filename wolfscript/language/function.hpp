@@ -196,13 +196,13 @@ constexpr const this_first_t this_first;
 template <typename T>
 callable function(this_first_t, T&& pFunc)
 {
-	using traits = detail::function_signature_traits<typename decltype(&std::decay_t<T>::operator())>;
-	using class_type = detail::first_param<traits::type::param_types>::type;
+	using traits = detail::function_signature_traits<decltype(&std::decay_t<T>::operator())>;
+	using class_type = typename detail::first_param<typename traits::type::param_types>::type;
 
 	static_assert(traits::type::param_types::size > 0, "You need to provide at least one parameter for a standalone method");
 	static_assert(std::is_pointer_v<class_type>, "First parameter of a standalone method needs to be a pointer");
 
-	using sig = detail::function_signature<traits::type::return_type, traits::type::param_types, true, std::is_const_v<class_type>>;
+	using sig = detail::function_signature<typename traits::type::return_type, typename traits::type::param_types, true, std::is_const_v<class_type>>;
 
 	return detail::make_proxy_function(std::forward<T>(pFunc), sig{});
 }
@@ -211,11 +211,11 @@ template <typename Tret, typename...Tparams>
 callable function(this_first_t, Tret(*pFunc)(Tparams...))
 {
 	static_assert(sizeof...(Tparams) > 0, "You need to provide at least one parameter for a standalone method");
-	using class_type = detail::first_param<Tparams...>::type;
+	using class_type = typename detail::first_param<Tparams...>::type;
 
 	static_assert(std::is_pointer_v<class_type>, "First parameter of a standalone method needs to be a pointer");
 
-	using sig = detail::function_signature<Tret, detail::function_params<Tparams...>, true, std::is_const_v<class_type>>{};
+	using sig = detail::function_signature<Tret, detail::function_params<Tparams...>, true, std::is_const_v<class_type>>;
 
 	return detail::make_proxy_function(std::move(pFunc), sig{});
 }
@@ -241,11 +241,21 @@ callable function(Tret(Tclass::*pFunc)(Tparams...) const)
 template <typename T>
 callable function(T&& pFunc)
 {
-	using traits = detail::function_signature_traits<typename decltype(&std::decay_t<T>::operator())>;
-	using sig = detail::function_signature<traits::type::return_type, traits::type::param_types>;
+	using traits = detail::function_signature_traits<decltype(&std::decay_t<T>::operator())>;
+	using sig = detail::function_signature<typename traits::type::return_type, typename traits::type::param_types>;
 	return detail::make_proxy_function(std::forward<T>(pFunc), sig{});
 }
 
+// Wraps a function like function() and marks it as pure,
+// see callable::is_pure
+template <typename...T>
+callable pure_function(T&&...pArgs)
+{
+	callable c = function(std::forward<T>(pArgs)...);
+	c.is_pure = true;
+	return c;
+}
+
 namespace detail
 {
 
@@ -280,14 +290,15 @@ std::function<T> from_callable(const callable& pCallable, const cast_list& pCast
 	if (auto orig = pCallable.original_function.get<std::function<T>>())
 		return *orig;
 
+	using traits = detail::function_signature_traits<T*>;
+	auto types = detail::function_signature_types::create(typename traits::type{});
+
 	// Check types
 	if (!pCallable.match(types.param_types, pCaster))
 		return{};
 
 	// Create a proxy function
-	using traits = detail::function_signature_traits<T*>;
-	auto types = detail::function_signature_types::create(traits{});
-	return detail::make_function<T>(pCallable, pCaster, traits::type);
+	return detail::make_function<T>(pCallable, pCaster, typename traits::type{});
 }
 
 } // namespace wolfscript
@@ -0,0 +1,329 @@
+#pragma once
+
+#include "parser.hpp"
+#include "line_index.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace wolfscript
+{
+
+namespace detail
+{
+
+// Passes tokens through while keeping track of where the last one ended
+class token_end_tracker :
+	public token_source
+{
+public:
+	token_end_tracker(token_source& pSource, std::uint32_t pStart) :
+		mSource(pSource),
+		mEnd(pStart)
+	{}
+
+	token next() override
+	{
+		token t = mSource.next();
+		if (t.type != token_type::eof)
+		{
+			// The quotes of a string are not a part of its text
+			const std::size_t quotes = t.type == token_type::string ? 2 : 0;
+			mEnd = t.offset + static_cast<std::uint32_t>(t.text.length() + quotes);
+		}
+		return t;
+	}
+
+	std::uint32_t end() const
+	{
+		return mEnd;
+	}
+
+private:
+	token_source& mSource;
+	std::uint32_t mEnd;
+};
+
+// Checks that the whitespace and comments after the last token can't
+// run into any text that follows them, like an unterminated comment.
+inline bool is_closed_trivia(std::string_view pText)
+{
+	while (true)
+	{
+		trim_whitespace_prefix(pText);
+		if (pText.empty())
+			return true;
+		if (query_multichar(pText, "//"))
+		{
+			const std::size_t end = pText.find('\n', 2);
+			if (end == std::string_view::npos)
+				return false;
+			pText.remove_prefix(end);
+		}
+		else if (query_multichar(pText, "/*"))
+		{
+			const std::size_t end = pText.find("*/", 2);
+			if (end == std::string_view::npos)
+				return false;
+			pText.remove_prefix(end + 2);
+		}
+		else
+			return false;
+	}
+}
+
+} // namespace detail
+
+// Keeps a source and its AST up to date while the source is edited.
+// The source is split into chunks at the start of each top-level
+// statement. An edit only re-tokenizes and re-parses the chunks around
+// it and splices the new statements into the existing AST_node_block,
+// so the rest of the AST is reused as is.
+//
+// Each parse gives its tokens offsets that are never handed out again,
+// so the nodes of a statement don't have to be updated when the text
+// before it moves. Use source_offset() or resolve_position() to find
+// where they are in text().
+//
+// A replaced statement is only freed along with the tree it was parsed
+// in, once none of the statements of that tree are left.
+class incremental_parser
+{
+public:
+	incremental_parser()
+	{
+		parse({});
+	}
+
+	// Parses a whole new source.
+	// This will throw a tokenization_error or parse_error exception on an error.
+	void parse(std::string_view pSource)
+	{
+		mRoot = std::make_unique<AST_node_block>();
+		mChunks.clear();
+		mStarts.clear();
+		mNext_base = 0;
+		mBroken = false;
+		mBroken_text.clear();
+		try
+		{
+			reparse(0, 0, pSource);
+		}
+		catch (exception::wolf_exception& e)
+		{
+			mBroken = true;
+			mBroken_text = std::string(pSource);
+			e.resolve_position(line_index(mBroken_text));
+			throw;
+		}
+	}
+
+	// Replaces pRemoved characters at pOffset with pInserted.
+	// If the new source doesn't parse, the exception is thrown and the
+	// edit is kept but the AST is left as it was. The next edit will
+	// then have to parse the whole source again.
+	void edit(std::size_t pOffset, std::size_t pRemoved, std::string_view pInserted)
+	{
+		if (pOffset > size() || pRemoved > size() - pOffset)
+			throw exception::wolf_exception("Edit is out of range of the source");
+
+		if (mBroken)
+		{
+			std::string source = std::move(mBroken_text);
+			source.replace(pOffset, pRemoved, pInserted);
+			parse(source);
+			return;
+		}
+
+		// The statement before the edit is included since it may continue
+		// into it. An "else" could have been added after an if statement.
+		std::size_t first = chunk_of(pOffset);
+		if (first > 0)
+			--first;
+		std::size_t last = chunk_of(pOffset + pRemoved) + 1;
+
+		while (true)
+		{
+			std::string window;
+			for (std::size_t i = first; i < last; i++)
+				window += mChunks[i].text;
+			window.replace(pOffset - mStarts[first], pRemoved, pInserted);
+
+			// Start over when the offsets run out
+			if (window.length() >= unknown_offset - mNext_base)
+			{
+				std::string source = text();
+				source.replace(pOffset, pRemoved, pInserted);
+				parse(source);
+				return;
+			}
+
+			const std::uint32_t base = mNext_base;
+			try
+			{
+				if (reparse(first, last, window))
+					return;
+			}
+			catch (exception::wolf_exception& e)
+			{
+				// Nothing after the window can fix the error
+				if (last == mChunks.size())
+				{
+					mBroken_text = text();
+					mBroken_text.replace(pOffset, pRemoved, pInserted);
+					mBroken = true;
+					if (e.offset != unknown_offset && e.offset >= base)
+						e.offset = mStarts[first] + (e.offset - base);
+					e.resolve_position(line_index(mBroken_text));
+					throw;
+				}
+			}
+
+			// The window is doubled until it parses on its own. When it
+			// already reaches the end, it can only be missing a statement.
+			if (last == mChunks.size())
+				first = first > 0 ? first - 1 : 0;
+			else
+				last = std::min(mChunks.size(), last + (last - first));
+		}
+	}
+
+	// Only valid until the next edit or parse
+	AST_node::ptr ast() const
+	{
+		return mRoot.get();
+	}
+
+	std::string text() const
+	{
+		if (mBroken)
+			return mBroken_text;
+		std::string result;
+		result.reserve(size());
+		for (const auto& i : mChunks)
+			result += i.text;
+		return result;
+	}
+
+	std::size_t size() const
+	{
+		if (mBroken)
+			return mBroken_text.size();
+		return mStarts.empty() ? 0 : mStarts.back() + mChunks.back().text.length();
+	}
+
+	// Converts the offset of a token or node of the AST into an
+	// offset in text(). Returns unknown_offset if it isn't in the AST.
+	std::uint32_t source_offset(std::uint32_t pOffset) const
+	{
+		for (std::size_t i = 0; i < mChunks.size(); i++)
+		{
+			const chunk& c = mChunks[i];
+			if (pOffset >= c.base && pOffset - c.base <= c.text.length())
+				return mStarts[i] + (pOffset - c.base);
+		}
+		return unknown_offset;
+	}
+
+	// Fills in the offset and position of an exception thrown while
+	// interpreting the AST.
+	void resolve_position(exception::wolf_exception& pException) const
+	{
+		if (pException.offset == unknown_offset)
+			return;
+		pException.offset = source_offset(pException.offset);
+		pException.position = unknown_position;
+		pException.resolve_position(line_index(text()));
+	}
+
+private:
+	struct chunk
+	{
+		// Owns the text the tokens and nodes of this chunk refer to.
+		// Chunks parsed together share it.
+		std::shared_ptr<const std::string> buffer;
+		// Owns the nodes of the statement
+		std::shared_ptr<const AST_tree> tree;
+		std::string_view text;
+		// The offset the first character was given when it was parsed
+		std::uint32_t base;
+	};
+
+	std::size_t chunk_of(std::size_t pOffset) const
+	{
+		const auto iter = std::upper_bound(mStarts.begin(), mStarts.end(), pOffset);
+		return iter == mStarts.begin() ? 0 : static_cast<std::size_t>(iter - mStarts.begin()) - 1;
+	}
+
+	// Parses pText in place of the chunks [pFirst, pLast).
+	// Returns false if the text has to include more chunks to be
+	// parsed the same as the whole source would.
+	bool reparse(std::size_t pFirst, std::size_t pLast, std::string_view pText)
+	{
+		const bool at_end = pLast == mChunks.size();
+		auto buffer = std::make_shared<const std::string>(pText);
+		const std::uint32_t base = mNext_base;
+		mNext_base += static_cast<std::uint32_t>(buffer->length()) + 1;
+
+		token_stream stream(*buffer, base);
+		detail::token_end_tracker tracker(stream, base);
+		std::vector<std::uint32_t> statement_offsets;
+		parser p;
+		auto tree = std::make_shared<const AST_tree>(p.parse(tracker, statement_offsets));
+
+		// A comment left open would swallow the chunks after the window
+		if (!at_end && !detail::is_closed_trivia(std::string_view(*buffer).substr(tracker.end() - base)))
+			return false;
+
+		// Only a source without any statements has a chunk without one
+		const auto& statements = tree->get()->children;
+		if (statements.empty() && !(pFirst == 0 && at_end))
+			return false;
+
+		std::vector<chunk> chunks;
+		for (std::size_t i = 0; i < statements.size(); i++)
+		{
+			const std::size_t begin = i == 0 ? 0 : statement_offsets[i] - base;
+			const std::size_t end = i + 1 < statements.size() ? statement_offsets[i + 1] - base : buffer->length();
+			chunks.push_back({ buffer, tree, std::string_view(*buffer).substr(begin, end - begin),
+				base + static_cast<std::uint32_t>(begin) });
+		}
+		if (chunks.empty())
+			chunks.push_back({ buffer, tree, *buffer, base });
+
+		auto& children = mRoot->children;
+		const std::size_t child_first = std::min(pFirst, children.size());
+		const std::size_t child_last = std::min(pLast, children.size());
+		children.erase(children.begin() + child_first, children.begin() + child_last);
+		children.insert(children.begin() + child_first, statements.begin(), statements.end());
+
+		mChunks.erase(mChunks.begin() + pFirst, mChunks.begin() + pLast);
+		mChunks.insert(mChunks.begin() + pFirst, chunks.begin(), chunks.end());
+
+		// Move the starts of every chunk after the window
+		mStarts.resize(mChunks.size());
+		for (std::size_t i = pFirst; i < mChunks.size(); i++)
+			mStarts[i] = i == 0 ? 0 : mStarts[i - 1] + static_cast<std::uint32_t>(mChunks[i - 1].text.length());
+		return true;
+	}
+
+private:
+	// Only the list of statements is owned here. The statements are owned
+	// by the trees of their chunks.
+	std::unique_ptr<AST_node_block> mRoot;
+	std::vector<chunk> mChunks;
+	// The offset of each chunk in the source
+	std::vector<std::uint32_t> mStarts;
+	std::uint32_t mNext_base{ 0 };
+
+	// Set when the last edit didn't parse. The source is only kept here
+	// until the next edit parses it again.
+	bool mBroken{ false };
+	std::string mBroken_text;
+};
+
+} // namespace wolfscript
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "ast.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace wolfscript
+{
+
+namespace detail
+{
+
+inline std::size_t count_nodes(const AST_node* pNode)
+{
+	std::size_t count = 1;
+	for (const auto& i : pNode->children)
+		count += count_nodes(i);
+	return count;
+}
+
+} // namespace detail
+
+// Finds the calls whose callee can only be a small script function and
+// marks them so the interpreter runs the body of the function straight
+// from the call, without resolving overloads, casting to generic
+// parameters and going through the std::function of the callable.
+//
+// A function is only inlined if it is the one thing declared with its
+// name in its scope, so it isn't overloaded, and if it doesn't call
+// itself. The callee is still checked when the call is run, so a name
+// that is bound to something else by then is called like any other.
+class function_inliner :
+	private AST_walker
+{
+public:
+	// Functions with up to this many nodes in their body are inlined
+	void set_max_size(std::size_t pNodes)
+	{
+		mMax_size = pNodes;
+	}
+
+	// The tree has to be resolved first
+	void inline_calls(AST_node* pRoot)
+	{
+		mFrames.clear();
+		mFunctions.clear();
+		mCalls.clear();
+
+		// Find what is declared in each frame first, since a function
+		// can call another that is declared after it.
+		mCollecting = true;
+		mOwners.assign(1, pRoot);
+		pRoot->visit(this);
+
+		mCollecting = false;
+		mOwners.assign(1, pRoot);
+		pRoot->visit(this);
+
+		for (auto[call, function] : mCalls)
+		{
+			function_info& info = mFunctions[function];
+			if (!info.counted)
+			{
+				info.size = detail::count_nodes(function->children[0]);
+				info.counted = true;
+			}
+			call->inlined = !info.recursive && info.size <= mMax_size ? function : nullptr;
+		}
+	}
+
+private:
+	struct slot
+	{
+		AST_node_function_declaration* function{ nullptr };
+		std::uint32_t declarations{ 0 };
+	};
+
+	struct function_info
+	{
+		std::size_t size{ 0 };
+		bool counted{ false };
+		bool recursive{ false };
+	};
+
+private:
+	virtual void dispatch(AST_node_variable* pNode) override
+	{
+		if (mCollecting)
+			declare(pNode->slot, nullptr);
+		AST_walker::dispatch(pNode);
+	}
+
+	virtual void dispatch(AST_node_function_declaration* pNode) override
+	{
+		if (mCollecting && !pNode->identifier.empty())
+			declare(pNode->slot, pNode);
+		mOwners.push_back(pNode);
+		AST_walker::dispatch(pNode);
+		mOwners.pop_back();
+	}
+
+	virtual void dispatch(AST_node_function_call* pNode) override
+	{
+		AST_walker::dispatch(pNode);
+		if (mCollecting)
+			return;
+		pNode->inlined = nullptr;
+
+		const AST_node_identifier* callee = as_identifier(pNode->children[0]);
+		if (!callee || callee->slot == unresolved_slot || callee->depth >= mOwners.size())
+			return;
+		auto iter = mFrames.find(mOwners[mOwners.size() - 1 - callee->depth]);
+		if (iter == mFrames.end() || callee->slot >= iter->second.size())
+			return;
+		const slot& s = iter->second[callee->slot];
+		if (!s.function || s.declarations != 1
+			|| s.function->parameters.size() != pNode->children.size() - 1)
+			return;
+
+		// A call from anywhere in its own body makes it recursive
+		for (std::size_t i = mOwners.size(); i > 1; i--)
+			if (mOwners[i - 1] == s.function)
+				mFunctions[s.function].recursive = true;
+		mCalls.emplace_back(pNode, s.function);
+	}
+
+private:
+	void declare(std::uint32_t pSlot, AST_node_function_declaration* pFunction)
+	{
+		if (pSlot == unresolved_slot)
+			return;
+		auto& slots = mFrames[mOwners.back()];
+		if (pSlot >= slots.size())
+			slots.resize(pSlot + 1);
+		slots[pSlot].function = pFunction;
+		++slots[pSlot].declarations;
+	}
+
+private:
+	std::size_t mMax_size{ 32 };
+	bool mCollecting{ false };
+	// The root and the functions around the node being visited.
+	// Each of them has a frame of its own.
+	std::vector<AST_node*> mOwners;
+	// What is declared in each slot of each frame
+	std::unordered_map<const AST_node*, std::vector<slot>> mFrames;
+	std::unordered_map<const AST_node_function_declaration*, function_info> mFunctions;
+	std::vector<std::pair<AST_node_function_call*, AST_node_function_declaration*>> mCalls;
+};
+
+} // namespace wolfscript
@@ -4,11 +4,29 @@
 #include "value_type.hpp"
 #include "exception.hpp"
 #include "callable.hpp"
+#include "call_cache.hpp"
+#include "operator_table.hpp"
 #include "common.hpp"
 #include "arithmetic.hpp"
-
+#include "resolver.hpp"
+#include "constant_folder.hpp"
+#include "inliner.hpp"
+#include "type_inferrer.hpp"
+#include "loop_hoister.hpp"
+#include "escape_analyzer.hpp"
+#include "bytecode.hpp"
+#include "jit.hpp"
+
+#include <algorithm>
 #include <iostream>
 #include <bitset>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string_view>
+#include <utility>
 
 namespace wolfscript
 {
@@ -54,33 +72,38 @@ public:
 	value_type& add(const std::string& pName, const value_type& pValue)
 	{
 		auto iter = mScope_stack.front().find(pName);
-		if (iter != mScope_stack.front().end())
+		if (iter == mScope_stack.front().end())
+			return mScope_stack.front()[pName] = pValue;
+		redeclare(iter->second, pValue);
+		return iter->second;
+	}
+
+	// Declares a value in place of one with the same name in the same scope.
+	// Functions are added as overloads, anything else replaces the old value.
+	static void redeclare(value_type& pDeclared, const value_type& pValue)
+	{
+		if (pValue.get<const callable>())
 		{
-			if (pValue.get<const callable>())
+			if (auto overloader = pDeclared.get<const callable_overloader>())
 			{
-				if (auto overloader = iter->second.get<const callable_overloader>())
-				{
-					// Add to a current overloader in scope
-					overloader->add(pValue);
-				}
-				else if (iter->second.get<const callable>())
-				{
-					// Swap it out for an overloader
-					callable_overloader overloader;
-					overloader.add(pValue);
-					overloader.add(iter->second);
-					iter->second = overloader;
-				}
-				return iter->second;
+				// Add to a current overloader in scope
+				overloader->add(pValue);
+				return;
+			}
+			else if (pDeclared.get<const callable>())
+			{
+				// Swap it out for an overloader
+				callable_overloader overloader;
+				overloader.add(pValue);
+				overloader.add(pDeclared);
+				pDeclared = overloader;
+				return;
 			}
 		}
-		else
-		{
-			return mScope_stack.front()[pName] = pValue;
-		}
+		pDeclared = pValue;
 	}
 
-	value_type* lookup(const std::string& pName)
+	value_type* lookup(std::string_view pName)
 	{
 		for (auto& i : mScope_stack)
 		{
@@ -91,7 +114,7 @@ public:
 		return nullptr;
 	}
 
-	value_type* lookup_current_scope(const std::string& pName)
+	value_type* lookup_current_scope(std::string_view pName)
 	{
 		auto iter = mScope_stack.front().find(pName);
 		if (iter != mScope_stack.front().end())
@@ -99,7 +122,7 @@ public:
 		return nullptr;
 	}
 
-	std::vector<value_type*> get_all_matches(const std::string& pName)
+	std::vector<value_type*> get_all_matches(std::string_view pName)
 	{
 		std::vector<value_type*> result;
 		for (auto& i : mScope_stack)
@@ -111,7 +134,7 @@ public:
 		return result;
 	}
 
-	bool exists(const std::string& pName) const
+	bool exists(std::string_view pName) const
 	{
 		for (const auto& i : mScope_stack)
 			if (i.find(pName) != i.end())
@@ -128,7 +151,8 @@ public:
 	}
 
 private:
-	typedef std::map<std::string, value_type> scope_t;
+	// Can be searched with a string_view without making a string
+	typedef std::map<std::string, value_type, std::less<>> scope_t;
 	std::list<scope_t> mScope_stack;
 };
 
@@ -138,15 +162,89 @@ class interpreter :
 public:
 	using string_factory = std::function<value_type(const std::string&)>;
 
+	~interpreter()
+	{
+		// A function that captures itself or another function that
+		// captures it keeps its cell alive, so they are emptied here
+		for (const auto& i : mCells)
+			if (auto cell = i.lock())
+				cell->reset();
+	}
+
+	// The locals of the tree are resolved to slots first, which changes
+	// the nodes. A tree can't be interpreted by two threads at once.
 	void interpret(AST_node* mRoot)
 	{
-		mRoot->visit(this);
-		mControl_flags.reset();
+		run(mRoot, nullptr);
+	}
+
+	// The tree has to outlive any functions it declares.
+	// Its constants are folded first, see set_constant_folding().
+	void interpret(const AST_tree& mTree)
+	{
+		run(mTree.get(), &mTree.arena());
+	}
+
+	// Folds the constants of a tree before it is interpreted. This is on
+	// by default. Only an AST_tree can be folded since the nodes that take
+	// the place of others are created in its arena. The tree stays folded.
+	void set_constant_folding(bool pEnabled)
+	{
+		mConstant_folding = pEnabled;
+	}
+
+	// Calls to script functions with up to this many nodes in their body
+	// run the body straight from the call, see function_inliner. This is
+	// 32 by default, 0 turns it off.
+	void set_inline_size(std::size_t pNodes)
+	{
+		mInline_size = pNodes;
+	}
+
+	// Evaluates the invariant expressions of loops once per run of the
+	// loop, see loop_hoister. This is on by default.
+	void set_loop_hoisting(bool pEnabled)
+	{
+		mLoop_hoisting = pEnabled;
 	}
 
-	void interpret(const AST_node::ptr& mRoot)
+	// Runs operators that couldn't be typed on the number types they were
+	// run with so far, while their operands keep having them. This is on
+	// by default.
+	void set_quickening(bool pEnabled)
 	{
-		interpret(mRoot.get());
+		mQuickening = pEnabled;
+	}
+
+	// Keeps the overload each call in a script was resolved to for the
+	// callee and argument types, see call_cache. This is on by default.
+	void set_call_caching(bool pEnabled)
+	{
+		mCall_caching = pEnabled;
+	}
+
+	// Compiles the tree to bytecode and runs it on a register machine, see
+	// bytecode_compiler. This is on by default. Off, the nodes of the tree
+	// are visited one by one.
+	void set_bytecode(bool pEnabled)
+	{
+		mBytecode = pEnabled;
+	}
+
+	// Compiles script functions that only work on numbers to native code
+	// once they are hot, see jit_compiler. A function is compiled for the
+	// types of the arguments it is called with then, other calls are run
+	// the normal way. This is off by default, and does nothing but on
+	// x86-64 Linux.
+	void set_jit(bool pEnabled)
+	{
+		mJit = pEnabled;
+	}
+
+	// How many calls make a function hot. This is 10 by default.
+	void set_jit_threshold(std::size_t pCalls)
+	{
+		mJit_threshold = pCalls;
 	}
 
 	void add(const std::string& pName, value_type pVal)
@@ -171,6 +269,90 @@ public:
 	}
 
 private:
+	void run(AST_node* pRoot, AST_arena* pArena)
+	{
+		std::uint32_t frame_size = mResolver.resolve(pRoot);
+		mResolver.for_each_name([this](std::string_view pName)
+		{
+			if (mLocal_names.find(pName) == mLocal_names.end())
+				mLocal_names.emplace(pName);
+		});
+		// Folding keeps the slots the resolver gave out
+		if (mConstant_folding && pArena)
+			mFolder.fold(pRoot, *pArena);
+		mInliner.set_max_size(mInline_size);
+		mInliner.inline_calls(pRoot);
+		mInferrer.infer(pRoot,
+			[this](std::string_view pName) -> const value_type* { return mSymbols.lookup(pName); },
+			[this](std::string_view pName) { return get_type(pName); });
+		if (mLoop_hoisting)
+			frame_size = mHoister.hoist(pRoot, frame_size, [this](std::string_view pName) -> const value_type* { return mSymbols.lookup(pName); });
+		else
+			mHoister.clear(pRoot);
+		mEscapes.analyze(pRoot);
+
+		if (mBytecode)
+		{
+			auto code = mCompiler.compile(pRoot);
+			frame_push_pop frame(*this, mStack.size(), frame_size, nullptr);
+			execute(*code);
+			return;
+		}
+		frame_push_pop frame(*this, mStack.size(), frame_size, nullptr);
+		pRoot->visit(this);
+		mControl_flags.reset();
+	}
+
+	// A local of a frame. It stays empty until its declaration is run.
+	struct frame_slot
+	{
+		std::optional<value_type> value;
+		// Only needed to find the local by name
+		std::string_view name;
+		// Set once a function captures the local. The value is kept here
+		// from then on.
+		captured_value cell{};
+		// The value the local had before its scope ended, if nothing else
+		// could refer to it. See escape_analyzer.
+		std::optional<value_type> spare{};
+		bool recycle{ false };
+
+		std::optional<value_type>& get()
+		{
+			return cell ? *cell : value;
+		}
+	};
+
+	// RAII-based pushing and popping of frames
+	class frame_push_pop
+	{
+	public:
+		// The frame takes the slots from pBase on, which is usually the
+		// end of the stack
+		frame_push_pop(interpreter& pInterpreter, std::size_t pBase, std::uint32_t pSize,
+			const std::vector<captured_value>* pCaptures) :
+			mInterpreter(pInterpreter),
+			mPrevious_base(pInterpreter.mBase),
+			mPrevious_captures(pInterpreter.mCaptures)
+		{
+			mInterpreter.mBase = pBase;
+			mInterpreter.mCaptures = pCaptures;
+			mInterpreter.mStack.resize(pBase + pSize);
+		}
+
+		~frame_push_pop()
+		{
+			mInterpreter.mStack.resize(mInterpreter.mBase);
+			mInterpreter.mBase = mPrevious_base;
+			mInterpreter.mCaptures = mPrevious_captures;
+		}
+
+	private:
+		interpreter& mInterpreter;
+		std::size_t mPrevious_base;
+		const std::vector<captured_value>* mPrevious_captures;
+	};
+
 	value_type visit_for_value(AST_node* pNode)
 	{
 		mResult_value.clear();
@@ -180,14 +362,8 @@ private:
 		return result;
 	}
 
-	value_type visit_for_value(const std::unique_ptr<AST_node>& pNode)
-	{
-		return visit_for_value(pNode.get());
-	}
-
 	virtual void dispatch(AST_node_block* pNode) override
 	{
-		symbol_table::scope_push_pop scope(mSymbols);
 		for (const auto& i : pNode->children)
 		{
 			try
@@ -196,9 +372,10 @@ private:
 			}
 			catch (exception::interpretor_error& e)
 			{
-				// Report the position of the error if not already.
-				if (e.position == unknown_position)
-					e.position = i->related_token.position;
+				// Report where the error occurred if not already.
+				// The position is resolved from this by the caller.
+				if (e.offset == unknown_offset)
+					e.offset = i->offset;
 				throw;
 			}
 			catch (...)
@@ -213,33 +390,58 @@ private:
 			// Clear the result after each line.
 			mResult_value.clear();
 		}
+		clear_locals(pNode->locals);
 	}
 
 	// Declare variable
 	virtual void dispatch(AST_node_variable* pNode) override
 	{
-		mSymbols.add(std::string(pNode->identifier), copy_value(visit_for_value(pNode->children[0])));
+		scalar number;
+		if (mTyped.evaluate(pNode->children[0], number))
+			declare_number(pNode, pNode->children[0]->inferred, number);
+		else
+			declare_local(pNode, visit_for_value(pNode->children[0]));
 	}
 
 	virtual void dispatch(AST_node_unary_op* pNode)
 	{
+		if (is_invariant(pNode))
+		{
+			evaluate_invariant(pNode);
+			return;
+		}
+		if (pNode->inferred != known_type::unknown && evaluate_typed(pNode))
+			return;
+
 		value_type val = visit_for_value(pNode->children[0]);
-		mResult_value = arithmetic_unary_operation(pNode->type, val);
+		if (!quick_unary(pNode, val, mResult_value))
+			mResult_value = generic_unary(pNode, val);
 	}
 
 	virtual void dispatch(AST_node_binary_op* pNode) override
 	{
+		if (is_invariant(pNode))
+		{
+			evaluate_invariant(pNode);
+			return;
+		}
+		if (pNode->inferred != known_type::unknown
+			&& (is_assignment(pNode->type) ? assign_typed(pNode) : evaluate_typed(pNode)))
+			return;
+
 		value_type l = visit_for_value(pNode->children[0]);
 		value_type r = visit_for_value(pNode->children[1]);
-			
-		if (l.is_arithmetic() && r.is_arithmetic())
-			mResult_value = arithmetic_binary_operation(pNode->type, l, r);
-		else
-			mResult_value = call_function(object_behavior::from_token_type(pNode->type), { l, r });
+		if (!quick_binary(pNode, l, r, mResult_value))
+			mResult_value = generic_binary(pNode, l, r);
 	}
 
 	virtual void dispatch(AST_node_member_accessor* pNode) override
 	{
+		if (is_invariant(pNode))
+		{
+			evaluate_invariant(pNode);
+			return;
+		}
 		value_type l = visit_for_value(pNode->children[0]);
 
 		// Call function to access the member
@@ -248,26 +450,15 @@ private:
 
 	virtual void dispatch(AST_node_constant* pNode) override
 	{
-		switch (pNode->related_token.type)
-		{
-		case token_type::integer:
-			mResult_value = std::cref(std::get<int>(pNode->related_token.value));
-			break;
-		case token_type::floating:
-			mResult_value = std::cref(std::get<float>(pNode->related_token.value));
-			break;
-		case token_type::string:
-			mResult_value = std::cref(std::get<std::string>(pNode->related_token.value));
-			break;
-		default:
+		// Constants are prebuilt by the parser so this doesn't allocate
+		if (!pNode->value || pNode->value->is_void())
 			throw exception::interpretor_error("Unsupported constant type");
-		}
-		return;
+		mResult_value = *pNode->value;
 	}
 
 	virtual void dispatch(AST_node_identifier* pNode) override
 	{
-		if (auto value = mSymbols.lookup(std::string(pNode->identifier)))
+		if (auto value = find_value(pNode))
 			mResult_value = *value;
 		else
 			throw exception::interpretor_error("Variable does not exist");
@@ -275,40 +466,35 @@ private:
 
 	virtual void dispatch(AST_node_function_call* pNode) override
 	{
-		value_type c = visit_for_value(pNode->children[0]);
-		
-		arg_list args;
-		std::vector<type_info> arg_types;
-		for (std::size_t i = 1; i < pNode->children.size(); i++)
-		{
-			args.emplace_back(visit_for_value(pNode->children[i]));
-			arg_types.push_back(args.back().get_type_info());
-		}
-
-		const callable* func = nullptr;
-		if (auto overloader = c.get<const callable_overloader>())
-		{
-			func = &overloader->find(arg_types, mCaster);
-		}
-		else if (func = c.get<const callable>())
+		if (is_invariant(pNode))
 		{
-			if (!func->match(arg_types, mCaster))
-				throw exception::interpretor_error("Cannot find function");
-			mResult_value = func->function(args);
+			evaluate_invariant(pNode);
+			return;
 		}
-		else
+		value_type c = visit_for_value(pNode->children[0]);
+		if (pNode->inlined)
 		{
-			throw exception::interpretor_error("Not a function");
+			// Fall back to a normal call if the name was bound to
+			// something else
+			auto func = c.get<const callable>();
+			if (func && func->script.declaration == pNode->inlined)
+			{
+				call_inlined(pNode, *func);
+				return;
+			}
 		}
 
-		cast_arguments(args, func->parameter_types);
-		mResult_value = func->function(args);
+		arg_list args;
+		args.reserve(pNode->children.size() - 1);
+		for (std::size_t i = 1; i < pNode->children.size(); i++)
+			args.emplace_back(visit_for_value(pNode->children[i]));
+		mResult_value = call(pNode, c, std::move(args));
 	}
 
 	virtual void dispatch(AST_node_if* pNode) override
 	{
 		// If
-		if (mCaster.cast<bool>(visit_for_value(pNode->children[0])))
+		if (test(pNode->children[0]))
 		{
 			pNode->children[1]->visit(this);
 			return;
@@ -321,7 +507,7 @@ private:
 			{
 				std::size_t condition_idx = i * 2 + 2;
 				std::size_t body_idx = i * 2 + 3;
-				if (mCaster.cast<bool>(visit_for_value(pNode->children[condition_idx])))
+				if (test(pNode->children[condition_idx]))
 				{
 					pNode->children[body_idx]->visit(this);
 					return;
@@ -336,18 +522,16 @@ private:
 
 	virtual void dispatch(AST_node_for* pNode) override
 	{
-		symbol_table::scope_push_pop var_scope(mSymbols);
-
 		const bool empty_conditional = pNode->children[1]->is_empty();
+		clear_locals(pNode->invariants);
 		for (
 			pNode->children[0]->visit(this);
-			empty_conditional || mCaster.cast<bool>(visit_for_value(pNode->children[1]));
+			empty_conditional || test(pNode->children[1]);
 			pNode->children[2]->visit(this)
 			)
 		{
-			symbol_table::scope_push_pop loop_scope(mSymbols);
-
 			pNode->children[3]->visit(this);
+			clear_locals(pNode->body_locals);
 
 			// "continue" just causes all scopes to unwind in the loop
 			// and it loops again like nothing happened
@@ -361,15 +545,17 @@ private:
 				break;
 			}
 		}
+		clear_locals(pNode->locals);
+		clear_locals(pNode->invariants);
 	}
 
 	virtual void dispatch(AST_node_while* pNode) override
 	{
-		while (mCaster.cast<bool>(visit_for_value(pNode->children[0])))
+		clear_locals(pNode->invariants);
+		while (test(pNode->children[0]))
 		{
-			symbol_table::scope_push_pop loop_scope(mSymbols);
-
 			pNode->children[1]->visit(this);
+			clear_locals(pNode->body_locals);
 
 			// Loop again like nothing happened
 			mControl_flags[ctrl_continue] = false;
@@ -382,9 +568,60 @@ private:
 				break;
 			}
 		}
+		clear_locals(pNode->invariants);
 	}
 
 	virtual void dispatch(AST_node_function_declaration* pNode) override
+	{
+		callable func = make_function(pNode);
+		func.function = [this, script = func.script](const std::vector<value_type>& pArgs)->value_type
+		{
+			if (script.native)
+			{
+				if (auto result = run_native(script, pArgs.data(), pArgs.size()))
+					return std::move(*result);
+			}
+
+			frame_push_pop frame(*this, mStack.size(), script.declaration->frame_size, &script.captures);
+
+			// The parameters take the first slots
+			for (std::size_t i = 0; i < pArgs.size(); i++)
+				mStack[mBase + i] = { pArgs[i], script.declaration->parameters[i].identifier };
+			return run_body(script.declaration);
+		};
+
+		if (pNode->identifier.empty())
+		{
+			// Return the object for this anonymous function
+			mResult_value = func;
+		}
+		else
+		{
+			// Add the function as its own constant variable
+			declare(pNode->slot, pNode->identifier, const_value(func));
+		}
+	}
+
+	virtual void dispatch(AST_node_return* pNode) override
+	{
+		mResult_value = visit_for_value(pNode->children[0]);
+		mControl_flags[ctrl_return] = true;
+	}
+
+	virtual void dispatch(AST_node_break* pNode) override
+	{
+		mControl_flags[ctrl_break] = true;
+	}
+
+	virtual void dispatch(AST_node_continue* pNode) override
+	{
+		mControl_flags[ctrl_continue] = true;
+	}
+
+private:
+	// Makes the callable of a function declared in a script, without the
+	// function that runs it
+	callable make_function(AST_node_function_declaration* pNode)
 	{
 		callable func;
 
@@ -418,125 +655,1137 @@ private:
 			}
 		}
 
-		func.function = [this, pNode](const std::vector<value_type>& pArgs)->value_type
-		{
-			symbol_table::scope_push_pop scope(mSymbols);
-
-			// Add the parameters to the scope
-			for (std::size_t i = 0; i < pArgs.size(); i++)
-				mSymbols.add(std::string(pNode->parameters[i].identifier), pArgs[i]);
-			
-			// Interpret the functions body nodes
-			value_type retval;
-			try
-			{
-				retval = visit_for_value(pNode->children[0]);
-			}
-			catch (exception::interpretor_error& e)
-			{
-				if (pNode->identifier.empty())
-					e.stack.push_back("Anonymouns function");
-				else
-					e.stack.push_back(std::string(pNode->identifier));
-				throw;
-			}
-			catch (...)
-			{
-				throw;
-			}
+		// The function takes the variables it uses from around it
+		func.script.declaration = pNode;
+		func.script.captures.reserve(pNode->captures.size());
+		for (const auto& i : pNode->captures)
+			func.script.captures.push_back(i.is_capture ? (*mCaptures)[i.index] : capture_local(i.index));
+		if (mJit)
+			func.script.native = &get_jit_function(pNode);
+		return func;
+	}
 
-			mControl_flags.reset();
+	jit_function& get_jit_function(AST_node_function_declaration* pNode)
+	{
+		// The tree could have been run by another interpreter
+		if (pNode->jit >= mJit_functions.size()
+			|| mJit_functions[pNode->jit].declaration != pNode)
+		{
+			pNode->jit = static_cast<std::uint32_t>(mJit_functions.size());
+			mJit_functions.emplace_back(pNode);
+		}
+		return mJit_functions[pNode->jit];
+	}
 
-			return retval;
-		};
+	// Runs a function as native code, compiling it once it is hot. Returns
+	// nothing if it has to be run the normal way.
+	std::optional<value_type> run_native(const script_function& pScript, const value_type* pArgs, std::size_t pCount)
+	{
+		jit_function& native = *pScript.native;
+		if (!native.is_compiled())
+		{
+			if (native.failed || ++native.calls < mJit_threshold)
+				return{};
+			native.failed = !mJit_compiler.compile(native, pArgs, pCount,
+				[this](std::string_view pName) -> const value_type* { return mSymbols.lookup(pName); },
+				[this](std::string_view pName) { return get_type(pName); });
+			if (native.failed)
+				return{};
+		}
 
-		if (pNode->identifier.empty())
+		try
 		{
-			// Return the object for this anonymous function
-			mResult_value = func;
+			return native.run(pArgs, pCount, mJit_caller);
 		}
-		else
+		catch (exception::interpretor_error& e)
 		{
-			// Add the function as its own constant variable
-			mSymbols.add(std::string(pNode->identifier), const_value(func));
+			add_to_stack(e, pScript.declaration);
+			throw;
 		}
 	}
 
-	virtual void dispatch(AST_node_return* pNode) override
+	// Adds the function an error went through to its stack
+	static void add_to_stack(exception::interpretor_error& e, const AST_node_function_declaration* pNode)
 	{
-		mResult_value = visit_for_value(pNode->children[0]);
-		mControl_flags[ctrl_return] = true;
+		if (pNode->identifier.empty())
+			e.stack.push_back("Anonymouns function");
+		else
+			e.stack.push_back(std::string(pNode->identifier));
 	}
 
-	virtual void dispatch(AST_node_break* pNode) override
+	// Calls pCallable with the member of the scalar that has the type
+	template <typename T>
+	static auto visit_scalar(known_type pType, const scalar& pScalar, T&& pCallable)
 	{
-		mControl_flags[ctrl_break] = true;
+		switch (pType)
+		{
+		case known_type::boolean:
+			return pCallable(pScalar.b);
+		case known_type::integer:
+			return pCallable(pScalar.i);
+		default:
+			return pCallable(pScalar.f);
+		}
 	}
 
-	virtual void dispatch(AST_node_continue* pNode) override
+	template <typename T>
+	static void set_scalar(scalar& pScalar, T pValue)
 	{
-		mControl_flags[ctrl_continue] = true;
+		if constexpr (std::is_same_v<T, bool>)
+			pScalar.b = pValue;
+		else if constexpr (std::is_same_v<T, int>)
+			pScalar.i = pValue;
+		else
+			pScalar.f = pValue;
 	}
 
-private:
-	callable_overloader find_functions(const std::string& pName)
+	// The operators on unboxed numbers of the types inferred for them
+
+	static void apply_unary(token_type pOp, known_type pType, const scalar& pU, scalar& pResult)
 	{
-		auto matches = mSymbols.get_all_matches(pName);
-		if (matches.empty())
-			throw exception::interpretor_error("No function with name \"" + pName + "\"");
+		visit_scalar(pType, pU, [&](auto pValue)
+		{
+			set_scalar(pResult, typed_unary(pOp, pValue));
+		});
+	}
 
-		callable_overloader overloader;
-		for (auto i : matches)
+	static void apply_binary(token_type pOp, known_type pL_type, const scalar& pL,
+		known_type pR_type, const scalar& pR, scalar& pResult)
+	{
+		visit_scalar(pL_type, pL, [&](auto pL_value)
 		{
-			if (i->get<const callable>())
+			visit_scalar(pR_type, pR, [&](auto pR_value)
 			{
-				overloader.add(*i);
-			}
-			else if (auto other = i->get<const callable_overloader>())
+				if (is_comparison(pOp))
+					pResult.b = typed_comparison(pOp, pL_value, pR_value);
+				else
+					set_scalar(pResult, typed_arithmetic(pOp, pL_value, pR_value));
+			});
+		});
+	}
+
+	// The target has to hold a number of its type
+	static void apply_assignment(token_type pOp, value_type& pTarget, known_type pType,
+		known_type pValue_type, const scalar& pValue)
+	{
+		void* ptr = pTarget.get_data().mPtr;
+		visit_scalar(pValue_type, pValue, [&](auto pR)
+		{
+			switch (pType)
 			{
-				overloader.add(*other);
+			case known_type::boolean:
+				typed_assignment(pOp, *static_cast<bool*>(ptr), pR);
+				break;
+			case known_type::integer:
+				typed_assignment(pOp, *static_cast<int*>(ptr), pR);
+				break;
+			default:
+				typed_assignment(pOp, *static_cast<float*>(ptr), pR);
+				break;
 			}
-		}
-		return overloader;
+		});
 	}
 
-	void cast_arguments(arg_list& pArgs, const std::vector<type_info>& pTypes) const
+	// Quickening. An operator the type_inferrer couldn't type keeps the
+	// number types of the operands it is run with in its operand_feedback.
+	// While its operands keep having those types it is run on them directly
+	// instead of through the visitors of arithmetic.hpp.
+
+	// The type an operand can be quickened for, unknown if there is none
+	static known_type quickened_type(const value_type& pValue)
 	{
-		for (std::size_t i = 0; i < pTypes.size(); ++i)
-			pArgs[i] = mCaster.cast(pTypes[i], pArgs[i]);
+		const type_info& type = pValue.get_type_info();
+		if (type.bare_equal(typeid(int)))
+			return known_type::integer;
+		if (type.bare_equal(typeid(float)))
+			return known_type::floating;
+		return known_type::unknown;
 	}
 
-	value_type call_function(const std::string& pName, arg_list pArgs)
+	// The right type of a unary operator is its only operand
+	static void observe(operand_feedback& pFeedback, known_type pLeft, known_type pRight)
 	{
-		callable_overloader overloader = find_functions(pName);
-		const callable& c = overloader.find(pArgs, mCaster);
-		cast_arguments(pArgs, c.parameter_types);
-		return c.function(pArgs);
+		if (pFeedback.generic)
+			return;
+		if (pLeft == known_type::unknown || pRight == known_type::unknown
+			|| (pFeedback.left != known_type::unknown && (pFeedback.left != pLeft || pFeedback.right != pRight)))
+		{
+			pFeedback.generic = true;
+			return;
+		}
+		pFeedback.left = pLeft;
+		pFeedback.right = pRight;
 	}
 
-	value_type copy_value(const value_type& pVal)
+	// Boxes the result of an operator. An operand that is a temporary number
+	// of the same type is used for it so nothing is allocated.
+	static value_type box_result(value_type& pOperand, known_type pType, const scalar& pResult)
 	{
-		if (pVal.is_arithmetic())
+		if (!pOperand.is_unique_number() || pOperand.is_const() || quickened_type(pOperand) != pType)
+			return box(pType, pResult);
+		void* ptr = pOperand.get_data().mPtr;
+		visit_scalar(pType, pResult, [ptr](auto pValue)
 		{
-			auto visitor = [](const auto& pVal) -> value_type
-			{
-				return pVal;
-			};
-			return detail::visit_arithmetic(pVal, visitor);
-		}
-		else
+			*static_cast<decltype(pValue)*>(ptr) = pValue;
+		});
+		return std::move(pOperand);
+	}
+
+	// Returns false if the operand doesn't have the type the operator was
+	// quickened for. It is run the generic way then.
+	bool quick_unary(const AST_node_unary_op* pNode, value_type& pU, value_type& pResult) const
+	{
+		const known_type type = pNode->feedback.left;
+		scalar u;
+		if (!mQuickening || !pNode->feedback.is_quickened() || !unbox(pU, type, u))
+			return false;
+
+		if (pNode->type == token_type::increment || pNode->type == token_type::decrement)
 		{
-			return call_function("copy", { pVal });
+			// A constant is left to fail the normal way
+			if (pU.is_const())
+				return false;
+			scalar one;
+			one.i = 1;
+			apply_assignment(pNode->type == token_type::increment ? token_type::add_assign : token_type::sub_assign,
+				pU, type, known_type::integer, one);
+			pResult = pU;
+			return true;
 		}
+
+		scalar result;
+		apply_unary(pNode->type, type, u, result);
+		pResult = box_result(pU, type, result);
+		return true;
 	}
 
-	const type_info* get_type(const std::string_view& pStr) const
+	bool quick_binary(const AST_node_binary_op* pNode, value_type& pL, value_type& pR, value_type& pResult) const
 	{
-		for (auto& i : mTypes)
-			if (i.first == pStr)
-				return &i.second;
-		return nullptr;
-	}
+		const operand_feedback& feedback = pNode->feedback;
+		scalar l, r;
+		if (!mQuickening || !feedback.is_quickened()
+			|| !unbox(pL, feedback.left, l) || !unbox(pR, feedback.right, r))
+			return false;
+
+		if (is_assignment(pNode->type))
+		{
+			if (pL.is_const())
+				return false;
+			apply_assignment(pNode->type, pL, feedback.left, feedback.right, r);
+			pResult = pL;
+			return true;
+		}
+
+		scalar result;
+		apply_binary(pNode->type, feedback.left, l, feedback.right, r, result);
+		pResult = box_result(pL, is_comparison(pNode->type) ? known_type::boolean : feedback.left, result);
+		return true;
+	}
+
+	// Runs an operator the generic way and keeps the types of its operands
+	value_type generic_unary(AST_node_unary_op* pNode, const value_type& pU)
+	{
+		value_type result = arithmetic_unary_operation(pNode->type, pU);
+		const known_type type = quickened_type(pU);
+		observe(pNode->feedback, type, type);
+		return result;
+	}
+
+	value_type generic_binary(AST_node_binary_op* pNode, const value_type& pL, const value_type& pR)
+	{
+		if (!pL.is_arithmetic() || !pR.is_arithmetic())
+		{
+			pNode->feedback.generic = true;
+			return call_operator(pNode->type, pL, pR);
+		}
+		value_type result = arithmetic_binary_operation(pNode->type, pL, pR);
+		observe(pNode->feedback, quickened_type(pL), quickened_type(pR));
+		return result;
+	}
+
+	// Runs the expressions the type_inferrer typed on unboxed numbers
+	class typed_evaluator :
+		public AST_visitor
+	{
+	public:
+		typed_evaluator(interpreter& pInterpreter) :
+			mInterpreter(pInterpreter)
+		{}
+
+		// Returns false if the node wasn't typed or a name doesn't hold the
+		// type inferred for it, so the node can be run the normal way.
+		// Typed expressions don't change anything, so that is always safe.
+		bool evaluate(AST_node* pNode, scalar& pResult)
+		{
+			if (pNode->inferred == known_type::unknown)
+				return false;
+			mValid = false;
+			pNode->visit(this);
+			pResult = mResult;
+			return mValid;
+		}
+
+	private:
+		virtual void dispatch(AST_node_constant* pNode) override
+		{
+			mValid = unbox(*pNode->value, pNode->inferred, mResult);
+		}
+
+		virtual void dispatch(AST_node_identifier* pNode) override
+		{
+			const value_type* value = mInterpreter.find_value(pNode);
+			mValid = value && unbox(*value, pNode->inferred, mResult);
+		}
+
+		virtual void dispatch(AST_node_unary_op* pNode) override
+		{
+			scalar u;
+			if (!evaluate(pNode->children[0], u))
+				return;
+			apply_unary(pNode->type, pNode->inferred, u, mResult);
+			mValid = true;
+		}
+
+		virtual void dispatch(AST_node_binary_op* pNode) override
+		{
+			scalar l, r;
+			if (is_assignment(pNode->type)
+				|| !evaluate(pNode->children[0], l)
+				|| !evaluate(pNode->children[1], r))
+				return;
+			apply_binary(pNode->type, pNode->children[0]->inferred, l, pNode->children[1]->inferred, r, mResult);
+			mValid = true;
+		}
+
+	private:
+		interpreter& mInterpreter;
+		scalar mResult{};
+		bool mValid{ false };
+	};
+
+	bool evaluate_typed(AST_node* pNode)
+	{
+		scalar value;
+		if (!mTyped.evaluate(pNode, value))
+			return false;
+		mResult_value = box(pNode->inferred, value);
+		return true;
+	}
+
+	// Assigns to a local or global in place without boxing the value
+	bool assign_typed(AST_node_binary_op* pNode)
+	{
+		value_type* target = find_value(as_identifier(pNode->children[0]));
+		scalar current, value;
+		// A constant is left to fail the normal way
+		if (!target || target->is_const()
+			|| !unbox(*target, pNode->inferred, current)
+			|| !mTyped.evaluate(pNode->children[1], value))
+			return false;
+
+		apply_assignment(pNode->type, *target, pNode->inferred, pNode->children[1]->inferred, value);
+		mResult_value = *target;
+		return true;
+	}
+
+	bool is_invariant(const AST_node* pNode) const
+	{
+		return pNode->invariant_slot != unresolved_slot && pNode != mEvaluating;
+	}
+
+	// Evaluates an expression the loop_hoister found to be invariant the
+	// first time it is reached in a run of its loop
+	void evaluate_invariant(AST_node* pNode)
+	{
+		if (auto& value = mStack[mBase + pNode->invariant_slot].value)
+		{
+			mResult_value = *value;
+			return;
+		}
+		AST_node* evaluating = std::exchange(mEvaluating, pNode);
+		try
+		{
+			pNode->visit(this);
+		}
+		catch (...)
+		{
+			mEvaluating = evaluating;
+			throw;
+		}
+		mEvaluating = evaluating;
+		// The stack could have grown
+		mStack[mBase + pNode->invariant_slot].value = mResult_value;
+	}
+
+	// Runs a condition and casts it to bool
+	bool test(AST_node* pNode)
+	{
+		scalar value;
+		if (mTyped.evaluate(pNode, value))
+			return visit_scalar(pNode->inferred, value, [](auto pValue) { return static_cast<bool>(pValue); });
+		return mCaster.cast<bool>(visit_for_value(pNode));
+	}
+
+	// Moves a local of the current frame to a cell it shares with the
+	// functions that capture it
+	captured_value capture_local(std::uint32_t pSlot)
+	{
+		frame_slot& slot = mStack[mBase + pSlot];
+		if (!slot.cell)
+		{
+			slot.cell = std::make_shared<std::optional<value_type>>(std::move(slot.value));
+			slot.value.reset();
+
+			// Forget the cells that are gone before the list grows
+			if (mCells.size() == mCells.capacity())
+				mCells.erase(std::remove_if(mCells.begin(), mCells.end(),
+					[](const auto& pCell) { return pCell.expired(); }), mCells.end());
+			mCells.push_back(slot.cell);
+		}
+		return slot.cell;
+	}
+
+	// Runs the body of a function in its frame
+	value_type run_body(AST_node_function_declaration* pNode)
+	{
+		// Interpret the functions body nodes
+		value_type retval;
+		try
+		{
+			retval = visit_for_value(pNode->children[0]);
+		}
+		catch (exception::interpretor_error& e)
+		{
+			add_to_stack(e, pNode);
+			throw;
+		}
+		catch (...)
+		{
+			throw;
+		}
+
+		mControl_flags.reset();
+
+		return retval;
+	}
+
+	// Does what calling the function does, but the arguments are put
+	// straight into the slots of its frame
+	void call_inlined(AST_node_function_call* pNode, const callable& pFunc)
+	{
+		const AST_node_function_declaration* declaration = pFunc.script.declaration;
+		const std::size_t base = mStack.size();
+		mStack.resize(base + declaration->frame_size);
+		try
+		{
+			for (std::size_t i = 0; i + 1 < pNode->children.size(); i++)
+			{
+				value_type arg = visit_for_value(pNode->children[i + 1]);
+				const type_info& type = pFunc.parameter_types[i];
+				if (declaration->parameters[i].has_type)
+				{
+					if (!mCaster.can_cast(type, arg.get_type_info()))
+						throw exception::interpretor_error("Cannot find function");
+					arg = mCaster.cast(type, arg);
+				}
+				mStack[base + i] = { std::move(arg), declaration->parameters[i].identifier };
+			}
+		}
+		catch (...)
+		{
+			mStack.resize(base);
+			throw;
+		}
+
+		if (pFunc.script.native)
+		{
+			arg_list args;
+			args.reserve(pNode->children.size() - 1);
+			for (std::size_t i = 0; i + 1 < pNode->children.size(); i++)
+				args.push_back(*mStack[base + i].value);
+			std::optional<value_type> result;
+			try
+			{
+				result = run_native(pFunc.script, args.data(), args.size());
+			}
+			catch (...)
+			{
+				mStack.resize(base);
+				throw;
+			}
+			if (result)
+			{
+				mStack.resize(base);
+				mResult_value = std::move(*result);
+				return;
+			}
+		}
+
+		frame_push_pop frame(*this, base, declaration->frame_size, &pFunc.script.captures);
+		mResult_value = run_body(pNode->inlined);
+	}
+
+	// RAII-based reserving of the registers of bytecode being run
+	class register_frame
+	{
+	public:
+		register_frame(interpreter& pInterpreter, const bytecode_function& pCode) :
+			mInterpreter(pInterpreter),
+			mRegisters(pInterpreter.mRegister_top),
+			mNumbers(pInterpreter.mNumber_top)
+		{
+			mInterpreter.mRegister_top += pCode.registers;
+			mInterpreter.mNumber_top += pCode.numbers;
+			if (mInterpreter.mRegisters.size() < mInterpreter.mRegister_top)
+				mInterpreter.mRegisters.resize(mInterpreter.mRegister_top);
+			if (mInterpreter.mNumbers.size() < mInterpreter.mNumber_top)
+				mInterpreter.mNumbers.resize(mInterpreter.mNumber_top);
+		}
+
+		~register_frame()
+		{
+			// Registers are emptied when they are read, unless an error
+			// stopped the code first
+			for (std::size_t i = mRegisters; i < mInterpreter.mRegister_top; i++)
+				value_type discarded = std::move(mInterpreter.mRegisters[i]);
+			mInterpreter.mRegister_top = mRegisters;
+			mInterpreter.mNumber_top = mNumbers;
+		}
+
+		std::size_t registers() const
+		{
+			return mRegisters;
+		}
+
+		std::size_t numbers() const
+		{
+			return mNumbers;
+		}
+
+	private:
+		interpreter& mInterpreter;
+		std::size_t mRegisters;
+		std::size_t mNumbers;
+	};
+
+	// Runs bytecode in the current frame
+	value_type execute(const bytecode_function& pCode)
+	{
+		const register_frame frame(*this, pCode);
+		const std::size_t registers = frame.registers();
+		const std::size_t numbers = frame.numbers();
+		// The registers can move when a function is called, so they are
+		// always found from the start of the stack
+		auto r = [&](std::uint32_t pIndex) -> value_type& { return mRegisters[registers + pIndex]; };
+		auto n = [&](std::uint32_t pIndex) -> scalar& { return mNumbers[numbers + pIndex]; };
+		// Keeps the value an instruction gives, if it is wanted
+		auto give = [&](std::uint32_t pIndex, value_type pValue)
+		{
+			if (pIndex != no_register)
+				r(pIndex) = std::move(pValue);
+		};
+
+		const instruction* const code = pCode.code.data();
+		const instruction* pc = code;
+		try
+		{
+#ifdef WOLFSCRIPT_THREADED_DISPATCH
+			static const void* const labels[] = {
+				&&op_constant, &&op_void_value, &&op_load, &&op_unary, &&op_quick_unary,
+				&&op_binary, &&op_quick_binary, &&op_member, &&op_call, &&op_function, &&op_declare, &&op_number_declare,
+				&&op_number_constant, &&op_number_load, &&op_number_unary, &&op_number_binary,
+				&&op_number_assign, &&op_box, &&op_jump, &&op_jump_if_false,
+				&&op_number_jump_if_false, &&op_clear_locals, &&op_invariant,
+				&&op_store_invariant, &&op_return_value, &&op_return_void };
+			static_assert(sizeof(labels) / sizeof(labels[0]) == static_cast<std::size_t>(opcode::count),
+				"Every opcode needs a label");
+			// A computed goto doesn't run destructors so every handler
+			// closes its scope before dispatching the next instruction
+#define WOLFSCRIPT_OP(pName) op_##pName:
+#define WOLFSCRIPT_NEXT goto *labels[static_cast<std::size_t>(pc->op)]
+			WOLFSCRIPT_NEXT;
+#else
+#define WOLFSCRIPT_OP(pName) case opcode::pName:
+#define WOLFSCRIPT_NEXT continue
+			for (;;) switch (pc->op)
+			{
+#endif
+			WOLFSCRIPT_OP(constant)
+			{
+				// Constants are prebuilt by the parser so this doesn't allocate
+				const value_type* value = static_cast<const AST_node_constant*>(pc->node)->value;
+				if (!value || value->is_void())
+					throw exception::interpretor_error("Unsupported constant type");
+				give(pc->a, *value);
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(void_value)
+			{
+				r(pc->a) = value_type{};
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(load)
+			{
+				const value_type* value = find_value(static_cast<const AST_node_identifier*>(pc->node));
+				if (!value)
+					throw exception::interpretor_error("Variable does not exist");
+				give(pc->a, *value);
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(unary)
+			{
+				AST_node_unary_op* node = static_cast<AST_node_unary_op*>(pc->node);
+				const value_type value = std::move(r(pc->b));
+				give(pc->a, generic_unary(node, value));
+				if (mQuickening && node->feedback.is_quickened())
+					pc->op = opcode::quick_unary;
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(quick_unary)
+			{
+				AST_node_unary_op* node = static_cast<AST_node_unary_op*>(pc->node);
+				value_type value = std::move(r(pc->b));
+				value_type result;
+				if (quick_unary(node, value, result))
+				{
+					give(pc->a, std::move(result));
+				}
+				else
+				{
+					pc->op = opcode::unary;
+					give(pc->a, generic_unary(node, value));
+				}
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(binary)
+			{
+				AST_node_binary_op* node = static_cast<AST_node_binary_op*>(pc->node);
+				const value_type l = std::move(r(pc->b));
+				const value_type r_value = std::move(r(pc->c));
+				give(pc->a, generic_binary(node, l, r_value));
+				if (mQuickening && node->feedback.is_quickened())
+					pc->op = opcode::quick_binary;
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(quick_binary)
+			{
+				AST_node_binary_op* node = static_cast<AST_node_binary_op*>(pc->node);
+				value_type l = std::move(r(pc->b));
+				value_type r_value = std::move(r(pc->c));
+				value_type result;
+				if (quick_binary(node, l, r_value, result))
+				{
+					give(pc->a, std::move(result));
+				}
+				else
+				{
+					pc->op = opcode::binary;
+					give(pc->a, generic_binary(node, l, r_value));
+				}
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(member)
+			{
+				const value_type object = std::move(r(pc->b));
+				// Call function to access the member
+				give(pc->a, call_function(std::string(static_cast<const AST_node_member_accessor*>(pc->node)->identifier), { object }));
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(call)
+			{
+				const value_type callee = std::move(r(pc->b));
+				AST_node_function_call* node = static_cast<AST_node_function_call*>(pc->node);
+				const callable* func = node->inlined ? callee.get<const callable>() : nullptr;
+				if (func && func->script.declaration == node->inlined && func->script.code)
+				{
+					give(pc->a, run_inlined(*func, registers + pc->b + 1, pc->c));
+				}
+				else
+				{
+					arg_list args;
+					args.reserve(pc->c);
+					for (std::uint32_t i = 1; i <= pc->c; i++)
+						args.push_back(std::move(r(pc->b + i)));
+					give(pc->a, call(node, callee, std::move(args)));
+				}
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(function)
+			{
+				give(pc->a, declare_compiled(static_cast<AST_node_function_declaration*>(pc->node), pCode.functions[pc->b]));
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(declare)
+			{
+				const value_type value = std::move(r(pc->b));
+				declare_local(static_cast<AST_node_variable*>(pc->node), value);
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(number_declare)
+			{
+				declare_number(static_cast<AST_node_variable*>(pc->node), pc->left, n(pc->b));
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(number_constant)
+			{
+				std::memcpy(&n(pc->a), &pc->b, sizeof(scalar));
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(number_load)
+			{
+				const value_type* value = find_value(static_cast<const AST_node_identifier*>(pc->node));
+				if (value && unbox(*value, pc->left, n(pc->a)))
+					++pc;
+				else
+					pc = code + pc->c;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(number_unary)
+			{
+				apply_unary(pc->token, pc->left, n(pc->b), n(pc->a));
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(number_binary)
+			{
+				apply_binary(pc->token, pc->left, n(pc->b), pc->right, n(pc->c), n(pc->a));
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(number_assign)
+			{
+				value_type* target = find_value(static_cast<const AST_node_identifier*>(pc->node));
+				scalar current;
+				// A constant is left to fail the normal way
+				if (!target || target->is_const() || !unbox(*target, pc->left, current))
+				{
+					pc = code + pc->c;
+				}
+				else
+				{
+					apply_assignment(pc->token, *target, pc->left, pc->right, n(pc->b));
+					give(pc->a, *target);
+					++pc;
+				}
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(box)
+			{
+				r(pc->a) = box(pc->left, n(pc->b));
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(jump)
+			{
+				pc = code + pc->c;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(jump_if_false)
+			{
+				const value_type value = std::move(r(pc->b));
+				pc = mCaster.cast<bool>(value) ? pc + 1 : code + pc->c;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(number_jump_if_false)
+			{
+				const bool value = visit_scalar(pc->left, n(pc->b), [](auto pValue) { return static_cast<bool>(pValue); });
+				pc = value ? pc + 1 : code + pc->c;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(clear_locals)
+			{
+				clear_locals({ pc->a, pc->b });
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(invariant)
+			{
+				if (auto& value = mStack[mBase + pc->b].value)
+				{
+					give(pc->a, *value);
+					pc = code + pc->c;
+				}
+				else
+				{
+					++pc;
+				}
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(store_invariant)
+			{
+				mStack[mBase + pc->a].value = r(pc->b);
+				++pc;
+			}
+			WOLFSCRIPT_NEXT;
+			WOLFSCRIPT_OP(return_value)
+			{
+				return std::move(r(pc->b));
+			}
+			WOLFSCRIPT_OP(return_void)
+			{
+				return{};
+			}
+#ifndef WOLFSCRIPT_THREADED_DISPATCH
+			case opcode::count:
+				break;
+			}
+			return{};
+#endif
+#undef WOLFSCRIPT_OP
+#undef WOLFSCRIPT_NEXT
+		}
+		catch (exception::interpretor_error& e)
+		{
+			// Report where the error occurred if not already.
+			// The position is resolved from this by the caller.
+			if (e.offset == unknown_offset)
+				e.offset = pCode.offsets[pc - code];
+			throw;
+		}
+	}
+
+	// Runs the bytecode of a function in its frame
+	value_type run_code(const script_function& pScript)
+	{
+		try
+		{
+			return execute(*pScript.code);
+		}
+		catch (exception::interpretor_error& e)
+		{
+			add_to_stack(e, pScript.declaration);
+			throw;
+		}
+	}
+
+	// Runs a compiled function with the arguments in the registers from
+	// pArgs on, which are put straight into the slots of its frame
+	value_type run_inlined(const callable& pFunc, std::size_t pArgs, std::uint32_t pCount)
+	{
+		const AST_node_function_declaration* declaration = pFunc.script.declaration;
+		for (std::uint32_t i = 0; i < pCount; i++)
+		{
+			value_type& arg = mRegisters[pArgs + i];
+			const type_info& type = pFunc.parameter_types[i];
+			if (declaration->parameters[i].has_type)
+			{
+				if (!mCaster.can_cast(type, arg.get_type_info()))
+					throw exception::interpretor_error("Cannot find function");
+				arg = mCaster.cast(type, arg);
+			}
+		}
+		if (pFunc.script.native)
+		{
+			if (auto result = run_native(pFunc.script, &mRegisters[pArgs], pCount))
+				return std::move(*result);
+		}
+
+		frame_push_pop frame(*this, mStack.size(), declaration->frame_size, &pFunc.script.captures);
+		for (std::uint32_t i = 0; i < pCount; i++)
+			mStack[mBase + i] = { std::move(mRegisters[pArgs + i]), declaration->parameters[i].identifier };
+		return run_code(pFunc.script);
+	}
+
+	// Declares a function that runs its bytecode. Returns the function if
+	// it is anonymous.
+	value_type declare_compiled(AST_node_function_declaration* pNode, std::shared_ptr<const bytecode_function> pCode)
+	{
+		callable func = make_function(pNode);
+		func.script.code = std::move(pCode);
+		func.function = [this, script = func.script](const std::vector<value_type>& pArgs)->value_type
+		{
+			if (script.native)
+			{
+				if (auto result = run_native(script, pArgs.data(), pArgs.size()))
+					return std::move(*result);
+			}
+
+			frame_push_pop frame(*this, mStack.size(), script.declaration->frame_size, &script.captures);
+
+			// The parameters take the first slots
+			for (std::size_t i = 0; i < pArgs.size(); i++)
+				mStack[mBase + i] = { pArgs[i], script.declaration->parameters[i].identifier };
+			return run_code(script);
+		};
+
+		if (pNode->identifier.empty())
+			return func;
+		declare(pNode->slot, pNode->identifier, const_value(func));
+		return{};
+	}
+
+	void declare(std::uint32_t pSlot, std::string_view pName, value_type pValue)
+	{
+		frame_slot& slot = mStack[mBase + pSlot];
+		auto& value = slot.get();
+		if (value)
+		{
+			symbol_table::redeclare(*value, pValue);
+		}
+		else
+		{
+			value = std::move(pValue);
+			slot.name = pName;
+		}
+	}
+
+	// Declares a local that holds a number. If it doesn't escape, the
+	// value it had the last time its scope ended is used again.
+	void declare_number(AST_node_variable* pNode, known_type pType, const scalar& pNumber)
+	{
+		frame_slot& slot = mStack[mBase + pNode->slot];
+		slot.recycle = !pNode->escapes;
+		if (!pNode->escapes && !slot.value && slot.spare && slot.spare->is_unique_number() && !slot.spare->is_const())
+		{
+			value_type& spare = *slot.spare;
+			const bool reused = visit_scalar(pType, pNumber, [&](auto pValue)
+			{
+				using type = decltype(pValue);
+				if (!spare.get_type_info().bare_equal(typeid(type)))
+					return false;
+				*static_cast<type*>(spare.get_data().mPtr) = pValue;
+				return true;
+			});
+			if (reused)
+			{
+				slot.value = std::move(spare);
+				slot.spare.reset();
+				slot.name = pNode->identifier;
+				return;
+			}
+		}
+		declare(pNode->slot, pNode->identifier, box(pType, pNumber));
+	}
+
+	// Declares a local with a copy of the value
+	void declare_local(AST_node_variable* pNode, const value_type& pValue)
+	{
+		const known_type type = detail::to_known_type(pValue.get_type_info());
+		scalar number;
+		if (!pNode->escapes && unbox(pValue, type, number))
+		{
+			declare_number(pNode, type, number);
+			return;
+		}
+		mStack[mBase + pNode->slot].recycle = !pNode->escapes;
+		declare(pNode->slot, pNode->identifier, copy_value(pValue));
+	}
+
+	void clear_locals(const slot_range& pRange)
+	{
+		for (std::uint32_t i = pRange.begin; i < pRange.end; i++)
+		{
+			frame_slot& slot = mStack[mBase + i];
+			if (slot.recycle && slot.value)
+				slot.spare = std::move(slot.value);
+			// The functions that captured the local keep its cell
+			slot.value.reset();
+			slot.cell.reset();
+		}
+	}
+
+	// The stack only has to be searched for names declared by a script
+	bool is_local_name(std::string_view pName) const
+	{
+		return mLocal_names.find(pName) != mLocal_names.end();
+	}
+
+	// Finds what a name refers to where it is used, or returns nullptr
+	value_type* find_value(const AST_node_identifier* pNode)
+	{
+		if (pNode->slot != unresolved_slot)
+		{
+			if (auto value = find_local(pNode))
+				return value;
+		}
+		else if (auto value = mSymbols.lookup(pNode->identifier))
+		{
+			return value;
+		}
+		return lookup(pNode->identifier);
+	}
+
+	// Returns nullptr if the local isn't declared yet
+	value_type* find_local(const AST_node_identifier* pNode)
+	{
+		auto& value = pNode->depth == 0 ? mStack[mBase + pNode->slot].get() : *(*mCaptures)[pNode->capture];
+		return value ? &*value : nullptr;
+	}
+
+	// Finds the innermost local on the stack or the global with this name.
+	// This is the last resort for a name that isn't found where it was
+	// resolved to, so the locals of the callers can still be seen.
+	value_type* lookup(std::string_view pName)
+	{
+		if (!is_local_name(pName))
+			return mSymbols.lookup(pName);
+		for (std::size_t i = mStack.size(); i > 0; i--)
+		{
+			auto& value = mStack[i - 1].get();
+			if (value && mStack[i - 1].name == pName)
+				return &*value;
+		}
+		return mSymbols.lookup(pName);
+	}
+
+	callable_overloader find_functions(const std::string& pName)
+	{
+		std::vector<value_type*> matches;
+		for (std::size_t i = is_local_name(pName) ? mStack.size() : 0; i > 0; i--)
+		{
+			auto& value = mStack[i - 1].get();
+			if (value && mStack[i - 1].name == pName)
+				matches.push_back(&*value);
+		}
+		for (auto i : mSymbols.get_all_matches(pName))
+			matches.push_back(i);
+		if (matches.empty())
+			throw exception::interpretor_error("No function with name \"" + pName + "\"");
+
+		callable_overloader overloader;
+		for (auto i : matches)
+		{
+			if (i->get<const callable>())
+			{
+				overloader.add(*i);
+			}
+			else if (auto other = i->get<const callable_overloader>())
+			{
+				overloader.add(*other);
+			}
+		}
+		return overloader;
+	}
+
+	void cast_arguments(arg_list& pArgs, const std::vector<type_info>& pTypes) const
+	{
+		for (std::size_t i = 0; i < pTypes.size(); ++i)
+			pArgs[i] = mCaster.cast(pTypes[i], pArgs[i]);
+	}
+
+	// Finds the function or the overload of an overloader that fits the
+	// arguments
+	const callable& find_callable(const value_type& pCallee, const arg_list& pArgs) const
+	{
+		std::vector<type_info> arg_types;
+		arg_types.reserve(pArgs.size());
+		for (const auto& i : pArgs)
+			arg_types.push_back(i.get_type_info());
+
+		const callable* func = nullptr;
+		if (auto overloader = pCallee.get<const callable_overloader>())
+		{
+			func = &overloader->find(arg_types, mCaster);
+		}
+		else if (func = pCallee.get<const callable>())
+		{
+			if (!func->match(arg_types, mCaster))
+				throw exception::interpretor_error("Cannot find function");
+		}
+		else
+		{
+			throw exception::interpretor_error("Not a function");
+		}
+		return *func;
+	}
+
+	value_type call(const value_type& pCallee, arg_list pArgs)
+	{
+		const callable& func = find_callable(pCallee, pArgs);
+		cast_arguments(pArgs, func.parameter_types);
+		return func.function(pArgs);
+	}
+
+	// Calls a function from a call in the script, through the inline cache
+	// of the call
+	value_type call(AST_node_function_call* pSite, const value_type& pCallee, arg_list pArgs)
+	{
+		if (!mCall_caching)
+			return call(pCallee, std::move(pArgs));
+
+		call_cache& cache = get_call_cache(pSite);
+		if (const call_cache::entry* entry = cache.find(pCallee, pArgs))
+			return entry->call(pArgs);
+		if (cache.is_megamorphic())
+			return call(pCallee, std::move(pArgs));
+
+		const callable& func = find_callable(pCallee, pArgs);
+		if (const call_cache::entry* entry = cache.add(pCallee, pArgs, func, mCaster))
+			return entry->call(pArgs);
+		cast_arguments(pArgs, func.parameter_types);
+		return func.function(pArgs);
+	}
+
+	call_cache& get_call_cache(AST_node_function_call* pSite)
+	{
+		// The tree could have been run by another interpreter
+		if (pSite->call_cache >= mCall_caches.size()
+			|| mCall_caches[pSite->call_cache].get_site() != pSite)
+		{
+			pSite->call_cache = static_cast<std::uint32_t>(mCall_caches.size());
+			mCall_caches.emplace_back(pSite);
+		}
+		return mCall_caches[pSite->call_cache];
+	}
+
+	// Calls the function of an operator on values that aren't numbers
+	value_type call_operator(token_type pOp, const value_type& pL, const value_type& pR)
+	{
+		const char* name = object_behavior::from_token_type(pOp);
+		// The functions a script declares for an operator are only found
+		// the normal way
+		if (name && !is_local_name(name))
+		{
+			if (auto entry = mOperators.find(pOp, pL.get_type_info(), pR.get_type_info(), mCaster))
+				return entry->call(pL, pR);
+		}
+		return call_function(name, { pL, pR });
+	}
+
+	value_type call_function(const std::string& pName, arg_list pArgs)
+	{
+		callable_overloader overloader = find_functions(pName);
+		const callable& c = overloader.find(pArgs, mCaster);
+		cast_arguments(pArgs, c.parameter_types);
+		return c.function(pArgs);
+	}
+
+	value_type copy_value(const value_type& pVal)
+	{
+		if (pVal.is_arithmetic())
+		{
+			auto visitor = [](const auto& pVal) -> value_type
+			{
+				return pVal;
+			};
+			return detail::visit_arithmetic(pVal, visitor);
+		}
+		else
+		{
+			return call_function("copy", { pVal });
+		}
+	}
+
+	const type_info* get_type(const std::string_view& pStr) const
+	{
+		for (auto& i : mTypes)
+			if (i.first == pStr)
+				return &i.second;
+		return nullptr;
+	}
 
 	const std::string* get_type(const type_info& pType) const
 	{
@@ -561,7 +1810,55 @@ private:
 	string_factory mString_factory;
 	value_type mResult_value;
 	cast_list mCaster;
+	// Only holds the globals added by the application
 	symbol_table mSymbols;
+
+	resolver mResolver;
+	constant_folder mFolder;
+	bool mConstant_folding{ true };
+	function_inliner mInliner;
+	std::size_t mInline_size{ 32 };
+	type_inferrer mInferrer;
+	loop_hoister mHoister;
+	escape_analyzer mEscapes;
+	bool mLoop_hoisting{ true };
+	// The invariant expression being evaluated the normal way
+	AST_node* mEvaluating{ nullptr };
+	typed_evaluator mTyped{ *this };
+	bool mQuickening{ true };
+	// The inline caches of the calls. A deque so a cache stays where it is
+	// while a call made from it adds others.
+	std::deque<call_cache> mCall_caches;
+	bool mCall_caching{ true };
+	operator_table mOperators{ [this](std::string_view pName) -> const value_type* { return mSymbols.lookup(pName); } };
+	bytecode_compiler mCompiler;
+	bool mBytecode{ true };
+	// The script functions that can be compiled to native code. A deque so
+	// the script_functions can keep pointers to them.
+	std::deque<jit_function> mJit_functions;
+	jit_compiler mJit_compiler;
+	jit_caller mJit_caller{ [this](AST_node_function_call* pSite, const value_type& pCallee, arg_list pArgs)
+	{
+		return call(pSite, pCallee, std::move(pArgs));
+	} };
+	bool mJit{ false };
+	std::size_t mJit_threshold{ 10 };
+	// The registers of the bytecode being run, one function after another
+	std::vector<value_type> mRegisters;
+	std::vector<scalar> mNumbers;
+	// Where the registers of the next function start
+	std::size_t mRegister_top{ 0 };
+	std::size_t mNumber_top{ 0 };
+	// The slots of the functions being run, one frame after another
+	std::vector<frame_slot> mStack;
+	// Where the slots of the current function start
+	std::size_t mBase{ 0 };
+	// What the current function captured
+	const std::vector<captured_value>* mCaptures{ nullptr };
+	// Every cell of a captured local that could still be used
+	std::vector<std::weak_ptr<std::optional<value_type>>> mCells;
+	// Every name a script has declared a local with
+	std::set<std::string, std::less<>> mLocal_names;
 };
 
 } // namespace wolfscript
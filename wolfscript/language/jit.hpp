@@ -0,0 +1,1017 @@
+#pragma once
+
+#include "ast.hpp"
+#include "callable.hpp"
+#include "exception.hpp"
+#include "arithmetic.hpp"
+#include "type_inferrer.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Native code is only generated for the System V ABI of x86-64
+#if defined(__x86_64__) && defined(__linux__)
+#define WOLFSCRIPT_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace wolfscript
+{
+
+// Memory that holds native code. It can't be written once the code is in.
+class executable_memory
+{
+public:
+	executable_memory(const std::vector<std::uint8_t>& pCode)
+	{
+#ifdef WOLFSCRIPT_JIT
+		const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+		mSize = (pCode.size() + page - 1) / page * page;
+		void* memory = mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory == MAP_FAILED)
+			return;
+		std::memcpy(memory, pCode.data(), pCode.size());
+		if (mprotect(memory, mSize, PROT_READ | PROT_EXEC) != 0)
+		{
+			munmap(memory, mSize);
+			return;
+		}
+		mMemory = memory;
+#endif
+	}
+
+	executable_memory(const executable_memory&) = delete;
+	executable_memory& operator=(const executable_memory&) = delete;
+
+	~executable_memory()
+	{
+#ifdef WOLFSCRIPT_JIT
+		if (mMemory)
+			munmap(mMemory, mSize);
+#endif
+	}
+
+	// nullptr if the memory couldn't be made
+	const void* get() const
+	{
+		return mMemory;
+	}
+
+private:
+	void* mMemory{ nullptr };
+	std::size_t mSize{ 0 };
+};
+
+// Calls a function from a call in native code
+using jit_caller = std::function<value_type(AST_node_function_call*, const value_type&, arg_list)>;
+
+// A call native code makes to a function the application added
+struct jit_call_site
+{
+	AST_node_function_call* node{ nullptr };
+	// Where the global is and the value it had when the code was compiled.
+	// The code is only run while it still has it.
+	const value_type* global{ nullptr };
+	value_type callee;
+	// The types of the arguments, which are passed in the slots from
+	// first_arg on
+	std::vector<known_type> arg_types;
+	std::uint32_t first_arg{ 0 };
+	// The type the result is unboxed to, unknown if it isn't used
+	known_type result{ known_type::unknown };
+	// Where errors of the call are reported
+	std::uint32_t offset{ unknown_offset };
+};
+
+struct jit_function;
+
+// What native code is run with
+struct jit_context
+{
+	scalar* slots{ nullptr };
+	const jit_function* function{ nullptr };
+	const jit_caller* caller{ nullptr };
+	// What a call threw
+	std::exception_ptr error;
+};
+
+// A script function that is compiled to native code once it is called
+// often enough. The code is compiled for the types of the arguments of the
+// call that made it hot, and is only run for calls with those types.
+struct jit_function
+{
+	// Native code returns what happened in eax. A value of a known_type is
+	// returned as that type, in the result slot.
+	static constexpr int returned_void = 0;
+	static constexpr int threw = 16;
+	static constexpr int divided_by_zero = 17;
+	// The slots native code uses are on the native stack, functions that
+	// need more aren't compiled
+	static constexpr std::size_t max_slots = 64;
+
+	jit_function(const AST_node_function_declaration* pDeclaration) :
+		declaration(pDeclaration)
+	{}
+
+	const AST_node_function_declaration* declaration;
+	// The calls run the normal way so far
+	std::size_t calls{ 0 };
+	// Set if the function couldn't be compiled. It isn't tried again.
+	bool failed{ false };
+
+	// The types of the arguments the code was compiled for
+	std::vector<known_type> parameters;
+	std::vector<jit_call_site> sites;
+	// The slot after the locals. It takes the value returned and the results
+	// of calls, and the arguments of calls come after it.
+	std::uint32_t result_slot{ 0 };
+	std::unique_ptr<executable_memory> code;
+
+	bool is_compiled() const
+	{
+		return code != nullptr;
+	}
+
+	// Returns nothing if the arguments don't have the types the code was
+	// compiled for or a function it calls was replaced. Nothing has been
+	// run then, so the function can be run the normal way instead. The
+	// functions can't be replaced while the code runs if their results are
+	// used, see jit_compiler::compile().
+	std::optional<value_type> run(const value_type* pArgs, std::size_t pCount, const jit_caller& pCaller) const
+	{
+		if (pCount != parameters.size())
+			return{};
+		scalar slots[max_slots];
+		for (std::size_t i = 0; i < pCount; i++)
+		{
+			if (!unbox(pArgs[i], parameters[i], slots[i]))
+				return{};
+			slots[i] = widen(parameters[i], slots[i]);
+		}
+		for (const auto& i : sites)
+			if (&i.global->get_data() != &i.callee.get_data())
+				return{};
+
+		jit_context context;
+		context.slots = slots;
+		context.function = this;
+		context.caller = &pCaller;
+		using entry = int(*)(jit_context*, scalar*);
+		const int status = reinterpret_cast<entry>(const_cast<void*>(code->get()))(&context, slots);
+		switch (status)
+		{
+		case returned_void:
+			return value_type{};
+		case threw:
+			std::rethrow_exception(context.error);
+		case divided_by_zero:
+			throw exception::arithmetic_error("Divide by 0");
+		default:
+			return box(static_cast<known_type>(status), slots[result_slot]);
+		}
+	}
+
+	// Native code keeps a bool in all the bits of its slot
+	static scalar widen(known_type pType, scalar pNumber)
+	{
+		if (pType == known_type::boolean)
+			pNumber.i = pNumber.b ? 1 : 0;
+		return pNumber;
+	}
+
+	// Native code calls this to make the call of a site. Returns threw if
+	// the call threw.
+	static int call_site(jit_context* pContext, std::uint32_t pSite) noexcept
+	{
+		const jit_function& function = *pContext->function;
+		const jit_call_site& site = function.sites[pSite];
+		try
+		{
+			arg_list args;
+			args.reserve(site.arg_types.size());
+			for (std::size_t i = 0; i < site.arg_types.size(); i++)
+				args.push_back(box(site.arg_types[i], pContext->slots[site.first_arg + i]));
+			value_type result = (*pContext->caller)(site.node, *site.global, std::move(args));
+			if (site.result != known_type::unknown)
+			{
+				scalar number;
+				if (!unbox(result, site.result, number))
+					throw exception::interpretor_error("Function didn't return the type it was compiled for");
+				pContext->slots[function.result_slot] = widen(site.result, number);
+			}
+			return 0;
+		}
+		catch (exception::interpretor_error& e)
+		{
+			if (e.offset == unknown_offset)
+				e.offset = site.offset;
+			pContext->error = std::current_exception();
+		}
+		catch (...)
+		{
+			pContext->error = std::current_exception();
+		}
+		return threw;
+	}
+};
+
+// Compiles script functions that only work on ints, floats and bools to
+// x86-64 code. Such a function can use its parameters and locals, the
+// operators on them, if, for and while, and call functions the application
+// added. Anything else, like strings, objects, globals used as values,
+// captures or functions declared in it, leaves the function to the
+// interpreter.
+//
+// Numbers are kept in slots of 4 bytes. rbx points at the slots and r12 at
+// the jit_context. An expression gives its value in eax, a float as its
+// bits, and the operands waiting for the other side are pushed on the
+// native stack.
+class jit_compiler :
+	private AST_visitor
+{
+public:
+	using global_finder = type_inferrer::global_finder;
+	using type_finder = type_inferrer::type_finder;
+
+	// Returns false if the function can't be compiled
+	bool compile(jit_function& pFunction, const value_type* pArgs, std::size_t pCount,
+		global_finder pFind_global, type_finder pFind_type)
+	{
+#ifndef WOLFSCRIPT_JIT
+		return false;
+#endif
+		const AST_node_function_declaration* declaration = pFunction.declaration;
+		if (!declaration->captures.empty() || pCount != declaration->parameters.size())
+			return false;
+
+		mFind_global = std::move(pFind_global);
+		mCode.clear();
+		mSites.clear();
+		mLoops.clear();
+		mLocals.assign(declaration->frame_size, local{});
+		mResult_slot = declaration->frame_size;
+		mMax_args = 0;
+		mDepth = 0;
+		mOffset = unknown_offset;
+		mInvariant = false;
+		mValid = true;
+		mUses_result = false;
+		mImpure = false;
+
+		// Untyped parameters get the type of the argument they are given
+		std::vector<known_type> parameters;
+		for (std::size_t i = 0; i < pCount; i++)
+		{
+			const auto& param = declaration->parameters[i];
+			known_type type = detail::to_known_type(pArgs[i].get_type_info());
+			if (param.has_type)
+			{
+				const type_info* info = pFind_type(param.type.text);
+				type = info ? detail::to_known_type(*info) : known_type::unknown;
+			}
+			if (type == known_type::unknown || i >= mLocals.size())
+				return false;
+			parameters.push_back(type);
+			mLocals[i] = { type, true, param.is_const, true };
+		}
+
+		label exit, divide_by_zero;
+		mExit = &exit;
+		mDivide_by_zero = &divide_by_zero;
+
+		// push rbx; push r12; push r13, which also aligns the stack
+		emit({ 0x53, 0x41, 0x54, 0x41, 0x55 });
+		// mov r12, rdi; mov rbx, rsi; mov r13, rsp
+		emit({ 0x49, 0x89, 0xfc, 0x48, 0x89, 0xf3, 0x49, 0x89, 0xe5 });
+		compile_statement(declaration->children[0]);
+		set_status(jit_function::returned_void);
+
+		// Leaving from inside an expression leaves its operands on the stack
+		place(exit);
+		// mov rsp, r13; pop r13; pop r12; pop rbx; ret
+		emit({ 0x4c, 0x89, 0xec, 0x41, 0x5d, 0x41, 0x5c, 0x5b, 0xc3 });
+		place(divide_by_zero);
+		set_status(jit_function::divided_by_zero);
+		jump(exit);
+
+		// A function that isn't pure can replace any global while the code
+		// runs, after the guards were checked. The result of another call
+		// could then have a type the code can't take.
+		if (mUses_result && mImpure)
+			return false;
+		if (!mValid || mResult_slot + 1 + mMax_args > jit_function::max_slots)
+			return false;
+		auto code = std::make_unique<executable_memory>(mCode);
+		if (!code->get())
+			return false;
+		pFunction.parameters = std::move(parameters);
+		pFunction.sites = std::move(mSites);
+		pFunction.result_slot = mResult_slot;
+		pFunction.code = std::move(code);
+		return true;
+	}
+
+private:
+	// What is known about a slot where the code being compiled is
+	struct local
+	{
+		known_type type{ known_type::unknown };
+		bool declared{ false };
+		bool is_const{ false };
+		// Parameters are never assigned, an argument can be the variable
+		// of the caller
+		bool is_parameter{ false };
+	};
+
+	struct label
+	{
+		std::ptrdiff_t position{ -1 };
+		// Where the offsets of the jumps to it are, until it is placed
+		std::vector<std::size_t> jumps;
+	};
+
+	struct loop
+	{
+		label* exit;
+		label* next;
+	};
+
+private:
+	virtual void dispatch(AST_node_block* pNode) override
+	{
+		const std::vector<local> locals = mLocals;
+		for (const auto& i : pNode->children)
+		{
+			const std::uint32_t offset = std::exchange(mOffset, i->offset);
+			compile_statement(i);
+			mOffset = offset;
+		}
+		mLocals = locals;
+	}
+
+	virtual void dispatch(AST_node_variable* pNode) override
+	{
+		if (pNode->children[0]->is_empty() || pNode->slot >= mLocals.size())
+			return fail();
+		const known_type type = compile_value(pNode->children[0]);
+
+		// A local declared again has to stay what it was, the declaration
+		// could be skipped
+		local& l = mLocals[pNode->slot];
+		if (l.declared && (l.type != type || l.is_const != pNode->is_const))
+			return fail();
+		l = { type, true, pNode->is_const, false };
+		store(pNode->slot);
+	}
+
+	virtual void dispatch(AST_node_unary_op* pNode) override
+	{
+		if (pNode->type == token_type::increment || pNode->type == token_type::decrement)
+		{
+			const AST_node_identifier* target = get_target(pNode->children[0]);
+			if (!target || mLocals[target->slot].type == known_type::boolean)
+				return fail();
+			const known_type type = mLocals[target->slot].type;
+			const bool increment = pNode->type == token_type::increment;
+			load(target->slot);
+			if (type == known_type::integer)
+			{
+				// add eax, 1 or sub eax, 1
+				emit({ 0x83, static_cast<std::uint8_t>(increment ? 0xc0 : 0xe8), 0x01 });
+			}
+			else
+			{
+				// mov ecx, 1.0f
+				emit({ 0xb9 });
+				emit32(0x3f800000);
+				float_operation(increment ? 0x58 : 0x5c);
+			}
+			store(target->slot);
+			mType = type;
+			return;
+		}
+
+		const known_type type = compile_value(pNode->children[0]);
+		if (pNode->type == token_type::sub)
+		{
+			// neg eax, or flip the sign bit of a float. A bool stays as it is.
+			if (type == known_type::integer)
+				emit({ 0xf7, 0xd8 });
+			else if (type == known_type::floating)
+			{
+				emit({ 0x35 });
+				emit32(0x80000000);
+			}
+		}
+		else if (pNode->type != token_type::add)
+		{
+			return fail();
+		}
+		mType = type;
+	}
+
+	virtual void dispatch(AST_node_binary_op* pNode) override
+	{
+		const token_type op = pNode->type;
+		if (is_assignment(op))
+			return compile_assignment(pNode);
+
+		const bool is_arithmetic = op == token_type::add || op == token_type::sub
+			|| op == token_type::mul || op == token_type::div || op == token_type::mod;
+		if (!is_arithmetic && !is_comparison(op))
+			return fail();
+
+		const known_type l = compile_value(pNode->children[0]);
+		push();
+		const known_type r = compile_value(pNode->children[1]);
+		const bool has_bool = l == known_type::boolean || r == known_type::boolean;
+		if (has_bool && op != token_type::equ && op != token_type::not_equ)
+			return fail();
+
+		// The right value is cast to the type of the left.
+		// mov ecx, eax; pop rax
+		convert(r, l);
+		emit({ 0x89, 0xc1, 0x58 });
+		mDepth -= 8;
+
+		if (is_comparison(op))
+		{
+			compare(op, l);
+			mType = known_type::boolean;
+			return;
+		}
+		arithmetic(op, l);
+		mType = l;
+	}
+
+	virtual void dispatch(AST_node_member_accessor*) override
+	{
+		fail();
+	}
+
+	virtual void dispatch(AST_node_constant* pNode) override
+	{
+		scalar value;
+		const known_type type = pNode->value ? detail::to_known_type(pNode->value->get_type_info()) : known_type::unknown;
+		if (type == known_type::unknown || !unbox(*pNode->value, type, value))
+			return fail();
+		value = jit_function::widen(type, value);
+		std::uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		// mov eax, imm32
+		emit({ 0xb8 });
+		emit32(bits);
+		mType = type;
+	}
+
+	virtual void dispatch(AST_node_identifier* pNode) override
+	{
+		// Only locals that are certainly declared here are read
+		if (pNode->depth != 0 || pNode->slot >= mLocals.size() || !mLocals[pNode->slot].declared)
+			return fail();
+		load(pNode->slot);
+		mType = mLocals[pNode->slot].type;
+	}
+
+	virtual void dispatch(AST_node_function_call* pNode) override
+	{
+		const bool is_statement = mStatement;
+
+		// A call to a pure function evaluated once for a loop would be
+		// made on every pass
+		const AST_node_identifier* callee = as_identifier(pNode->children[0]);
+		if (!callee || callee->slot != unresolved_slot || mInvariant)
+			return fail();
+		const value_type* global = mFind_global(callee->identifier);
+		if (!global || (!global->get<const callable>() && !global->get<const callable_overloader>()))
+			return fail();
+
+		jit_call_site site;
+		site.node = pNode;
+		site.global = global;
+		site.callee = *global;
+		site.offset = mOffset;
+		if (auto func = global->get<const callable>())
+			mImpure = mImpure || !func->is_pure;
+		else
+			mImpure = mImpure || !global->get<const callable_overloader>()->is_pure();
+		if (!is_statement)
+		{
+			mUses_result = true;
+			// The result has to be a number
+			const callable* func = global->get<const callable>();
+			if (func && func->return_type.owning())
+				site.result = detail::to_known_type(func->return_type);
+			if (site.result == known_type::unknown)
+				return fail();
+		}
+
+		const std::size_t count = pNode->children.size() - 1;
+		for (std::size_t i = 0; i < count; i++)
+		{
+			site.arg_types.push_back(compile_value(pNode->children[i + 1]));
+			push();
+		}
+		site.first_arg = mResult_slot + 1;
+		for (std::size_t i = count; i > 0; i--)
+		{
+			// pop rax
+			emit({ 0x58 });
+			mDepth -= 8;
+			store(static_cast<std::uint32_t>(site.first_arg + i - 1));
+		}
+		mMax_args = std::max(mMax_args, count);
+
+		// mov rdi, r12; mov esi, site
+		emit({ 0x4c, 0x89, 0xe7, 0xbe });
+		emit32(static_cast<std::uint32_t>(mSites.size()));
+		call(reinterpret_cast<const void*>(&jit_function::call_site));
+		mSites.push_back(std::move(site));
+
+		// The status is still in eax if the call threw.
+		// test eax, eax; jne exit
+		emit({ 0x85, 0xc0, 0x0f, 0x85 });
+		jump_offset(*mExit);
+		if (!is_statement)
+		{
+			load(mResult_slot);
+			mType = mSites.back().result;
+		}
+	}
+
+	virtual void dispatch(AST_node_if* pNode) override
+	{
+		label done;
+		const std::size_t count = pNode->elseif_count + 1;
+		for (std::size_t i = 0; i < count; i++)
+		{
+			label next;
+			compile_test(pNode->children[i * 2], next);
+			compile_scope(pNode->children[i * 2 + 1]);
+			if (i + 1 < count || pNode->has_else)
+				jump(done);
+			place(next);
+		}
+		if (pNode->has_else)
+			compile_scope(pNode->children.back());
+		place(done);
+	}
+
+	virtual void dispatch(AST_node_for* pNode) override
+	{
+		const std::vector<local> locals = mLocals;
+		compile_statement(pNode->children[0]);
+
+		label condition, next, exit;
+		place(condition);
+		if (!pNode->children[1]->is_empty())
+			compile_test(pNode->children[1], exit);
+		mLoops.push_back({ &exit, &next });
+		compile_scope(pNode->children[3]);
+		mLoops.pop_back();
+		place(next);
+		compile_scope(pNode->children[2]);
+		jump(condition);
+		place(exit);
+		mLocals = locals;
+	}
+
+	virtual void dispatch(AST_node_while* pNode) override
+	{
+		label condition, exit;
+		place(condition);
+		compile_test(pNode->children[0], exit);
+		mLoops.push_back({ &exit, &condition });
+		compile_scope(pNode->children[1]);
+		mLoops.pop_back();
+		jump(condition);
+		place(exit);
+	}
+
+	virtual void dispatch(AST_node_function_declaration*) override
+	{
+		fail();
+	}
+
+	virtual void dispatch(AST_node_return* pNode) override
+	{
+		if (pNode->children[0]->is_empty())
+		{
+			set_status(jit_function::returned_void);
+		}
+		else
+		{
+			const known_type type = compile_value(pNode->children[0]);
+			store(mResult_slot);
+			set_status(static_cast<int>(type));
+		}
+		jump(*mExit);
+	}
+
+	virtual void dispatch(AST_node_break*) override
+	{
+		if (mLoops.empty())
+			return fail();
+		jump(*mLoops.back().exit);
+	}
+
+	virtual void dispatch(AST_node_continue*) override
+	{
+		if (mLoops.empty())
+			return fail();
+		jump(*mLoops.back().next);
+	}
+
+private:
+	// Compiles the expression so its value is in eax. Returns its type.
+	known_type compile_value(AST_node* pNode)
+	{
+		const bool statement = std::exchange(mStatement, false);
+		const bool invariant = mInvariant;
+		mInvariant |= pNode->invariant_slot != unresolved_slot;
+		mType = known_type::unknown;
+		pNode->visit(this);
+		mStatement = statement;
+		mInvariant = invariant;
+		if (mType == known_type::unknown)
+			fail();
+		return mType;
+	}
+
+	void compile_statement(AST_node* pNode)
+	{
+		const bool statement = std::exchange(mStatement, true);
+		pNode->visit(this);
+		mStatement = statement;
+	}
+
+	// The locals a statement that isn't always run declares aren't known
+	// to be declared after it
+	void compile_scope(AST_node* pNode)
+	{
+		const std::vector<local> locals = mLocals;
+		compile_statement(pNode);
+		mLocals = locals;
+	}
+
+	// Jumps to the label if the condition is false
+	void compile_test(AST_node* pNode, label& pFalse)
+	{
+		convert(compile_value(pNode), known_type::boolean);
+		// test eax, eax; je
+		emit({ 0x85, 0xc0, 0x0f, 0x84 });
+		jump_offset(pFalse);
+	}
+
+	void compile_assignment(AST_node_binary_op* pNode)
+	{
+		const token_type op = pNode->type;
+		const AST_node_identifier* target = get_target(pNode->children[0]);
+		if (!target)
+			return fail();
+		const known_type type = mLocals[target->slot].type;
+		const known_type value = compile_value(pNode->children[1]);
+		if (op != token_type::assign && (type == known_type::boolean || value == known_type::boolean))
+			return fail();
+
+		convert(value, type);
+		if (op != token_type::assign)
+		{
+			// mov ecx, eax
+			emit({ 0x89, 0xc1 });
+			load(target->slot);
+			switch (op)
+			{
+			case token_type::add_assign: arithmetic(token_type::add, type); break;
+			case token_type::sub_assign: arithmetic(token_type::sub, type); break;
+			case token_type::mul_assign: arithmetic(token_type::mul, type); break;
+			default: arithmetic(token_type::div, type); break;
+			}
+		}
+		store(target->slot);
+		mType = type;
+	}
+
+	// The local an assignment or increment changes, nullptr if it can't be
+	// changed here
+	const AST_node_identifier* get_target(AST_node* pNode) const
+	{
+		const AST_node_identifier* identifier = as_identifier(pNode);
+		if (!identifier || identifier->depth != 0 || identifier->slot >= mLocals.size())
+			return nullptr;
+		const local& l = mLocals[identifier->slot];
+		if (!l.declared || l.is_const || l.is_parameter)
+			return nullptr;
+		return identifier;
+	}
+
+	// Applies the operator to eax and ecx, which have the type
+	void arithmetic(token_type pOp, known_type pType)
+	{
+		if (pOp == token_type::div || pOp == token_type::mod)
+			check_zero(pType);
+		if (pType == known_type::integer)
+		{
+			switch (pOp)
+			{
+			case token_type::add:
+				// add eax, ecx
+				emit({ 0x01, 0xc8 });
+				break;
+			case token_type::sub:
+				// sub eax, ecx
+				emit({ 0x29, 0xc8 });
+				break;
+			case token_type::mul:
+				// imul eax, ecx
+				emit({ 0x0f, 0xaf, 0xc1 });
+				break;
+			case token_type::div:
+				// cdq; idiv ecx
+				emit({ 0x99, 0xf7, 0xf9 });
+				break;
+			default:
+				// cdq; idiv ecx; mov eax, edx
+				emit({ 0x99, 0xf7, 0xf9, 0x89, 0xd0 });
+				break;
+			}
+			return;
+		}
+
+		switch (pOp)
+		{
+		case token_type::add:
+			float_operation(0x58);
+			break;
+		case token_type::sub:
+			float_operation(0x5c);
+			break;
+		case token_type::mul:
+			float_operation(0x59);
+			break;
+		case token_type::div:
+			float_operation(0x5e);
+			break;
+		default:
+			// movd xmm0, eax; movd xmm1, ecx
+			emit({ 0x66, 0x0f, 0x6e, 0xc0, 0x66, 0x0f, 0x6e, 0xc9 });
+			call(reinterpret_cast<const void*>(&float_mod));
+			// movd eax, xmm0
+			emit({ 0x66, 0x0f, 0x7e, 0xc0 });
+			break;
+		}
+	}
+
+	// Leaves with divided_by_zero if ecx, which has the type, is 0
+	void check_zero(known_type pType)
+	{
+		if (pType == known_type::integer)
+			// test ecx, ecx; je
+			emit({ 0x85, 0xc9, 0x0f, 0x84 });
+		else
+			// movd xmm1, ecx; xorps xmm2, xmm2; ucomiss xmm1, xmm2;
+			// jp over the je, which a NaN isn't taken by
+			emit({ 0x66, 0x0f, 0x6e, 0xc9, 0x0f, 0x57, 0xd2, 0x0f, 0x2e, 0xca, 0x7a, 0x06, 0x0f, 0x84 });
+		jump_offset(*mDivide_by_zero);
+	}
+
+	// Runs an SSE instruction on the floats in eax and ecx
+	void float_operation(std::uint8_t pOpcode)
+	{
+		// movd xmm0, eax; movd xmm1, ecx; op xmm0, xmm1; movd eax, xmm0
+		emit({ 0x66, 0x0f, 0x6e, 0xc0, 0x66, 0x0f, 0x6e, 0xc9 });
+		emit({ 0xf3, 0x0f, pOpcode, 0xc1 });
+		emit({ 0x66, 0x0f, 0x7e, 0xc0 });
+	}
+
+	// Compares eax to ecx, which have the type, and gives a bool
+	void compare(token_type pOp, known_type pType)
+	{
+		if (pType != known_type::floating)
+		{
+			std::uint8_t condition = 0x94;
+			switch (pOp)
+			{
+			case token_type::equ: condition = 0x94; break;
+			case token_type::not_equ: condition = 0x95; break;
+			case token_type::less_than: condition = 0x9c; break;
+			case token_type::less_than_equ_to: condition = 0x9e; break;
+			case token_type::greater_than: condition = 0x9f; break;
+			default: condition = 0x9d; break;
+			}
+			// cmp eax, ecx; setcc al
+			emit({ 0x39, 0xc8, 0x0f, condition, 0xc0 });
+		}
+		else
+		{
+			// movd xmm0, eax; movd xmm1, ecx
+			emit({ 0x66, 0x0f, 0x6e, 0xc0, 0x66, 0x0f, 0x6e, 0xc9 });
+			// Comparisons with a NaN are false, but for !=
+			switch (pOp)
+			{
+			case token_type::equ:
+				// ucomiss xmm0, xmm1; sete al; setnp cl; and al, cl
+				emit({ 0x0f, 0x2e, 0xc1, 0x0f, 0x94, 0xc0, 0x0f, 0x9b, 0xc1, 0x20, 0xc8 });
+				break;
+			case token_type::not_equ:
+				// ucomiss xmm0, xmm1; setne al; setp cl; or al, cl
+				emit({ 0x0f, 0x2e, 0xc1, 0x0f, 0x95, 0xc0, 0x0f, 0x9a, 0xc1, 0x08, 0xc8 });
+				break;
+			case token_type::less_than:
+				// ucomiss xmm1, xmm0; seta al
+				emit({ 0x0f, 0x2e, 0xc8, 0x0f, 0x97, 0xc0 });
+				break;
+			case token_type::less_than_equ_to:
+				// ucomiss xmm1, xmm0; setae al
+				emit({ 0x0f, 0x2e, 0xc8, 0x0f, 0x93, 0xc0 });
+				break;
+			case token_type::greater_than:
+				// ucomiss xmm0, xmm1; seta al
+				emit({ 0x0f, 0x2e, 0xc1, 0x0f, 0x97, 0xc0 });
+				break;
+			default:
+				// ucomiss xmm0, xmm1; setae al
+				emit({ 0x0f, 0x2e, 0xc1, 0x0f, 0x93, 0xc0 });
+				break;
+			}
+		}
+		// movzx eax, al
+		emit({ 0x0f, 0xb6, 0xc0 });
+	}
+
+	// Casts eax the way static_cast does
+	void convert(known_type pFrom, known_type pTo)
+	{
+		if (pFrom == pTo || pFrom == known_type::unknown)
+			return;
+		switch (pTo)
+		{
+		case known_type::boolean:
+			if (pFrom == known_type::integer)
+			{
+				// test eax, eax; setne al
+				emit({ 0x85, 0xc0, 0x0f, 0x95, 0xc0 });
+			}
+			else
+			{
+				// movd xmm0, eax; xorps xmm1, xmm1; ucomiss xmm0, xmm1;
+				// setne al; setp cl; or al, cl
+				emit({ 0x66, 0x0f, 0x6e, 0xc0, 0x0f, 0x57, 0xc9, 0x0f, 0x2e, 0xc1 });
+				emit({ 0x0f, 0x95, 0xc0, 0x0f, 0x9a, 0xc1, 0x08, 0xc8 });
+			}
+			// movzx eax, al
+			emit({ 0x0f, 0xb6, 0xc0 });
+			break;
+		case known_type::integer:
+			// A bool is already 0 or 1.
+			// movd xmm0, eax; cvttss2si eax, xmm0
+			if (pFrom == known_type::floating)
+				emit({ 0x66, 0x0f, 0x6e, 0xc0, 0xf3, 0x0f, 0x2c, 0xc0 });
+			break;
+		default:
+			// cvtsi2ss xmm0, eax; movd eax, xmm0
+			emit({ 0xf3, 0x0f, 0x2a, 0xc0, 0x66, 0x0f, 0x7e, 0xc0 });
+			break;
+		}
+	}
+
+	static float float_mod(float pL, float pR)
+	{
+		return std::fmod(pL, pR);
+	}
+
+private:
+	void emit(std::initializer_list<std::uint8_t> pBytes)
+	{
+		mCode.insert(mCode.end(), pBytes);
+	}
+
+	void emit32(std::uint32_t pValue)
+	{
+		for (int i = 0; i < 4; i++)
+			mCode.push_back(static_cast<std::uint8_t>(pValue >> (i * 8)));
+	}
+
+	// mov eax, [rbx + slot * 4]
+	void load(std::uint32_t pSlot)
+	{
+		emit({ 0x8b, 0x83 });
+		emit32(pSlot * 4);
+	}
+
+	// mov [rbx + slot * 4], eax
+	void store(std::uint32_t pSlot)
+	{
+		emit({ 0x89, 0x83 });
+		emit32(pSlot * 4);
+	}
+
+	// push rax
+	void push()
+	{
+		emit({ 0x50 });
+		mDepth += 8;
+	}
+
+	// mov eax, status
+	void set_status(int pStatus)
+	{
+		emit({ 0xb8 });
+		emit32(static_cast<std::uint32_t>(pStatus));
+	}
+
+	// Calls a C++ function with the stack aligned to 16 bytes
+	void call(const void* pFunction)
+	{
+		const bool align = mDepth % 16 != 0;
+		// sub rsp, 8
+		if (align)
+			emit({ 0x48, 0x83, 0xec, 0x08 });
+		// mov rax, imm64; call rax
+		emit({ 0x48, 0xb8 });
+		const std::uint64_t address = reinterpret_cast<std::uint64_t>(pFunction);
+		emit32(static_cast<std::uint32_t>(address));
+		emit32(static_cast<std::uint32_t>(address >> 32));
+		emit({ 0xff, 0xd0 });
+		// add rsp, 8
+		if (align)
+			emit({ 0x48, 0x83, 0xc4, 0x08 });
+	}
+
+	// jmp
+	void jump(label& pLabel)
+	{
+		emit({ 0xe9 });
+		jump_offset(pLabel);
+	}
+
+	// The offset of a jump to the label, after its opcode
+	void jump_offset(label& pLabel)
+	{
+		const std::size_t at = mCode.size();
+		emit32(0);
+		if (pLabel.position >= 0)
+			patch(at, static_cast<std::size_t>(pLabel.position));
+		else
+			pLabel.jumps.push_back(at);
+	}
+
+	void place(label& pLabel)
+	{
+		pLabel.position = static_cast<std::ptrdiff_t>(mCode.size());
+		for (auto i : pLabel.jumps)
+			patch(i, mCode.size());
+		pLabel.jumps.clear();
+	}
+
+	void patch(std::size_t pAt, std::size_t pTarget)
+	{
+		const std::uint32_t offset = static_cast<std::uint32_t>(
+			static_cast<std::int32_t>(static_cast<std::ptrdiff_t>(pTarget) - static_cast<std::ptrdiff_t>(pAt + 4)));
+		for (int i = 0; i < 4; i++)
+			mCode[pAt + i] = static_cast<std::uint8_t>(offset >> (i * 8));
+	}
+
+	void fail()
+	{
+		mValid = false;
+		mType = known_type::unknown;
+	}
+
+private:
+	global_finder mFind_global;
+	std::vector<std::uint8_t> mCode;
+	std::vector<jit_call_site> mSites;
+	// What is known about each slot of the frame
+	std::vector<local> mLocals;
+	std::vector<loop> mLoops;
+	label* mExit{ nullptr };
+	label* mDivide_by_zero{ nullptr };
+	std::uint32_t mResult_slot{ 0 };
+	std::size_t mMax_args{ 0 };
+	// The bytes pushed on the native stack by the expression being compiled
+	std::size_t mDepth{ 0 };
+	// The offset of the statement being compiled
+	std::uint32_t mOffset{ unknown_offset };
+	known_type mType{ known_type::unknown };
+	// True if the node is compiled as a statement, so its value isn't used
+	bool mStatement{ false };
+	// True in an expression the loop_hoister made invariant
+	bool mInvariant{ false };
+	// True if the result of a call is used
+	bool mUses_result{ false };
+	// True if a function that isn't pure is called
+	bool mImpure{ false };
+	bool mValid{ true };
+};
+
+} // namespace wolfscript
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "token.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+namespace wolfscript
+{
+
+// Maps byte offsets in a source to lines and columns.
+// The start of every line is recorded in a single pass over the source
+// so nothing has to keep track of positions while tokenizing.
+class line_index
+{
+public:
+	line_index() = default;
+
+	line_index(std::string_view pSource)
+	{
+		build(pSource);
+	}
+
+	void build(std::string_view pSource)
+	{
+		mLine_starts.clear();
+		// A guess of 32 characters per line avoids most reallocations
+		mLine_starts.reserve(pSource.length() / 32 + 1);
+		mLine_starts.push_back(0);
+		const char* begin = pSource.data();
+		const char* end = begin + pSource.length();
+		for (const char* i = begin; i < end; ++i)
+		{
+			// memchr is vectorized by every standard library worth using
+			i = static_cast<const char*>(std::memchr(i, '\n', static_cast<std::size_t>(end - i)));
+			if (!i)
+				break;
+			mLine_starts.push_back(static_cast<std::uint32_t>(i - begin + 1));
+		}
+	}
+
+	text_position position(std::uint32_t pOffset) const
+	{
+		if (pOffset == unknown_offset || mLine_starts.empty())
+			return unknown_position;
+		const std::size_t line = line_of(pOffset);
+		return text_position(static_cast<int>(line) + 1, static_cast<int>(pOffset - mLine_starts[line]));
+	}
+
+	// Gets the index (starting at 0) of the line containing the offset
+	std::size_t line_of(std::uint32_t pOffset) const
+	{
+		return static_cast<std::size_t>(std::upper_bound(mLine_starts.begin(), mLine_starts.end(), pOffset)
+			- mLine_starts.begin()) - 1;
+	}
+
+	// Gets the offset of the first character of a line (starting at 0)
+	std::uint32_t line_start(std::size_t pLine) const
+	{
+		return mLine_starts[pLine];
+	}
+
+	std::size_t line_count() const
+	{
+		return mLine_starts.size();
+	}
+
+	bool empty() const
+	{
+		return mLine_starts.empty();
+	}
+
+	std::size_t memory_usage() const
+	{
+		return mLine_starts.capacity() * sizeof(std::uint32_t);
+	}
+
+private:
+	std::vector<std::uint32_t> mLine_starts;
+};
+
+} // namespace wolfscript
@@ -0,0 +1,489 @@
+#pragma once
+
+#include "ast.hpp"
+#include "callable.hpp"
+#include "constant_folder.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <set>
+#include <string_view>
+#include <utility>
+
+namespace wolfscript
+{
+
+namespace detail
+{
+
+// Finds the locals of a function that the functions declared in it capture
+class captured_slots_finder :
+	public AST_walker
+{
+public:
+	virtual void dispatch(AST_node_function_declaration* pNode) override
+	{
+		// Functions further in capture through this one
+		for (const auto& i : pNode->captures)
+			if (!i.is_capture)
+				mSlots.insert(i.index);
+	}
+
+	const std::set<std::uint32_t>& get_slots() const
+	{
+		return mSlots;
+	}
+
+private:
+	std::set<std::uint32_t> mSlots;
+};
+
+// Finds every name declared as a local, function or parameter
+class declared_names_finder :
+	public AST_walker
+{
+public:
+	virtual void dispatch(AST_node_variable* pNode) override
+	{
+		mNames.insert(pNode->identifier);
+		AST_walker::dispatch(pNode);
+	}
+
+	virtual void dispatch(AST_node_function_declaration* pNode) override
+	{
+		if (!pNode->identifier.empty())
+			mNames.insert(pNode->identifier);
+		for (const auto& i : pNode->parameters)
+			mNames.insert(i.identifier);
+		AST_walker::dispatch(pNode);
+	}
+
+	const std::set<std::string_view>& get_names() const
+	{
+		return mNames;
+	}
+
+private:
+	std::set<std::string_view> mNames;
+};
+
+} // namespace detail
+
+// Finds the expressions in loops that give the same value on every pass
+// and have no side effects. The interpreter only evaluates them the first
+// time they are reached each time their loop is run, and keeps the value
+// in a slot of the frame the loop runs in. Since they are evaluated where
+// they would have been first, one that fails still fails in the same place
+// and one in a branch that isn't taken is never evaluated.
+//
+// Only arithmetic operations and calls to the functions of the application
+// marked pure are moved out. A name is invariant if it isn't declared or
+// changed in the loop, see detail::mutated_names_finder. If the loop calls
+// anything that could have side effects, only the locals of the function
+// that hold numbers and aren't captured are relied on.
+class loop_hoister :
+	private AST_walker
+{
+public:
+	// Finds a value the application added
+	using global_finder = std::function<const value_type*(std::string_view)>;
+
+	// The tree has to be resolved and its types inferred first. Returns
+	// the size of the frame of the root with the slots that were added.
+	std::uint32_t hoist(AST_node* pRoot, std::uint32_t pFrame_size, global_finder pFind_global)
+	{
+		clear(pRoot);
+		detail::declared_names_finder names;
+		pRoot->visit(&names);
+		mDeclared_names = &names.get_names();
+		mFind_global = std::move(pFind_global);
+		enter_function(pRoot, pFrame_size);
+		mDeclared_names = nullptr;
+		return pFrame_size;
+	}
+
+	// Removes what hoist() did to a tree, so it can run without it
+	void clear(AST_node* pRoot)
+	{
+		pRoot->invariant_slot = unresolved_slot;
+		for (auto i : pRoot->children)
+			clear(i);
+
+		struct ranges_clearer :
+			AST_walker
+		{
+			virtual void dispatch(AST_node_for* pNode) override
+			{
+				pNode->invariants = {};
+				AST_walker::dispatch(pNode);
+			}
+
+			virtual void dispatch(AST_node_while* pNode) override
+			{
+				pNode->invariants = {};
+				AST_walker::dispatch(pNode);
+			}
+		} clearer;
+		pRoot->visit(&clearer);
+	}
+
+private:
+	// Marks the invariant expressions of a loop that can be kept
+	class marker :
+		public AST_visitor
+	{
+	public:
+		marker(loop_hoister& pHoister) :
+			mHoister(pHoister)
+		{}
+
+		// pMutable is true if the value of the node could be changed where
+		// it is used, so it has to be a new one each time
+		void mark(AST_node* pNode, bool pMutable)
+		{
+			// Already kept for a loop around this one
+			if (pNode->invariant_slot != unresolved_slot)
+				return;
+			mMutable = pMutable;
+			pNode->visit(this);
+		}
+
+		virtual void dispatch(AST_node_block* pNode) override
+		{
+			mark_children(pNode);
+		}
+
+		virtual void dispatch(AST_node_variable* pNode) override
+		{
+			// The value is copied into the local
+			mark_children(pNode);
+		}
+
+		virtual void dispatch(AST_node_unary_op* pNode) override
+		{
+			if (!keep(pNode))
+				mark(pNode->children[0], pNode->type == token_type::increment || pNode->type == token_type::decrement);
+		}
+
+		virtual void dispatch(AST_node_binary_op* pNode) override
+		{
+			if (keep(pNode))
+				return;
+			mark(pNode->children[0], is_assignment(pNode->type));
+			mark(pNode->children[1], false);
+		}
+
+		virtual void dispatch(AST_node_member_accessor* pNode) override
+		{
+			if (!keep(pNode))
+				mark(pNode->children[0], true);
+		}
+
+		virtual void dispatch(AST_node_function_call* pNode) override
+		{
+			if (keep(pNode))
+				return;
+			for (auto i : pNode->children)
+				mark(i, true);
+		}
+
+		virtual void dispatch(AST_node_if* pNode) override
+		{
+			mark_children(pNode);
+		}
+
+		virtual void dispatch(AST_node_for* pNode) override
+		{
+			mark_children(pNode);
+		}
+
+		virtual void dispatch(AST_node_while* pNode) override
+		{
+			mark_children(pNode);
+		}
+
+		virtual void dispatch(AST_node_return* pNode) override
+		{
+			mark(pNode->children[0], true);
+		}
+
+	private:
+		void mark_children(AST_node* pNode)
+		{
+			for (auto i : pNode->children)
+				mark(i, false);
+		}
+
+		// Gives the node a slot if its value can be kept
+		bool keep(AST_node* pNode)
+		{
+			if (mMutable || !mHoister.is_invariant(pNode))
+				return false;
+			pNode->invariant_slot = (*mHoister.mFrame_size)++;
+			return true;
+		}
+
+	private:
+		loop_hoister& mHoister;
+		bool mMutable{ false };
+	};
+
+	// Tells if an expression gives the same value on every pass through
+	// the loop being hoisted and has no side effects
+	class invariance_checker :
+		public AST_visitor
+	{
+	public:
+		invariance_checker(const loop_hoister& pHoister) :
+			mHoister(pHoister)
+		{}
+
+		bool check(AST_node* pNode)
+		{
+			if (pNode->invariant_slot != unresolved_slot)
+				return true;
+			mResult = false;
+			pNode->visit(this);
+			return mResult;
+		}
+
+		virtual void dispatch(AST_node_unary_op* pNode) override
+		{
+			mResult = (pNode->type == token_type::add || pNode->type == token_type::sub)
+				&& pNode->children[0]->inferred != known_type::unknown
+				&& check(pNode->children[0]);
+		}
+
+		virtual void dispatch(AST_node_binary_op* pNode) override
+		{
+			// Operations on anything but numbers call the functions of the
+			// application for the operator
+			mResult = !is_assignment(pNode->type)
+				&& pNode->children[0]->inferred != known_type::unknown
+				&& pNode->children[1]->inferred != known_type::unknown
+				&& check(pNode->children[0])
+				&& check(pNode->children[1]);
+		}
+
+		virtual void dispatch(AST_node_member_accessor* pNode) override
+		{
+			mResult = mHoister.is_pure_member(pNode->identifier) && check(pNode->children[0]);
+		}
+
+		virtual void dispatch(AST_node_constant*) override
+		{
+			mResult = true;
+		}
+
+		virtual void dispatch(AST_node_identifier* pNode) override
+		{
+			mResult = mHoister.is_invariant_name(pNode);
+		}
+
+		virtual void dispatch(AST_node_function_call* pNode) override
+		{
+			if (!mHoister.is_pure_call(pNode))
+				return;
+			for (std::size_t i = 1; i < pNode->children.size(); i++)
+				if (!check(pNode->children[i]))
+					return;
+			mResult = true;
+		}
+
+	private:
+		const loop_hoister& mHoister;
+		bool mResult{ false };
+	};
+
+	// Pure functions don't change their arguments
+	class mutated_names_finder :
+		public detail::mutated_names_finder
+	{
+	public:
+		mutated_names_finder(const loop_hoister& pHoister) :
+			mHoister(pHoister)
+		{}
+
+	protected:
+		virtual bool could_change(AST_node_member_accessor* pNode) const override
+		{
+			return !mHoister.is_pure_member(pNode->identifier);
+		}
+
+		virtual bool could_change(AST_node_function_call* pNode) const override
+		{
+			return !mHoister.is_pure_call(pNode);
+		}
+
+	private:
+		const loop_hoister& mHoister;
+	};
+
+	// Finds an operation in a loop that could have side effects
+	class side_effects_finder :
+		public AST_walker
+	{
+	public:
+		side_effects_finder(const loop_hoister& pHoister) :
+			mHoister(pHoister)
+		{}
+
+		virtual void dispatch(AST_node_unary_op* pNode) override
+		{
+			if (pNode->children[0]->inferred == known_type::unknown)
+				found = true;
+			AST_walker::dispatch(pNode);
+		}
+
+		virtual void dispatch(AST_node_binary_op* pNode) override
+		{
+			if (pNode->children[0]->inferred == known_type::unknown
+				|| pNode->children[1]->inferred == known_type::unknown)
+				found = true;
+			AST_walker::dispatch(pNode);
+		}
+
+		virtual void dispatch(AST_node_member_accessor* pNode) override
+		{
+			if (!mHoister.is_pure_member(pNode->identifier))
+				found = true;
+			AST_walker::dispatch(pNode);
+		}
+
+		virtual void dispatch(AST_node_function_call* pNode) override
+		{
+			if (!mHoister.is_pure_call(pNode))
+				found = true;
+			AST_walker::dispatch(pNode);
+		}
+
+		virtual void dispatch(AST_node_function_declaration*) override
+		{
+			// Only run when it is called
+		}
+
+		bool found{ false };
+
+	private:
+		const loop_hoister& mHoister;
+	};
+
+private:
+	virtual void dispatch(AST_node_for* pNode) override
+	{
+		// The first statement is only run once
+		hoist_loop({ pNode->children[1], pNode->children[2], pNode->children[3] }, pNode->invariants);
+		AST_walker::dispatch(pNode);
+	}
+
+	virtual void dispatch(AST_node_while* pNode) override
+	{
+		hoist_loop({ pNode->children[0], pNode->children[1] }, pNode->invariants);
+		AST_walker::dispatch(pNode);
+	}
+
+	virtual void dispatch(AST_node_function_declaration* pNode) override
+	{
+		enter_function(pNode->children[0], pNode->frame_size);
+	}
+
+private:
+	// Hoists the loops of a function, whose body runs in a frame of this size
+	void enter_function(AST_node* pBody, std::uint32_t& pFrame_size)
+	{
+		detail::captured_slots_finder captured;
+		pBody->visit(&captured);
+
+		std::uint32_t* frame_size = std::exchange(mFrame_size, &pFrame_size);
+		const std::set<std::uint32_t>* captured_slots = std::exchange(mCaptured_slots, &captured.get_slots());
+		pBody->visit(this);
+		mFrame_size = frame_size;
+		mCaptured_slots = captured_slots;
+	}
+
+	void hoist_loop(std::initializer_list<AST_node*> pParts, slot_range& pInvariants)
+	{
+		detail::declared_names_finder declared;
+		mutated_names_finder mutated(*this);
+		side_effects_finder side_effects(*this);
+		for (auto i : pParts)
+		{
+			i->visit(&mutated);
+			i->visit(&declared);
+			i->visit(&side_effects);
+		}
+		mMutated_names = &mutated.get_names();
+		mLoop_names = &declared.get_names();
+		mSide_effects = side_effects.found;
+
+		pInvariants.begin = *mFrame_size;
+		marker m(*this);
+		for (auto i : pParts)
+			m.mark(i, false);
+		pInvariants.end = *mFrame_size;
+
+		mMutated_names = nullptr;
+		mLoop_names = nullptr;
+	}
+
+	bool is_invariant(AST_node* pNode) const
+	{
+		invariance_checker checker(*this);
+		return checker.check(pNode);
+	}
+
+	bool is_invariant_name(const AST_node_identifier* pNode) const
+	{
+		if (mMutated_names->count(pNode->identifier) > 0 || mLoop_names->count(pNode->identifier) > 0)
+			return false;
+		if (!mSide_effects)
+			return true;
+		// A function that is called could change anything else
+		return pNode->depth == 0 && pNode->slot != unresolved_slot
+			&& pNode->inferred != known_type::unknown
+			&& mCaptured_slots->count(pNode->slot) == 0;
+	}
+
+	bool is_pure_call(AST_node_function_call* pNode) const
+	{
+		// Script functions could do anything
+		const AST_node_identifier* callee = as_identifier(pNode->children[0]);
+		return callee && callee->slot == unresolved_slot && is_pure_global(callee->identifier);
+	}
+
+	bool is_pure_member(std::string_view pName) const
+	{
+		// Members are found by name on the stack too
+		return mDeclared_names->count(pName) == 0 && is_pure_global(pName);
+	}
+
+	bool is_pure_global(std::string_view pName) const
+	{
+		const value_type* value = mFind_global(pName);
+		if (!value)
+			return false;
+		if (auto c = value->get<const callable>())
+			return c->is_pure;
+		if (auto overloader = value->get<const callable_overloader>())
+			return overloader->is_pure();
+		return false;
+	}
+
+private:
+	global_finder mFind_global;
+	// Every name the tree declares
+	const std::set<std::string_view>* mDeclared_names{ nullptr };
+	// The size of the frame of the function the loops being hoisted are in
+	std::uint32_t* mFrame_size{ nullptr };
+	// The locals of that function that other functions capture
+	const std::set<std::uint32_t>* mCaptured_slots{ nullptr };
+
+	// The names the loop being hoisted changes and declares
+	const std::set<std::string_view>* mMutated_names{ nullptr };
+	const std::set<std::string_view>* mLoop_names{ nullptr };
+	// True if the loop calls anything that could have side effects
+	bool mSide_effects{ false };
+};
+
+} // namespace wolfscript
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "token.hpp"
+#include "value_type.hpp"
+#include "callable.hpp"
+#include "cast.hpp"
+#include "exception.hpp"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+namespace wolfscript
+{
+
+// The functions of the binary operators of object_behavior, found in the
+// globals named after them. The overload for an operator and the types of
+// its operands is kept in a table with a slot for each operator and pair
+// of types, so it is only found once for them.
+class operator_table
+{
+public:
+	// Finds a global by name, nullptr if there is none
+	using global_finder = std::function<const value_type*(std::string_view)>;
+
+	struct entry
+	{
+		std::size_t op{ no_operator };
+		const std::type_info* left{ nullptr };
+		const std::type_info* right{ nullptr };
+		bool left_const{ false };
+		bool right_const{ false };
+		// nullptr if no function takes the operands
+		const callable* function{ nullptr };
+		// Empty where the operand is passed as it is
+		cast_function casts[2];
+
+		value_type call(const value_type& pL, const value_type& pR) const
+		{
+			arg_list args;
+			args.reserve(2);
+			args.push_back(casts[0] ? casts[0](function->parameter_types[0], pL) : pL);
+			args.push_back(casts[1] ? casts[1](function->parameter_types[1], pR) : pR);
+			return function->function(args);
+		}
+	};
+
+	operator_table(global_finder pFind_global) :
+		mFind_global(std::move(pFind_global))
+	{}
+
+	// Returns nullptr if no function is registered for the operator or
+	// none of them takes the operands. The operator is then run the
+	// normal way.
+	const entry* find(token_type pOp, const type_info& pL, const type_info& pR, const cast_list& pCast_list)
+	{
+		const std::size_t op = operator_index(pOp);
+		if (op == no_operator)
+			return nullptr;
+		update(op);
+		if (mOperators[op].overloads.empty())
+			return nullptr;
+
+		entry& found = mEntries[get_slot(op, pL, pR)];
+		if (found.op != op || found.left != pL.stdtypeinfo || found.right != pR.stdtypeinfo
+			|| found.left_const != pL.is_const || found.right_const != pR.is_const)
+		{
+			found = entry{};
+			found.op = op;
+			found.left = pL.stdtypeinfo;
+			found.right = pR.stdtypeinfo;
+			found.left_const = pL.is_const;
+			found.right_const = pR.is_const;
+			try
+			{
+				const std::vector<type_info> types = { pL, pR };
+				found.function = &mOperators[op].overloads.find(types, pCast_list);
+			}
+			catch (const exception::interpretor_error&)
+			{
+				// Left for the normal way to report
+				return nullptr;
+			}
+			if (found.function->parameter_types.size() == 2)
+			{
+				found.casts[0] = pCast_list.prepare(found.function->parameter_types[0], pL);
+				found.casts[1] = pCast_list.prepare(found.function->parameter_types[1], pR);
+			}
+		}
+		return found.function ? &found : nullptr;
+	}
+
+private:
+	// The functions of an operator as they were when the entries were found
+	struct operator_functions
+	{
+		// Where the functions are kept, found once the global exists
+		const value_type* global{ nullptr };
+		// The value the global had. It is kept so its data can't be taken
+		// by another.
+		value_type value;
+		// The version of the value if it is an overloader
+		std::uint32_t version{ 0 };
+		callable_overloader overloads;
+	};
+
+	// Takes the functions of an operator from its global again if the
+	// global was replaced or a function was added to it. Anything that
+	// isn't a function leaves the operator without any, like
+	// symbol_table::add.
+	void update(std::size_t pOp)
+	{
+		operator_functions& functions = mOperators[pOp];
+		if (!functions.global)
+			functions.global = mFind_global(object_behavior::from_token_type(operators[pOp]));
+		if (!functions.global)
+			return;
+
+		const value_type& current = *functions.global;
+		const callable_overloader* overloader = current.get<const callable_overloader>();
+		const std::uint32_t version = overloader ? overloader->get_version() : 0;
+		if (&current.get_data() == &functions.value.get_data() && version == functions.version)
+			return;
+
+		functions.value = current;
+		functions.version = version;
+		functions.overloads = callable_overloader{};
+		if (overloader)
+			functions.overloads.add(*overloader);
+		else if (current.get<const callable>())
+			functions.overloads.add(current);
+
+		// The overloads found before could be different now
+		mEntries.fill(entry{});
+	}
+
+	static constexpr std::size_t no_operator = static_cast<std::size_t>(-1);
+	static constexpr std::size_t operator_count = 9;
+	// Has to be a power of 2
+	static constexpr std::size_t slot_count = 256;
+	// The operators in the order of operator_index
+	static constexpr token_type operators[operator_count] = {
+		token_type::assign, token_type::add_assign, token_type::sub_assign,
+		token_type::mul_assign, token_type::div_assign, token_type::add,
+		token_type::sub, token_type::mul, token_type::div };
+
+	static std::size_t operator_index(token_type pOp)
+	{
+		switch (pOp)
+		{
+		case token_type::assign: return 0;
+		case token_type::add_assign: return 1;
+		case token_type::sub_assign: return 2;
+		case token_type::mul_assign: return 3;
+		case token_type::div_assign: return 4;
+		case token_type::add: return 5;
+		case token_type::sub: return 6;
+		case token_type::mul: return 7;
+		case token_type::div: return 8;
+		default: return no_operator;
+		}
+	}
+
+	static std::size_t get_slot(std::size_t pOp, const type_info& pL, const type_info& pR)
+	{
+		std::uintptr_t hash = reinterpret_cast<std::uintptr_t>(pL.stdtypeinfo) * 31
+			+ reinterpret_cast<std::uintptr_t>(pR.stdtypeinfo);
+		hash = hash * 31 + pOp * 4 + (pL.is_const ? 2 : 0) + (pR.is_const ? 1 : 0);
+		hash ^= hash >> 17;
+		hash ^= hash >> 7;
+		return hash & (slot_count - 1);
+	}
+
+private:
+	global_finder mFind_global;
+	std::array<operator_functions, operator_count> mOperators;
+	std::array<entry, slot_count> mEntries;
+};
+
+} // namespace wolfscript
@@ -1,87 +1,234 @@
 #pragma once
 
 #include "ast.hpp"
+#include "ast_arena.hpp"
+#include "tokenizer.hpp"
+#include "compact_tokens.hpp"
+#include "constant_pool.hpp"
 #include "exception.hpp"
 #include <memory>
 #include <iostream>
+#include <array>
 
 namespace wolfscript
 {
 
-template<typename Tto, typename Tfrom>
-std::unique_ptr<Tto> static_unique_pointer_cast(std::unique_ptr<Tfrom>&& pOld)
+namespace detail
 {
-	return std::unique_ptr<Tto>{ static_cast<Tto*>(pOld.release()) };
+
+// How the parser treats a token when it is used as an operator
+struct operator_binding
+{
+	token_type type;
+	// How tightly a binary operator binds, higher binds tighter.
+	// 0 if the token is not a binary operator.
+	unsigned char binary_power;
+	bool is_prefix;
+};
+
+// Every operator of an expression. All binary operators are left
+// associative.
+constexpr operator_binding operator_bindings[] =
+{
+	{ token_type::assign, 1, false },
+	{ token_type::add_assign, 1, false },
+	{ token_type::sub_assign, 1, false },
+	{ token_type::mul_assign, 1, false },
+	{ token_type::div_assign, 1, false },
+
+	{ token_type::logical_or, 2, false },
+
+	{ token_type::logical_and, 3, false },
+
+	{ token_type::equ, 4, false },
+	{ token_type::not_equ, 4, false },
+
+	{ token_type::less_than, 5, false },
+	{ token_type::less_than_equ_to, 5, false },
+	{ token_type::greater_than, 5, false },
+	{ token_type::greater_than_equ_to, 5, false },
+
+	{ token_type::add, 6, true },
+	{ token_type::sub, 6, true },
+
+	{ token_type::mul, 7, false },
+	{ token_type::div, 7, false },
+	{ token_type::mod, 7, false },
+
+	{ token_type::increment, 0, true },
+	{ token_type::decrement, 0, true },
+};
+
+constexpr std::array<operator_binding, static_cast<std::size_t>(token_type::count)> make_binding_table()
+{
+	std::array<operator_binding, static_cast<std::size_t>(token_type::count)> table{};
+	for (const auto& i : operator_bindings)
+		table[static_cast<std::size_t>(i.type)] = i;
+	return table;
+}
+
+// The operator_binding of each token_type, so the parser only needs
+// one lookup to know what to do with a token.
+constexpr std::array<operator_binding, static_cast<std::size_t>(token_type::count)> binding_table = make_binding_table();
+
+constexpr const operator_binding& binding_of(token_type pType)
+{
+	return binding_table[static_cast<std::size_t>(pType)];
 }
 
+} // namespace detail
+
 class parser
 {
 public:
-	std::unique_ptr<AST_node> parse(const token_array& pTokens)
+	AST_tree parse(const token_array& pTokens)
 	{
-		mTokens = pTokens;
-		mIter = mTokens.begin();
-		return parse_file();
+		token_array_source source(pTokens);
+		return parse(source);
+	}
+
+	AST_tree parse(const compact_token_array& pTokens)
+	{
+		try
+		{
+			compact_token_source source(pTokens);
+			return parse(source);
+		}
+		catch (exception::wolf_exception& e)
+		{
+			e.resolve_position(pTokens.lines());
+			throw;
+		}
+	}
+
+	// Parse directly from source text. Tokens are lexed on demand
+	// as the parser needs them so no token_array is ever built.
+	AST_tree parse(std::string_view pSource)
+	{
+		try
+		{
+			token_stream source(pSource);
+			return parse(source);
+		}
+		catch (exception::wolf_exception& e)
+		{
+			// Lines are only indexed when there is an error to report
+			e.resolve_position(line_index(pSource));
+			throw;
+		}
+	}
+
+	// Every node of the result is allocated in a new AST_arena which
+	// is owned by the returned tree.
+	AST_tree parse(token_source& pSource)
+	{
+		auto arena = std::make_unique<AST_arena>();
+		mArena = arena.get();
+		mSource = &pSource;
+		mCurrent = 0;
+		mList_stack.clear();
+		for (auto& i : mLookahead)
+			i = mSource->next();
+		AST_node* root = parse_file();
+		mSource = nullptr;
+		mArena = nullptr;
+		return AST_tree(std::move(arena), root);
+	}
+
+	// Same as above but also gives the offset of the first token of
+	// every top-level statement.
+	AST_tree parse(token_source& pSource, std::vector<std::uint32_t>& pStatement_offsets)
+	{
+		pStatement_offsets.clear();
+		mStatement_offsets = &pStatement_offsets;
+		try
+		{
+			auto result = parse(pSource);
+			mStatement_offsets = nullptr;
+			return result;
+		}
+		catch (...)
+		{
+			mStatement_offsets = nullptr;
+			throw;
+		}
 	}
 
 private:
-	std::unique_ptr<AST_node> parse_file()
+	AST_node* parse_file()
 	{
-		auto node = std::make_unique<AST_node_block>();
+		auto node = make_node<AST_node_block>();
+		const std::size_t first = mList_stack.size();
 		while (can_peek())
-			node->children.emplace_back(std::move(parse_statement()));
+		{
+			if (mStatement_offsets)
+				mStatement_offsets->push_back(current().offset);
+			mList_stack.push_back(parse_statement());
+		}
+		pop_list(node, first);
+		return node;
+	}
+
+	AST_node* parse_statement()
+	{
+		// Statements without a token of their own are located by their
+		// first token so the interpreter can report errors in them.
+		const std::uint32_t offset = current().offset;
+		auto node = parse_statement_impl();
+		if (node->offset == unknown_offset)
+			node->offset = offset;
 		return node;
 	}
 
-	std::unique_ptr<AST_node> parse_statement()
+	AST_node* parse_statement_impl()
 	{
-		if (mIter->type == token_type::l_brace)
+		if (current().type == token_type::l_brace)
 		{
 			return parse_compound_statement();
 		}
-		else if (mIter->type == token_type::kw_var ||
-			mIter->type == token_type::kw_const)
+		else if (current().type == token_type::kw_var ||
+			current().type == token_type::kw_const)
 		{
 			return parse_var();
 		}
-		else if (mIter->type == token_type::kw_if)
+		else if (current().type == token_type::kw_if)
 		{
 			return parse_if_statement();
 		}
-		else if (mIter->type == token_type::kw_return)
+		else if (current().type == token_type::kw_return)
 		{
 			return parse_return_statement();
 		}
-		else if (mIter->type == token_type::kw_function
+		else if (current().type == token_type::kw_function
 			&& can_peek() && peek()->type == token_type::identifier)
 		{
 			return parse_function_declaration(false);
 		}
-		else if (mIter->type == token_type::kw_for)
+		else if (current().type == token_type::kw_for)
 		{
 			return parse_for_statement();
 		}
-		else if (mIter->type == token_type::kw_while)
+		else if (current().type == token_type::kw_while)
 		{
 			return parse_while_statement();
 		}
-		else if (mIter->type == token_type::kw_break)
+		else if (current().type == token_type::kw_break)
 		{
 			advance(); // Skip break
 			expect(token_type::eol, "Expected ;");
 			advance(); // Skip ;
-			return std::make_unique<AST_node_break>();
+			return make_node<AST_node_break>();
 		}
-		else if (mIter->type == token_type::kw_continue)
+		else if (current().type == token_type::kw_continue)
 		{
 			advance(); // Skip continue
 			expect(token_type::eol, "Expected ;");
 			advance(); // Skip ;
-			return std::make_unique<AST_node_continue>();
+			return make_node<AST_node_continue>();
 		}
-		else if (mIter->type == token_type::eol)
+		else if (current().type == token_type::eol)
 		{
-			auto node = std::make_unique<AST_node_empty>();
+			auto node = make_node<AST_node_empty>();
 			advance(); // Skip ;
 			return node;
 		}
@@ -96,20 +243,22 @@ private:
 		}
 	}
 
-	std::unique_ptr<AST_node> parse_compound_statement()
+	AST_node* parse_compound_statement()
 	{
 		advance(); // Skip {
-		auto node = std::make_unique<AST_node_block>();
-		while (mIter->type != token_type::r_brace)
-			node->children.emplace_back(std::move(parse_statement()));
+		auto node = make_node<AST_node_block>();
+		const std::size_t first = mList_stack.size();
+		while (current().type != token_type::r_brace)
+			mList_stack.push_back(parse_statement());
+		pop_list(node, first);
 		advance(); // Skip }
 		return node;
 	}
 
-	std::unique_ptr<AST_node> parse_return_statement()
+	AST_node* parse_return_statement()
 	{
 		advance(); // Skip return
-		auto node = std::make_unique<AST_node_return>();
+		auto node = make_node<AST_node_return>();
 		node->children.emplace_back(parse_expression());
 		expect(token_type::eol, "Expected ;");
 		advance(); // Skip ;
@@ -117,15 +266,15 @@ private:
 	}
 
 	// TODO: Add node type
-	std::unique_ptr<AST_node> parse_if_statement()
+	AST_node* parse_if_statement()
 	{
-		auto node = std::make_unique<AST_node_if>();
+		auto node = make_node<AST_node_if>();
 
 		advance(); // Skip if
 		expect(token_type::l_parenthesis, "Expected ( for if statement conditional expression");
 		advance(); // Skip (
-		if (mIter->type == token_type::r_parenthesis)
-			throw exception::parse_error("Missing if statement conditional expression", *mIter);
+		if (current().type == token_type::r_parenthesis)
+			throw exception::parse_error("Missing if statement conditional expression", current());
 
 		node->children.emplace_back(parse_expression());
 
@@ -135,14 +284,14 @@ private:
 		node->children.emplace_back(parse_statement());
 
 		while (can_peek()
-			&& mIter->type == token_type::kw_else
+			&& current().type == token_type::kw_else
 			&& peek()->type == token_type::kw_if)
 		{
 			advance(2); // Skip else if
 			expect(token_type::l_parenthesis, "Expected ( for else if statement conditional expression");
 			advance(); // Skip (
-			if (mIter->type == token_type::r_parenthesis)
-				throw exception::parse_error("Missing if statement conditional expression", *mIter);
+			if (current().type == token_type::r_parenthesis)
+				throw exception::parse_error("Missing if statement conditional expression", current());
 
 			node->children.emplace_back(parse_expression());
 
@@ -154,7 +303,7 @@ private:
 			++node->elseif_count;
 		}
 
-		if (mIter->type == token_type::kw_else)
+		if (current().type == token_type::kw_else)
 		{
 			advance(); // Skip else
 			node->has_else = true;
@@ -164,23 +313,23 @@ private:
 		return node;
 	}
 
-	std::unique_ptr<AST_node> parse_for_statement()
+	AST_node* parse_for_statement()
 	{
-		auto node = std::make_unique<AST_node_for>();
+		auto node = make_node<AST_node_for>();
 
 		advance(); // Skip for
 		expect(token_type::l_parenthesis, "Expected ( for 'for' statement");
 		advance(); // Skip (
-		if (mIter->type == token_type::r_parenthesis)
-			throw exception::parse_error("Missing 'for' statement expression", *mIter);
+		if (current().type == token_type::r_parenthesis)
+			throw exception::parse_error("Missing 'for' statement expression", current());
 
 		// Var statement/expression
-		if (mIter->type == token_type::eol)
+		if (current().type == token_type::eol)
 		{
-			node->children.emplace_back(std::make_unique<AST_node_empty>());
+			node->children.emplace_back(make_node<AST_node_empty>());
 			advance(); // Skip ;
 		}
-		else if (mIter->type == token_type::kw_var)
+		else if (current().type == token_type::kw_var)
 		{
 			node->children.emplace_back(parse_var()); // Already checks for ;
 		}
@@ -192,9 +341,9 @@ private:
 		}
 
 		// Conditional
-		if (mIter->type == token_type::eol)
+		if (current().type == token_type::eol)
 		{
-			node->children.emplace_back(std::make_unique<AST_node_empty>());
+			node->children.emplace_back(make_node<AST_node_empty>());
 		}
 		else
 		{
@@ -204,9 +353,9 @@ private:
 		advance(); // Skip ;
 
 		// Looped expression
-		if (mIter->type == token_type::r_parenthesis)
+		if (current().type == token_type::r_parenthesis)
 		{
-			node->children.emplace_back(std::make_unique<AST_node_empty>());
+			node->children.emplace_back(make_node<AST_node_empty>());
 		}
 		else
 		{
@@ -220,17 +369,18 @@ private:
 		return node;
 	}
 
-	std::unique_ptr<AST_node> parse_while_statement()
+	AST_node* parse_while_statement()
 	{
-		auto node = std::make_unique<AST_node_while>();
+		auto node = make_node<AST_node_while>();
 
 		advance(); // Skip while
 		expect(token_type::l_parenthesis, "Expected ( for 'while' statement");
 		advance(); // Skip (
-		if (mIter->type == token_type::r_parenthesis)
-			throw exception::parse_error("Missing 'while' statement expression", *mIter);
+		if (current().type == token_type::r_parenthesis)
+			throw exception::parse_error("Missing 'while' statement expression", current());
 
-		node->children.emplace_back(parse_equality());
+		// The condition only takes equality and tighter operators
+		node->children.emplace_back(parse_expression(detail::binding_of(token_type::equ).binary_power));
 		expect(token_type::r_parenthesis, "Missing ) for 'while' statement");
 		advance(); // Skip )
 
@@ -239,23 +389,23 @@ private:
 		return node;
 	}
 
-	std::unique_ptr<AST_node> parse_var()
+	AST_node* parse_var()
 	{
-		auto node = std::make_unique<AST_node_variable>();
+		auto node = make_node<AST_node_variable>();
 
-		node->is_const = mIter->type == token_type::kw_const;
+		node->is_const = current().type == token_type::kw_const;
 		advance(); // Skip var/const
 
 		// Get the identifier
 		expect(token_type::identifier, "Expected identifier for variable");
-		node->identifier = mIter->text;
+		node->identifier = current().text;
 		advance(); // Skip identifier
 
 		// Check for =
 		expect(token_type::assign, "Expected =");
 		advance(); // Skip =
 
-		node->children.emplace_back(std::move(parse_expression()));
+		node->children.emplace_back(parse_expression());
 
 		expect(token_type::eol, "Expected ;");
 		advance(); // Skip ;
@@ -263,94 +413,50 @@ private:
 		return node;
 	}
 
-	// Helper function for binary expressions since they are defined in mostly the same way.
-	std::unique_ptr<AST_node> parse_binary_expression(const std::set<token_type>& pOps,
-		std::unique_ptr<AST_node>(parser::*pChild_func)())
+	// Parses binary operations by precedence climbing over
+	// detail::binding_table. Only operators that bind tighter than
+	// pMin_power are taken, the rest are left for the caller.
+	AST_node* parse_expression(unsigned int pMin_power = 1)
 	{
-		auto node = (this->*pChild_func)();
-		while (pOps.find(mIter->type) != pOps.end())
-		{
-			auto op_node = std::make_unique<AST_node_binary_op>();
-			op_node->related_token = *mIter;
-			op_node->type = mIter->type;
-			op_node->children.emplace_back(std::move(node));
+		auto node = parse_postfix_expression();
+		while (true)
+		{
+			const unsigned int power = detail::binding_of(current().type).binary_power;
+			if (power == 0 || power < pMin_power)
+				return node;
+			auto op_node = make_node<AST_node_binary_op>();
+			op_node->offset = current().offset;
+			op_node->type = current().type;
+			op_node->children.emplace_back(node);
 			advance(); // Skip op
-			op_node->children.emplace_back((this->*pChild_func)());
-			node = std::move(static_unique_pointer_cast<AST_node>(std::move(op_node)));
+			// The right side only takes operators that bind tighter
+			// so operators of the same power group to the left.
+			op_node->children.emplace_back(parse_expression(power + 1));
+			node = op_node;
 		}
-		return node;
-	}
-
-	std::unique_ptr<AST_node> parse_expression()
-	{
-		return parse_binary_expression({ token_type::add, token_type::sub }, &parser::parse_assignment);
-	}
-
-	std::unique_ptr<AST_node> parse_assignment()
-	{
-		return parse_binary_expression({ token_type::assign,
-			token_type::add_assign, token_type::sub_assign,
-			token_type::mul_assign, token_type::div_assign },
-			&parser::parse_logical_or);
 	}
 
-	std::unique_ptr<AST_node> parse_logical_or()
-	{
-		return parse_binary_expression({ token_type::logical_or }, &parser::parse_logical_and);
-	}
-
-	std::unique_ptr<AST_node> parse_logical_and()
-	{
-		return parse_binary_expression({ token_type::logical_and }, &parser::parse_equality);
-	}
-
-	std::unique_ptr<AST_node> parse_equality()
-	{
-		return parse_binary_expression({ token_type::equ, token_type::not_equ }, &parser::parse_relational);
-	}
-
-	std::unique_ptr<AST_node> parse_relational()
-	{
-		return parse_binary_expression(
-			{
-				token_type::less_than,
-				token_type::less_than_equ_to,
-				token_type::greater_than,
-				token_type::greater_than_equ_to
-			}, &parser::parse_additive_expression);
-	}
-
-	std::unique_ptr<AST_node> parse_additive_expression()
-	{
-		return parse_binary_expression({ token_type::add, token_type::sub }, &parser::parse_multiplicative_expression);
-	}
-
-	std::unique_ptr<AST_node> parse_multiplicative_expression()
-	{
-		return parse_binary_expression({ token_type::mul, token_type::div, token_type::mod }, &parser::parse_postfix_expression);
-	}
-
-	std::unique_ptr<AST_node> parse_postfix_expression()
+	AST_node* parse_postfix_expression()
 	{
 		auto node = parse_factor();
 
 		bool has_postfix = false;
 		do {
 			has_postfix = false;
-			if (mIter->type == token_type::period)
+			if (current().type == token_type::period)
 			{
 				advance(); // Skip .
 				expect(token_type::identifier, "Expected identifier");
-				auto access_node = std::make_unique<AST_node_member_accessor>();
-				access_node->identifier = mIter->text;
-				access_node->children.emplace_back(std::move(node));
-				node = std::move(access_node);
+				auto access_node = make_node<AST_node_member_accessor>();
+				access_node->identifier = current().text;
+				access_node->children.emplace_back(node);
+				node = access_node;
 				advance(); // Skip identifier
 				has_postfix = true;
 			}
-			else if (mIter->type == token_type::l_parenthesis)
+			else if (current().type == token_type::l_parenthesis)
 			{
-				node = parse_function_call(std::move(node));
+				node = parse_function_call(node);
 				has_postfix = true;
 			}
 		} while (has_postfix);
@@ -358,14 +464,14 @@ private:
 		return node;
 	}
 
-	std::unique_ptr<AST_node> parse_function_call(std::unique_ptr<AST_node> pCaller)
+	AST_node* parse_function_call(AST_node* pCaller)
 	{
-		auto node = std::make_unique<AST_node_function_call>();
-		node->children.emplace_back(std::move(pCaller));
+		auto node = make_node<AST_node_function_call>();
+		node->children.emplace_back(pCaller);
 		advance(); // Skip (
 
 		// No arguments
-		if (mIter->type == token_type::r_parenthesis)
+		if (current().type == token_type::r_parenthesis)
 		{
 			advance(); // Skip )
 			return node;
@@ -374,7 +480,7 @@ private:
 		// First parameter
 		node->children.emplace_back(parse_expression());
 
-		while (mIter->type == token_type::separator)
+		while (current().type == token_type::separator)
 		{
 			advance(); // Skip ,
 			node->children.emplace_back(parse_expression());
@@ -386,21 +492,18 @@ private:
 		return node;
 	}
 
-	std::unique_ptr<AST_node> parse_factor()
+	AST_node* parse_factor()
 	{
-		if (mIter->type == token_type::add
-			|| mIter->type == token_type::sub
-			|| mIter->type == token_type::increment
-			|| mIter->type == token_type::decrement)
-		{
-			auto node = std::make_unique<AST_node_unary_op>();
-			node->related_token = *mIter;
-			node->type = mIter->type;
+		if (detail::binding_of(current().type).is_prefix)
+		{
+			auto node = make_node<AST_node_unary_op>();
+			node->offset = current().offset;
+			node->type = current().type;
 			advance(); // Skip +/-/++/--
 			node->children.emplace_back(parse_factor());
 			return node;
 		}
-		else if (mIter->type == token_type::l_parenthesis)
+		else if (current().type == token_type::l_parenthesis)
 		{
 			advance(); // Skip (
 			auto node = parse_expression();
@@ -408,68 +511,70 @@ private:
 			advance(); // Skip )
 			return node;
 		}
-		else if (mIter->type == token_type::integer ||
-			mIter->type == token_type::floating ||
-			mIter->type == token_type::string)
+		else if (current().type == token_type::integer ||
+			current().type == token_type::floating ||
+			current().type == token_type::string)
 		{
-			auto node = std::make_unique<AST_node_constant>();
-			node->related_token = *mIter;
+			auto node = make_node<AST_node_constant>();
+			node->offset = current().offset;
+			node->value = &mArena->constants()[add_constant(current())];
+			node->text = current().text;
 			advance();
 			return node;
 		}
-		else if (mIter->type == token_type::identifier)
+		else if (current().type == token_type::identifier)
 		{
-			auto node = std::make_unique<AST_node_identifier>();
-			node->related_token = *mIter;
-			node->identifier = mIter->text;
+			auto node = make_node<AST_node_identifier>();
+			node->offset = current().offset;
+			node->identifier = current().text;
 			advance();
 			return node;
 		}
-		else if (mIter->type == token_type::kw_function)
+		else if (current().type == token_type::kw_function)
 		{
 			return parse_function_declaration(true);
 		}
 		else
-			throw exception::parse_error("Unexpected token", *mIter);
+			throw exception::parse_error("Unexpected token", current());
 	}
 
 	AST_node_function_declaration::param parse_parameter()
 	{
 		AST_node_function_declaration::param param;
-		if (mIter->type == token_type::kw_const)
+		if (current().type == token_type::kw_const)
 		{
 			param.is_const = true;
 			advance(); // Skip const
 		}
 		expect(token_type::identifier, "Expected identifier for parameter");
-		param.identifier = mIter->text;
+		param.identifier = current().text;
 		advance(); // Skip identifier
-		if (mIter->type == token_type::identifier)
+		if (current().type == token_type::identifier)
 		{
 			param.has_type = true;
-			param.type = *mIter;
+			param.type = current();
 			advance(); // Skip type identifier
 		}
 		return param;
 	}
 
-	std::unique_ptr<AST_node> parse_function_declaration(bool pAnonymous)
+	AST_node* parse_function_declaration(bool pAnonymous)
 	{
-		auto node = std::make_unique<AST_node_function_declaration>();
-		node->related_token = *mIter;
+		auto node = make_node<AST_node_function_declaration>();
+		node->offset = current().offset;
 		advance(); // Skip function
 		if (!pAnonymous)
 		{
 			expect(token_type::identifier, "Expected function identifier");
-			node->identifier = mIter->text;
+			node->identifier = current().text;
 			advance(); // Skip identifier
 		}
 		expect(token_type::l_parenthesis, "Expected (");
 		advance(); // Skip (
-		if (mIter->type != token_type::r_parenthesis)
+		if (current().type != token_type::r_parenthesis)
 		{
 			node->parameters.emplace_back(parse_parameter());
-			while (mIter->type == token_type::separator)
+			while (current().type == token_type::separator)
 			{
 				advance(); // Skip ,
 				node->parameters.emplace_back(parse_parameter());
@@ -477,10 +582,10 @@ private:
 		}
 		expect(token_type::r_parenthesis, "Expected ) for function");
 		advance(); // Skip )
-		if (mIter->type == token_type::identifier)
+		if (current().type == token_type::identifier)
 		{
 			node->has_return_type = true;
-			node->return_type = *mIter;
+			node->return_type = current();
 			advance(); // Skip type identifier
 		}
 
@@ -489,33 +594,82 @@ private:
 		return node;
 	}
 
+	std::size_t add_constant(const token& pToken)
+	{
+		switch (pToken.type)
+		{
+		case token_type::integer:
+			return mArena->constants().add(std::get<int>(pToken.value));
+		case token_type::floating:
+			return mArena->constants().add(std::get<float>(pToken.value));
+		case token_type::string:
+			detail::unescape_string(pToken.text, mString_buffer);
+			return mArena->constants().add(mString_buffer);
+		default:
+			throw exception::parse_error("Unsupported constant type", pToken);
+		}
+	}
+
 	void expect(token_type pToken, const char* pMsg) const
 	{
-		if (mIter->type != pToken)
-			throw exception::parse_error(pMsg, *mIter);
+		if (current().type != pToken)
+			throw exception::parse_error(pMsg, current());
 	}
 
 	void advance(std::size_t count = 1)
 	{
-		mIter += count;
-		if (mIter == mTokens.end())
-			throw exception::parse_error("Unexpected end of file", *mIter);
+		for (std::size_t i = 0; i < count; i++)
+		{
+			if (current().type == token_type::eof)
+				throw exception::parse_error("Unexpected end of file", current());
+			// The slot of the current token is refilled with the
+			// token furthest ahead.
+			mLookahead[mCurrent] = mSource->next();
+			mCurrent = (mCurrent + 1) % mLookahead.size();
+		}
+	}
+
+	template <typename T>
+	T* make_node()
+	{
+		return mArena->create<T>();
+	}
+
+	// Moves the nodes pushed since pFirst into the children of pNode
+	void pop_list(AST_node* pNode, std::size_t pFirst)
+	{
+		pNode->children.assign(mList_stack.begin() + pFirst, mList_stack.end());
+		mList_stack.resize(pFirst);
+	}
+
+	const token& current() const
+	{
+		return mLookahead[mCurrent];
 	}
 
 	bool can_peek() const
 	{
-		return mIter != mTokens.end() &&
-			++token_iterator(mIter) != mTokens.end();
+		return current().type != token_type::eof;
 	}
 
-	token_iterator peek() const
+	const token* peek() const
 	{
-		return ++token_iterator(mIter);
+		return &mLookahead[(mCurrent + 1) % mLookahead.size()];
 	}
 
 private:
-	token_array mTokens;
-	token_iterator mIter;
+	// The parser never looks more than one token ahead of the current one.
+	std::array<token, 2> mLookahead;
+	std::size_t mCurrent{ 0 };
+	token_source* mSource{ nullptr };
+	std::vector<std::uint32_t>* mStatement_offsets{ nullptr };
+
+	// Owns the nodes and literals of the file being parsed
+	AST_arena* mArena{ nullptr };
+	std::string mString_buffer;
+	// Lists of statements are gathered here first so they only get
+	// allocated in the arena once they have their final size.
+	std::vector<AST_node*> mList_stack;
 };
 
 } // namespace wolfscript
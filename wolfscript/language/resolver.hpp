@@ -0,0 +1,255 @@
+#pragma once
+
+#include "ast.hpp"
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace wolfscript
+{
+
+// Gives every local a slot in the frame of the function it is declared in,
+// and every name that refers to one a (depth, slot) address so the
+// interpreter can find it by index instead of by name. The depth is how
+// many functions out the local was declared.
+//
+// The bodies of functions are resolved at the end of the scope they are
+// declared in so they can see everything declared in it, like a function
+// declared after them. A name that isn't a local of any function around
+// it is left unresolved and is looked up by name, like a global.
+//
+// A local of a function further out is captured by the function the name
+// is used in, and by every function in between, so each function only
+// needs the variables it captured when it was declared.
+class resolver :
+	private AST_walker
+{
+public:
+	// Resolves a tree as the body of a function without parameters.
+	// Returns the size of its frame.
+	std::uint32_t resolve(AST_node* pRoot)
+	{
+		mBindings.clear();
+		mLocals.clear();
+		mScopes.clear();
+		mFunctions.clear();
+		mBodies.clear();
+		push_function();
+		pRoot->visit(this);
+		return pop_function();
+	}
+
+	// Calls pCallable with every name the last tree declared a local with
+	template <typename T>
+	void for_each_name(T&& pCallable) const
+	{
+		for (const auto& i : mBindings)
+			pCallable(i.first);
+	}
+
+private:
+	struct binding
+	{
+		std::uint32_t slot;
+		// Index of the scope in mScopes
+		std::uint32_t scope;
+	};
+
+	struct scope
+	{
+		// Index of the first local of the scope in mLocals
+		std::size_t first_local;
+		std::uint32_t first_slot;
+		// Index of the function in mFunctions
+		std::uint32_t function;
+	};
+
+	struct function
+	{
+		std::uint32_t frame_size{ 0 };
+		// Not set for the root
+		AST_node_function_declaration* node{ nullptr };
+		// The index in the captures of the node for each local it captured,
+		// keyed by the index of the function and the slot of the local
+		std::unordered_map<std::uint64_t, std::uint32_t> captures;
+	};
+
+	struct body
+	{
+		AST_node_function_declaration* node;
+		// Index of the scope the function is declared in
+		std::uint32_t scope;
+	};
+
+private:
+	virtual void dispatch(AST_node_block* pNode) override
+	{
+		push_scope();
+		AST_walker::dispatch(pNode);
+		pNode->locals = pop_scope();
+	}
+
+	virtual void dispatch(AST_node_variable* pNode) override
+	{
+		// The value is resolved first since it can't see the variable
+		AST_walker::dispatch(pNode);
+		pNode->slot = declare(pNode->identifier);
+	}
+
+	virtual void dispatch(AST_node_identifier* pNode) override
+	{
+		auto iter = mBindings.find(pNode->identifier);
+		if (iter == mBindings.end() || iter->second.empty())
+		{
+			pNode->depth = 0;
+			pNode->slot = unresolved_slot;
+			return;
+		}
+		const binding& b = iter->second.back();
+		const std::uint32_t function = mScopes[b.scope].function;
+		pNode->depth = static_cast<std::uint32_t>(mFunctions.size() - 1) - function;
+		pNode->slot = b.slot;
+		if (pNode->depth > 0)
+			pNode->capture = capture(function, b.slot, static_cast<std::uint32_t>(mFunctions.size() - 1));
+	}
+
+	virtual void dispatch(AST_node_for* pNode) override
+	{
+		push_scope();
+		for (std::size_t i = 0; i < 3; i++)
+			pNode->children[i]->visit(this);
+		push_scope();
+		pNode->children[3]->visit(this);
+		pNode->body_locals = pop_scope();
+		pNode->locals = pop_scope();
+	}
+
+	virtual void dispatch(AST_node_while* pNode) override
+	{
+		pNode->children[0]->visit(this);
+		push_scope();
+		pNode->children[1]->visit(this);
+		pNode->body_locals = pop_scope();
+	}
+
+	virtual void dispatch(AST_node_function_declaration* pNode) override
+	{
+		if (!pNode->identifier.empty())
+			pNode->slot = declare(pNode->identifier);
+		mBodies.push_back({ pNode, static_cast<std::uint32_t>(mScopes.size() - 1) });
+	}
+
+private:
+	void resolve_body(AST_node_function_declaration* pNode)
+	{
+		pNode->captures.clear();
+		push_function(pNode);
+		// Each parameter gets its own slot, even if a name is repeated
+		for (const auto& i : pNode->parameters)
+			add_local(i.identifier);
+		AST_walker::dispatch(pNode);
+		pNode->frame_size = pop_function();
+	}
+
+	void push_function(AST_node_function_declaration* pNode = nullptr)
+	{
+		mFunctions.emplace_back().node = pNode;
+		push_scope();
+	}
+
+	// Returns the size of the frame
+	std::uint32_t pop_function()
+	{
+		pop_scope();
+		const std::uint32_t size = mFunctions.back().frame_size;
+		mFunctions.pop_back();
+		return size;
+	}
+
+	void push_scope()
+	{
+		const std::uint32_t function = static_cast<std::uint32_t>(mFunctions.size() - 1);
+		mScopes.push_back({ mLocals.size(), mFunctions.back().frame_size, function });
+	}
+
+	slot_range pop_scope()
+	{
+		// The functions declared in the scope are resolved before anything
+		// in it goes out of scope. Any function declared in their bodies
+		// is resolved and removed before they return.
+		const std::uint32_t index = static_cast<std::uint32_t>(mScopes.size() - 1);
+		std::size_t first = mBodies.size();
+		while (first > 0 && mBodies[first - 1].scope == index)
+			--first;
+		for (std::size_t i = first; i < mBodies.size(); i++)
+			resolve_body(mBodies[i].node);
+		mBodies.resize(first);
+
+		const scope s = mScopes.back();
+		mScopes.pop_back();
+		for (std::size_t i = mLocals.size(); i > s.first_local; i--)
+			mLocals[i - 1]->pop_back();
+		mLocals.resize(s.first_local);
+		return { s.first_slot, mFunctions.back().frame_size };
+	}
+
+	// Returns the capture of the function pUser for the local of the
+	// function pOwner, which is further out
+	std::uint32_t capture(std::uint32_t pOwner, std::uint32_t pSlot, std::uint32_t pUser)
+	{
+		function& user = mFunctions[pUser];
+		const std::uint64_t key = (static_cast<std::uint64_t>(pOwner) << 32) | pSlot;
+		if (auto iter = user.captures.find(key); iter != user.captures.end())
+			return iter->second;
+
+		// The function in between has to capture it too
+		AST_capture c;
+		if (pUser - 1 == pOwner)
+			c = { pSlot, false };
+		else
+			c = { capture(pOwner, pSlot, pUser - 1), true };
+		const std::uint32_t index = static_cast<std::uint32_t>(user.node->captures.size());
+		user.node->captures.push_back(c);
+		user.captures.emplace(key, index);
+		return index;
+	}
+
+	// Slots are never shared so a function resolved at the end of a scope
+	// can't find another local in the slot of one declared after it.
+	std::uint32_t add_local(std::string_view pName)
+	{
+		return add_local(mBindings[pName]);
+	}
+
+	std::uint32_t add_local(std::vector<binding>& pBindings)
+	{
+		const std::uint32_t slot = mFunctions.back().frame_size++;
+		pBindings.push_back({ slot, static_cast<std::uint32_t>(mScopes.size() - 1) });
+		mLocals.push_back(&pBindings);
+		return slot;
+	}
+
+	// Declaring a name again in the same scope gives the same slot
+	std::uint32_t declare(std::string_view pName)
+	{
+		auto& bindings = mBindings[pName];
+		if (!bindings.empty() && bindings.back().scope == mScopes.size() - 1)
+			return bindings.back().slot;
+		return add_local(bindings);
+	}
+
+private:
+	// The bindings of each name from the outermost to the innermost.
+	// Names are never removed so their lists stay where they are.
+	std::unordered_map<std::string_view, std::vector<binding>> mBindings;
+	// The bindings added by the open scopes, in order
+	std::vector<std::vector<binding>*> mLocals;
+	std::vector<scope> mScopes;
+	std::vector<function> mFunctions;
+	// Functions waiting for the end of their scope
+	std::vector<body> mBodies;
+};
+
+} // namespace wolfscript
@@ -0,0 +1,342 @@
+#pragma once
+
+#include <cstddef>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define WOLFSCRIPT_SCAN_X86_64
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC allows AVX2 intrinsics anywhere, GCC and Clang need the
+// functions using them to be marked.
+#if defined(WOLFSCRIPT_SCAN_X86_64) && !defined(_MSC_VER)
+#define WOLFSCRIPT_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define WOLFSCRIPT_TARGET_AVX2
+#endif
+
+namespace wolfscript
+{
+
+// The instruction sets the tokenizer can use for scanning text
+enum class scan_isa
+{
+	scalar,
+	sse2,
+	avx2,
+};
+
+namespace detail
+{
+
+// Each of these kernels scans pLength bytes at pStr and returns the
+// index of the first byte it is looking for, or pLength if there is none.
+struct scan_kernels
+{
+	// First byte that isn't ' ', '\t', '\n', or '\r'
+	std::size_t(*find_non_whitespace)(const char* pStr, std::size_t pLength);
+	// First byte that isn't a letter, digit, or '_'
+	std::size_t(*find_identifier_end)(const char* pStr, std::size_t pLength);
+	// First '"' or '\\'
+	std::size_t(*find_string_special)(const char* pStr, std::size_t pLength);
+	// The '*' of the first "*/"
+	std::size_t(*find_comment_end)(const char* pStr, std::size_t pLength);
+};
+
+namespace scalar_scan
+{
+
+inline std::size_t find_non_whitespace(const char* pStr, std::size_t pLength)
+{
+	std::size_t i = 0;
+	for (; i < pLength; i++)
+	{
+		const char c = pStr[i];
+		if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+			break;
+	}
+	return i;
+}
+
+inline std::size_t find_identifier_end(const char* pStr, std::size_t pLength)
+{
+	std::size_t i = 0;
+	for (; i < pLength; i++)
+	{
+		const char c = pStr[i];
+		if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+			(c >= '0' && c <= '9') || c == '_'))
+			break;
+	}
+	return i;
+}
+
+inline std::size_t find_string_special(const char* pStr, std::size_t pLength)
+{
+	std::size_t i = 0;
+	for (; i < pLength; i++)
+		if (pStr[i] == '\"' || pStr[i] == '\\')
+			break;
+	return i;
+}
+
+inline std::size_t find_comment_end(const char* pStr, std::size_t pLength)
+{
+	for (std::size_t i = 0; i + 1 < pLength; i++)
+		if (pStr[i] == '*' && pStr[i + 1] == '/')
+			return i;
+	return pLength;
+}
+
+constexpr scan_kernels kernels =
+{
+	&find_non_whitespace,
+	&find_identifier_end,
+	&find_string_special,
+	&find_comment_end,
+};
+
+} // namespace scalar_scan
+
+#ifdef WOLFSCRIPT_SCAN_X86_64
+
+inline unsigned int count_trailing_zeros(unsigned int pBits)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, pBits);
+	return static_cast<unsigned int>(index);
+#else
+	return static_cast<unsigned int>(__builtin_ctz(pBits));
+#endif
+}
+
+// Classifying the characters of an identifier with only signed byte
+// comparisons is done by shifting each range down to start at -128,
+// then checking the whole range with a single compare.
+constexpr char identifier_letter_offset = static_cast<char>(-128 - 'a');
+constexpr char identifier_letter_limit = static_cast<char>(-128 + 26);
+constexpr char identifier_digit_offset = static_cast<char>(-128 - '0');
+constexpr char identifier_digit_limit = static_cast<char>(-128 + 10);
+
+namespace sse2_scan
+{
+
+inline std::size_t find_non_whitespace(const char* pStr, std::size_t pLength)
+{
+	std::size_t i = 0;
+	for (; i + 16 <= pLength; i += 16)
+	{
+		const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pStr + i));
+		const __m128i whitespace = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\t'))),
+			_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\r'))));
+		const unsigned int bits = ~static_cast<unsigned int>(_mm_movemask_epi8(whitespace)) & 0xFFFF;
+		if (bits != 0)
+			return i + count_trailing_zeros(bits);
+	}
+	return i + scalar_scan::find_non_whitespace(pStr + i, pLength - i);
+}
+
+inline std::size_t find_identifier_end(const char* pStr, std::size_t pLength)
+{
+	std::size_t i = 0;
+	for (; i + 16 <= pLength; i += 16)
+	{
+		const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pStr + i));
+		const __m128i lower = _mm_or_si128(block, _mm_set1_epi8(0x20));
+		const __m128i letter = _mm_cmplt_epi8(_mm_add_epi8(lower, _mm_set1_epi8(identifier_letter_offset)),
+			_mm_set1_epi8(identifier_letter_limit));
+		const __m128i digit = _mm_cmplt_epi8(_mm_add_epi8(block, _mm_set1_epi8(identifier_digit_offset)),
+			_mm_set1_epi8(identifier_digit_limit));
+		const __m128i underscore = _mm_cmpeq_epi8(block, _mm_set1_epi8('_'));
+		const __m128i valid = _mm_or_si128(_mm_or_si128(letter, digit), underscore);
+		const unsigned int bits = ~static_cast<unsigned int>(_mm_movemask_epi8(valid)) & 0xFFFF;
+		if (bits != 0)
+			return i + count_trailing_zeros(bits);
+	}
+	return i + scalar_scan::find_identifier_end(pStr + i, pLength - i);
+}
+
+inline std::size_t find_string_special(const char* pStr, std::size_t pLength)
+{
+	std::size_t i = 0;
+	for (; i + 16 <= pLength; i += 16)
+	{
+		const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pStr + i));
+		const __m128i special = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\"')),
+			_mm_cmpeq_epi8(block, _mm_set1_epi8('\\')));
+		const unsigned int bits = static_cast<unsigned int>(_mm_movemask_epi8(special));
+		if (bits != 0)
+			return i + count_trailing_zeros(bits);
+	}
+	return i + scalar_scan::find_string_special(pStr + i, pLength - i);
+}
+
+inline std::size_t find_comment_end(const char* pStr, std::size_t pLength)
+{
+	// Each block is compared against the same block shifted by one byte
+	std::size_t i = 0;
+	for (; i + 17 <= pLength; i += 16)
+	{
+		const __m128i star = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pStr + i)), _mm_set1_epi8('*'));
+		const __m128i slash = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pStr + i + 1)), _mm_set1_epi8('/'));
+		const unsigned int bits = static_cast<unsigned int>(_mm_movemask_epi8(_mm_and_si128(star, slash)));
+		if (bits != 0)
+			return i + count_trailing_zeros(bits);
+	}
+	return i + scalar_scan::find_comment_end(pStr + i, pLength - i);
+}
+
+constexpr scan_kernels kernels =
+{
+	&find_non_whitespace,
+	&find_identifier_end,
+	&find_string_special,
+	&find_comment_end,
+};
+
+} // namespace sse2_scan
+
+namespace avx2_scan
+{
+
+inline WOLFSCRIPT_TARGET_AVX2 std::size_t find_non_whitespace(const char* pStr, std::size_t pLength)
+{
+	std::size_t i = 0;
+	for (; i + 32 <= pLength; i += 32)
+	{
+		const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pStr + i));
+		const __m256i whitespace = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t'))),
+			_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\r'))));
+		const unsigned int bits = ~static_cast<unsigned int>(_mm256_movemask_epi8(whitespace));
+		if (bits != 0)
+			return i + count_trailing_zeros(bits);
+	}
+	return i + sse2_scan::find_non_whitespace(pStr + i, pLength - i);
+}
+
+inline WOLFSCRIPT_TARGET_AVX2 std::size_t find_identifier_end(const char* pStr, std::size_t pLength)
+{
+	std::size_t i = 0;
+	for (; i + 32 <= pLength; i += 32)
+	{
+		const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pStr + i));
+		const __m256i lower = _mm256_or_si256(block, _mm256_set1_epi8(0x20));
+		const __m256i letter = _mm256_cmpgt_epi8(_mm256_set1_epi8(identifier_letter_limit),
+			_mm256_add_epi8(lower, _mm256_set1_epi8(identifier_letter_offset)));
+		const __m256i digit = _mm256_cmpgt_epi8(_mm256_set1_epi8(identifier_digit_limit),
+			_mm256_add_epi8(block, _mm256_set1_epi8(identifier_digit_offset)));
+		const __m256i underscore = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('_'));
+		const __m256i valid = _mm256_or_si256(_mm256_or_si256(letter, digit), underscore);
+		const unsigned int bits = ~static_cast<unsigned int>(_mm256_movemask_epi8(valid));
+		if (bits != 0)
+			return i + count_trailing_zeros(bits);
+	}
+	return i + sse2_scan::find_identifier_end(pStr + i, pLength - i);
+}
+
+inline WOLFSCRIPT_TARGET_AVX2 std::size_t find_string_special(const char* pStr, std::size_t pLength)
+{
+	std::size_t i = 0;
+	for (; i + 32 <= pLength; i += 32)
+	{
+		const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pStr + i));
+		const __m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\"')),
+			_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\\')));
+		const unsigned int bits = static_cast<unsigned int>(_mm256_movemask_epi8(special));
+		if (bits != 0)
+			return i + count_trailing_zeros(bits);
+	}
+	return i + sse2_scan::find_string_special(pStr + i, pLength - i);
+}
+
+inline WOLFSCRIPT_TARGET_AVX2 std::size_t find_comment_end(const char* pStr, std::size_t pLength)
+{
+	std::size_t i = 0;
+	for (; i + 33 <= pLength; i += 32)
+	{
+		const __m256i star = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pStr + i)), _mm256_set1_epi8('*'));
+		const __m256i slash = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pStr + i + 1)), _mm256_set1_epi8('/'));
+		const unsigned int bits = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_and_si256(star, slash)));
+		if (bits != 0)
+			return i + count_trailing_zeros(bits);
+	}
+	return i + sse2_scan::find_comment_end(pStr + i, pLength - i);
+}
+
+constexpr scan_kernels kernels =
+{
+	&find_non_whitespace,
+	&find_identifier_end,
+	&find_string_special,
+	&find_comment_end,
+};
+
+} // namespace avx2_scan
+
+inline bool cpu_supports_avx2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	// The OS must also save the AVX registers (OSXSAVE and XCR0)
+	if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0x6) != 0x6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // WOLFSCRIPT_SCAN_X86_64
+
+inline scan_isa detect_scan_isa()
+{
+#ifdef WOLFSCRIPT_SCAN_X86_64
+	return cpu_supports_avx2() ? scan_isa::avx2 : scan_isa::sse2;
+#else
+	return scan_isa::scalar;
+#endif
+}
+
+// Returns the kernels for an instruction set, or the best supported
+// ones if it isn't available.
+inline const scan_kernels& get_scan_kernels(scan_isa pIsa)
+{
+#ifdef WOLFSCRIPT_SCAN_X86_64
+	static const bool has_avx2 = cpu_supports_avx2();
+	if (pIsa == scan_isa::avx2 && has_avx2)
+		return avx2_scan::kernels;
+	if (pIsa != scan_isa::scalar)
+		return sse2_scan::kernels;
+#endif
+	return scalar_scan::kernels;
+}
+
+inline const scan_kernels*& active_scan_kernels()
+{
+	static const scan_kernels* kernels = &get_scan_kernels(detect_scan_isa());
+	return kernels;
+}
+
+} // namespace detail
+
+// Chooses the instruction set used by the tokenizer. The best one the CPU
+// supports is picked automatically, so this is mostly useful for testing
+// and benchmarking. All of them produce identical tokens.
+inline void set_scan_isa(scan_isa pIsa)
+{
+	detail::active_scan_kernels() = &detail::get_scan_kernels(pIsa);
+}
+
+} // namespace wolfscript
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "parser.hpp"
+#include "flat_ast.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+namespace wolfscript
+{
+
+namespace detail
+{
+
+// A quick 64-bit hash that reads 8 bytes at a time.
+// It only has to tell sources apart, it isn't made to resist attacks.
+inline std::uint64_t hash_bytes(std::string_view pBytes, std::uint64_t pSeed)
+{
+	constexpr std::uint64_t multiplier = 0xff51afd7ed558ccdull;
+	std::uint64_t hash = pSeed ^ (pBytes.length() * 0x9e3779b97f4a7c15ull);
+	std::size_t i = 0;
+	for (; i + 8 <= pBytes.length(); i += 8)
+	{
+		std::uint64_t word;
+		std::memcpy(&word, pBytes.data() + i, 8);
+		hash = (hash ^ word) * multiplier;
+		hash ^= hash >> 32;
+	}
+	std::uint64_t tail = 0;
+	// The data of an empty view can be null
+	if (i < pBytes.length())
+		std::memcpy(&tail, pBytes.data() + i, pBytes.length() - i);
+	hash = (hash ^ tail) * multiplier;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+} // namespace detail
+
+// Keeps the parsed form of scripts in a directory so a script that
+// hasn't changed doesn't have to be parsed again by the next process.
+// Each entry is named after a hash of the source and the format version
+// and is a versioned AST_flat_tree. An entry that is damaged, from
+// another version, or from another source is ignored and replaced.
+// Nothing about the cache is ever reported as an error, at worst the
+// script is just parsed again.
+class script_cache
+{
+public:
+	// Change this whenever the parser or the format of the entries
+	// changes so the old entries are no longer used.
+	static constexpr std::uint32_t format_version = 1;
+
+	script_cache(std::filesystem::path pDirectory) :
+		mDirectory(std::move(pDirectory))
+	{}
+
+	const std::filesystem::path& directory() const
+	{
+		return mDirectory;
+	}
+
+	// Gets the AST of the source from the cache, or parses it and adds it
+	// to the cache. The tree refers to the source, so it MUST outlive it.
+	// This will throw a tokenization_error or parse_error exception on an error.
+	AST_tree parse(std::string_view pSource) const
+	{
+		if (AST_tree tree = load(pSource))
+			return tree;
+		parser p;
+		AST_tree tree = p.parse(pSource);
+		store(pSource, tree);
+		return tree;
+	}
+
+	// Returns an empty tree if there is no usable entry for the source
+	AST_tree load(std::string_view pSource) const
+	{
+		std::ifstream stream(entry_path(pSource), std::ios::binary | std::ios::ate);
+		if (!stream)
+			return{};
+		const std::streamoff size = stream.tellg();
+		if (size < static_cast<std::streamoff>(header_size))
+			return{};
+		std::string data(static_cast<std::size_t>(size), '\0');
+		if (!stream.seekg(0) || !stream.read(data.data(), size))
+			return{};
+
+		detail::binary_reader reader(data);
+		header h;
+		if (!reader.read(h.magic) || !reader.read(h.version)
+			|| !reader.read(h.source_length) || !reader.read(h.source_hash)
+			|| !reader.read(h.payload_hash))
+			return{};
+		const std::string_view payload = std::string_view(data).substr(header_size);
+		if (h.magic != magic || h.version != format_version
+			|| h.source_length != pSource.length()
+			|| h.source_hash != detail::hash_bytes(pSource, source_seed)
+			|| h.payload_hash != detail::hash_bytes(payload, payload_seed))
+			return{};
+
+		AST_flat_tree flat;
+		if (!flat.read(payload, pSource))
+			return{};
+		return flat.expand();
+	}
+
+	// Writes an entry for the source. Returns false if it couldn't.
+	bool store(std::string_view pSource, const AST_tree& pTree) const
+	{
+		std::string payload;
+		if (!pTree || !AST_flat_tree(pTree).write(payload, pSource))
+			return false;
+
+		std::string data;
+		detail::binary_writer writer(data);
+		writer.write(magic);
+		writer.write(format_version);
+		writer.write(static_cast<std::uint64_t>(pSource.length()));
+		writer.write(detail::hash_bytes(pSource, source_seed));
+		writer.write(detail::hash_bytes(payload, payload_seed));
+		data += payload;
+
+		std::error_code error;
+		std::filesystem::create_directories(mDirectory, error);
+
+		// Another process could be reading the entry, so a new one is
+		// written next to it and then moved over it
+		const std::filesystem::path path = entry_path(pSource);
+		std::filesystem::path temporary = path;
+		temporary += "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()))
+			+ "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+		{
+			std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+			if (!stream.write(data.data(), static_cast<std::streamsize>(data.size())) || !stream.flush())
+			{
+				stream.close();
+				std::filesystem::remove(temporary, error);
+				return false;
+			}
+		}
+		std::filesystem::rename(temporary, path, error);
+		if (error)
+		{
+			std::filesystem::remove(temporary, error);
+			return false;
+		}
+		return true;
+	}
+
+	std::filesystem::path entry_path(std::string_view pSource) const
+	{
+		static const char digits[] = "0123456789abcdef";
+		std::uint64_t hash = detail::hash_bytes(pSource, name_seed ^ format_version);
+		std::string name(16, '0');
+		for (auto i = name.rbegin(); i != name.rend(); ++i, hash >>= 4)
+			*i = digits[hash & 0xf];
+		return mDirectory / (name + ".wsc");
+	}
+
+private:
+	struct header
+	{
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint64_t source_length;
+		std::uint64_t source_hash;
+		std::uint64_t payload_hash;
+	};
+	static constexpr std::size_t header_size = 4 + 4 + 8 + 8 + 8;
+
+	// "WSC" and a byte that tells apart machines of another byte order
+	static constexpr std::uint32_t magic = 0x01435357;
+
+	// Each use of the hash gets its own seed so a collision in
+	// one doesn't mean a collision in the others
+	static constexpr std::uint64_t name_seed = 0x2545f4914f6cdd1dull;
+	static constexpr std::uint64_t source_seed = 0x9e6c63d0676a9a99ull;
+	static constexpr std::uint64_t payload_seed = 0x53c5ca59ab5e2f41ull;
+
+private:
+	std::filesystem::path mDirectory;
+};
+
+} // namespace wolfscript
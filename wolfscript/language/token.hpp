@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <limits>
 #include <string>
 #include <string_view>
 #include <variant>
@@ -8,7 +10,7 @@
 namespace wolfscript
 {
 
-enum class token_type
+enum class token_type : unsigned char
 {
 	unknown,
 
@@ -149,6 +151,37 @@ constexpr const char* token_name[static_cast<unsigned int>(token_type::count)] =
 	"Keyword continue",
 };
 
+constexpr bool is_assignment(token_type pType)
+{
+	switch (pType)
+	{
+	case token_type::assign:
+	case token_type::add_assign:
+	case token_type::sub_assign:
+	case token_type::mul_assign:
+	case token_type::div_assign:
+		return true;
+	default:
+		return false;
+	}
+}
+
+constexpr bool is_comparison(token_type pType)
+{
+	switch (pType)
+	{
+	case token_type::equ:
+	case token_type::not_equ:
+	case token_type::less_than:
+	case token_type::less_than_equ_to:
+	case token_type::greater_than:
+	case token_type::greater_than_equ_to:
+		return true;
+	default:
+		return false;
+	}
+}
+
 // Represents a position in text
 struct text_position
 {
@@ -190,16 +223,23 @@ struct text_position
 
 constexpr text_position unknown_position(-1, -1);
 
+// Tokens and nodes refer to the source by byte offset. These are only
+// turned into a text_position by a line_index when they are needed.
+constexpr std::uint32_t unknown_offset = std::numeric_limits<std::uint32_t>::max();
+
 struct token
 {
 	// The representation of this token
 	token_type type{ token_type::unknown };
+	// Offset of the first character of this token in the source.
+	// For strings, this is the offset of the opening quote.
+	std::uint32_t offset{ unknown_offset };
 	// Reference to the source for this token
 	std::string_view text;
-	// Value associated with string and arithmetic types
-	std::variant<int, float, std::string> value;
-	// Position in the source
-	text_position position;
+	// Value associated with arithmetic types.
+	// String constants are left in the text with their escape sequences
+	// and are only decoded when they are added to a constant_pool.
+	std::variant<int, float> value;
 
 	token() = default;
 	token(const token&) = default;
@@ -215,4 +255,37 @@ struct token
 typedef std::vector<token> token_array;
 typedef std::vector<token>::const_iterator token_iterator;
 
+// Interface for anything that can hand tokens to the parser one at a time.
+class token_source
+{
+public:
+	virtual ~token_source() = default;
+
+	// Returns the next token. Once the end is reached, this should keep
+	// returning an eof token.
+	virtual token next() = 0;
+};
+
+// Hands out the tokens of an already tokenized array.
+// The array must outlive this object.
+class token_array_source :
+	public token_source
+{
+public:
+	token_array_source(const token_array& pTokens) :
+		mIter(pTokens.begin()),
+		mEnd(pTokens.end())
+	{}
+
+	token next() override
+	{
+		if (mIter == mEnd)
+			return token(token_type::eof);
+		return *mIter++;
+	}
+
+private:
+	token_iterator mIter, mEnd;
+};
+
 } // namespace wolfscript
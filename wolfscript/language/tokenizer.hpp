@@ -2,12 +2,16 @@
 
 #include "token.hpp"
 #include "exception.hpp"
+#include "scan.hpp"
 #include <vector>
 #include <string>
 #include <string_view>
-#include <map>
+#include <array>
 #include <algorithm>
 #include <exception>
+#include <cstdint>
+#include <cstring>
+#include <utility>
 
 namespace wolfscript
 {
@@ -15,7 +19,7 @@ namespace wolfscript
 namespace detail
 {
 
-bool is_whitespace(char c)
+constexpr bool is_whitespace(char c)
 {
 	return
 		c == ' ' ||
@@ -24,73 +28,218 @@ bool is_whitespace(char c)
 		c == '\r';
 }
 
-bool is_digit(char c)
+constexpr bool is_digit(char c)
 {
 	return c >= '0' &&
 		c <= '9';
 }
 
-bool is_letter(char c)
+constexpr bool is_letter(char c)
 {
 	return (c >= 'a' && c <= 'z') ||
 		(c >= 'A' && c <= 'Z');
 }
 
-void trim_whitespace_prefix(std::string_view& pView, text_position& pPosition)
+struct token_spelling
 {
-	auto iter = std::find_if(pView.begin(), pView.end(), [&pPosition](char c)
+	std::string_view text;
+	token_type type;
+};
+
+// Every keyword and operator the tokenizer recognizes.
+// Entries starting with a letter are keywords, everything else is an
+// operator of one or two characters. This is the only place that needs
+// to change to add a new keyword or operator.
+constexpr token_spelling token_spellings[] =
+{
+	// Keywords
+	{ "var", token_type::kw_var },
+	{ "const", token_type::kw_const },
+	{ "if", token_type::kw_if },
+	{ "else", token_type::kw_else },
+	{ "for", token_type::kw_for },
+	{ "while", token_type::kw_while },
+	{ "function", token_type::kw_function },
+	{ "return", token_type::kw_return },
+	{ "break", token_type::kw_break },
+	{ "continue", token_type::kw_continue },
+
+	// Operators
+	{ "==", token_type::equ },
+	{ "!=", token_type::not_equ },
+	{ "++", token_type::increment },
+	{ "--", token_type::decrement },
+	{ "+=", token_type::add_assign },
+	{ "-=", token_type::sub_assign },
+	{ "*=", token_type::mul_assign },
+	{ "/=", token_type::div_assign },
+	{ "||", token_type::logical_or },
+	{ "<=", token_type::less_than_equ_to },
+	{ ">=", token_type::greater_than_equ_to },
+	{ "::", token_type::namespace_separator },
+	{ "<", token_type::less_than },
+	{ ">", token_type::greater_than },
+	{ "(", token_type::l_parenthesis },
+	{ ")", token_type::r_parenthesis },
+	{ "+", token_type::add },
+	{ "-", token_type::sub },
+	{ "*", token_type::mul },
+	{ "/", token_type::div },
+	{ "%", token_type::mod },
+	{ "=", token_type::assign },
+	{ ";", token_type::eol },
+	{ ",", token_type::separator },
+	{ "{", token_type::l_brace },
+	{ "}", token_type::r_brace },
+	{ ".", token_type::period },
+};
+
+constexpr bool is_keyword_spelling(const token_spelling& pSpelling)
+{
+	return is_letter(pSpelling.text.front());
+}
+
+// Returns the length of a keyword or operator, or 0 if the type has no
+// fixed spelling.
+constexpr std::size_t spelling_length(token_type pType)
+{
+	for (const auto& i : token_spellings)
+		if (i.type == pType)
+			return i.text.length();
+	return 0;
+}
+
+// Keywords are found with a perfect hash that is generated at compile time
+// from token_spellings.
+constexpr std::size_t keyword_table_size = 64;
+
+constexpr std::size_t keyword_hash(std::string_view pText, std::size_t pSeed)
+{
+	const std::size_t first = static_cast<unsigned char>(pText.front());
+	const std::size_t second = pText.length() > 1 ? static_cast<unsigned char>(pText[1]) : 0;
+	const std::size_t last = static_cast<unsigned char>(pText.back());
+	return (pText.length() * pSeed + first * 7 + second * 3 + last) % keyword_table_size;
+}
+
+// Find the first seed that gives every keyword its own slot.
+// Returns 0 if there is none.
+constexpr std::size_t find_keyword_seed()
+{
+	for (std::size_t seed = 1; seed < 256; seed++)
 	{
-		if (c == '\n')
-			pPosition.new_line();
-		else
-			++pPosition.column;
-		return !is_whitespace(c);
-	});
-	pView.remove_prefix(std::distance(pView.begin(), iter));
-	--pPosition.column; // Do not include the last character which was not a whitespace
+		bool used[keyword_table_size]{};
+		bool collision = false;
+		for (const auto& i : token_spellings)
+		{
+			if (!is_keyword_spelling(i))
+				continue;
+			const std::size_t slot = keyword_hash(i.text, seed);
+			collision |= used[slot];
+			used[slot] = true;
+		}
+		if (!collision)
+			return seed;
+	}
+	return 0;
 }
 
-token tokenize_identifier(std::string_view& pView, text_position& pPosition)
+constexpr std::size_t keyword_seed = find_keyword_seed();
+static_assert(keyword_seed != 0, "Keywords do not hash perfectly. Try increasing keyword_table_size.");
+
+constexpr std::array<token_spelling, keyword_table_size> make_keyword_table()
 {
-	int length = 0;
-	for (auto i : pView)
+	std::array<token_spelling, keyword_table_size> table{};
+	for (auto& i : table)
+		i = { "", token_type::identifier };
+	for (const auto& i : token_spellings)
+		if (is_keyword_spelling(i))
+			table[keyword_hash(i.text, keyword_seed)] = i;
+	return table;
+}
+
+constexpr std::array<token_spelling, keyword_table_size> keyword_table = make_keyword_table();
+
+// Returns the keyword type of an identifier or token_type::identifier if
+// it isn't a keyword.
+constexpr token_type find_keyword(std::string_view pText)
+{
+	const token_spelling& entry = keyword_table[keyword_hash(pText, keyword_seed)];
+	return entry.text == pText ? entry.type : token_type::identifier;
+}
+
+// Operators are found with a transition table indexed by their first
+// character which is also generated from token_spellings.
+struct operator_transition
+{
+	static constexpr std::size_t max_follow = 4;
+
+	// The token if the operator ends at the first character
+	token_type single{ token_type::unknown };
+	// The second characters that extend the operator and their tokens
+	char follow[max_follow]{};
+	token_type follow_type[max_follow]{};
+	std::size_t follow_count{ 0 };
+};
+
+constexpr std::array<operator_transition, 128> make_operator_table()
+{
+	std::array<operator_transition, 128> table{};
+	for (const auto& i : token_spellings)
 	{
-		if (is_letter(i) || is_digit(i) || i == '_')
-			++length;
+		if (is_keyword_spelling(i))
+			continue;
+		auto& entry = table[static_cast<unsigned char>(i.text[0])];
+		if (i.text.length() == 1)
+		{
+			entry.single = i.type;
+		}
 		else
-			break;
+		{
+			entry.follow[entry.follow_count] = i.text[1];
+			entry.follow_type[entry.follow_count] = i.type;
+			++entry.follow_count;
+		}
 	}
+	return table;
+}
+
+constexpr std::array<operator_transition, 128> operator_table = make_operator_table();
+
+// Returns the operator at the start of the view along with its length.
+// The type is token_type::unknown if there is no such operator.
+constexpr std::pair<token_type, std::size_t> find_operator(std::string_view pView)
+{
+	const auto c = static_cast<unsigned char>(pView.front());
+	if (c >= operator_table.size())
+		return { token_type::unknown, 0 };
+	const operator_transition& entry = operator_table[c];
+	if (pView.length() > 1)
+		for (std::size_t i = 0; i < entry.follow_count; i++)
+			if (entry.follow[i] == pView[1])
+				return { entry.follow_type[i], 2 };
+	return { entry.single, 1 };
+}
+
+inline void trim_whitespace_prefix(std::string_view& pView)
+{
+	pView.remove_prefix(active_scan_kernels()->find_non_whitespace(pView.data(), pView.length()));
+}
+
+inline token tokenize_identifier(std::string_view& pView, std::uint32_t pOffset)
+{
+	const std::size_t length = active_scan_kernels()->find_identifier_end(pView.data(), pView.length());
 
 	token t;
 	t.text = pView.substr(0, length);
+	t.type = find_keyword(t.text);
+	t.offset = pOffset;
 
-	// Lookup table for keywords and their respective token_type value
-	std::map<std::string_view, token_type> keywords =
-	{
-		{"var" , token_type::kw_var},
-		{"const", token_type::kw_const},
-		{"if" , token_type::kw_if},
-		{"else" , token_type::kw_else},
-		{"for" , token_type::kw_for},
-		{"while" , token_type::kw_while},
-		{"function" , token_type::kw_function},
-		{"return" , token_type::kw_return},
-		{"break" , token_type::kw_break},
-		{"continue" , token_type::kw_continue}
-	};
-	if (keywords.find(t.text) != keywords.end())
-		t.type = keywords[t.text];
-	else
-		t.type = token_type::identifier;
-	t.position = pPosition;
-
-	pPosition.column += length;
 	pView.remove_prefix(length);
 
 	return t;
 }
 
-token tokenize_number(std::string_view& pView, text_position& pPosition)
+inline token tokenize_number(std::string_view& pView, std::uint32_t pOffset)
 {
 	int length = 0;
 	bool is_float = false;
@@ -104,14 +253,14 @@ token tokenize_number(std::string_view& pView, text_position& pPosition)
 			++length;
 		}
 		else if (is_letter(i))
-			throw exception::tokenization_error("This identifier should not start with a digit", pPosition);
+			throw exception::tokenization_error("This identifier should not start with a digit", pOffset);
 		else
 			break;
 	}
 
 	token t;
 	t.text = pView.substr(0, length);
-	t.position = pPosition;
+	t.offset = pOffset;
 	if (is_float)
 	{
 		t.type = token_type::floating;
@@ -122,199 +271,230 @@ token tokenize_number(std::string_view& pView, text_position& pPosition)
 		t.type = token_type::integer;
 		t.value = std::stoi(std::string(t.text.begin(), t.text.end()));
 	}
-	pPosition.column += length;
 	pView.remove_prefix(length);
 
 	return t;
 }
 
-token tokenize_char(std::string_view& pView, text_position& pPosition, token_type pType, std::size_t pLength = 1)
+inline token tokenize_char(std::string_view& pView, std::uint32_t pOffset, token_type pType, std::size_t pLength = 1)
 {
 	token t;
 	t.text = pView.substr(0, pLength);
 	t.type = pType;
-	t.position = pPosition;
+	t.offset = pOffset;
 
-	pPosition.column += pLength;
 	pView.remove_prefix(pLength);
 
 	return t;
 }
 
-token tokenize_string(std::string_view& pView, text_position& pPosition)
+// Gets the character an escape sequence, "\[c]", represents.
+// Returns false if it isn't a valid escape sequence.
+constexpr bool unescape_char(char c, char& pResult)
 {
-	pView.remove_prefix(1); // Skip "
-	std::string result;
-	int length = 0;
-	for (; length < pView.length() && pView[length] != '\"'; length++)
+	switch (c)
 	{
-		// Parse escape sequence
-		if (pView[length] == '\\')
+	case '0': pResult = '\0'; return true;
+	case 'n': pResult = '\n'; return true;
+	case 'r': pResult = '\r'; return true;
+	case 't': pResult = '\t'; return true;
+	case '\"': pResult = '\"'; return true;
+	case '\\': pResult = '\\'; return true;
+		// TODO: Add the rest of these escape sequences
+	default: return false;
+	}
+}
+
+// True if the text could be the contents of a string token: it has no
+// quotes outside of escape sequences, which are all valid.
+inline bool is_string_text(std::string_view pText)
+{
+	for (std::size_t i = 0; i < pText.length(); i++)
+	{
+		if (pText[i] == '\"')
+			return false;
+		if (pText[i] == '\\')
 		{
-			// There should be room for one more character
-			if (pView.length() - length < 2)
-				throw exception::tokenization_error("Escape sequence at end of file", pPosition);
-			++length; // Skip '\'
-			switch (pView[length])
-			{
-			case '0': result += '\0'; break;
-			case 'n': result += '\n'; break;
-			case 'r': result += '\r'; break;
-			case 't': result += '\t'; break;
-			case '\"': result += '\"'; break;
-			case '\\': result += '\\'; break;
-				// TODO: Add the rest of these escape sequences
-			default:
-				throw exception::tokenization_error("Invalid escape sequence", pPosition);
-			}
+			char c;
+			if (++i >= pText.length() || !unescape_char(pText[i], c))
+				return false;
 		}
-		else if (pView[length] != '\"')
-			result += pView[length];
+	}
+	return true;
+}
+
+// Decodes the text of a string token into pResult.
+// The escape sequences are expected to be validated by the tokenizer.
+inline void unescape_string(std::string_view pText, std::string& pResult)
+{
+	pResult.clear();
+	pResult.reserve(pText.length());
+	std::size_t i = 0;
+	while (i < pText.length())
+	{
+		// Only a backslash starts an escape sequence
+		const std::size_t escape = std::min(pText.find('\\', i), pText.length());
+		pResult.append(pText.data() + i, escape - i);
+		i = escape;
+		// A backslash at the end has nothing to escape
+		if (i + 1 >= pText.length())
+			break;
+		char c = '\0';
+		unescape_char(pText[i + 1], c);
+		pResult += c;
+		i += 2; // Skip the escape sequence
+	}
+}
+
+// The text of the token is the contents between the quotes, which is
+// decoded later by unescape_string.
+inline token tokenize_string(std::string_view& pView, std::uint32_t pOffset)
+{
+	pView.remove_prefix(1); // Skip "
+	std::size_t length = 0;
+	while (true)
+	{
+		// Skip to the next quote or escape sequence
+		length += active_scan_kernels()->find_string_special(pView.data() + length, pView.length() - length);
+		if (length >= pView.length())
+			throw exception::tokenization_error("Unterminated string", pOffset);
+		if (pView[length] == '\"')
+			break;
+
+		// There should be room for one more character
+		if (pView.length() - length < 2)
+			throw exception::tokenization_error("Escape sequence at end of file", pOffset);
+		++length; // Skip '\'
+		char c;
+		if (!unescape_char(pView[length], c))
+			throw exception::tokenization_error("Invalid escape sequence", pOffset);
+		++length;
 	}
 
 	token t;
-	if (length > 0)
-		t.text = pView.substr(0, length - 1);
+	t.text = pView.substr(0, length);
 	t.type = token_type::string;
-	t.position = pPosition;
-	t.value = std::move(result);
-
-	pPosition.column += length + 1;
+	t.offset = pOffset;
 
 	pView.remove_prefix(length + 1);
 	return t;
 }
 
-bool query_multichar(const std::string_view& pView, const char* pComp)
+inline bool query_multichar(const std::string_view& pView, const char* pComp)
 {
 	const std::size_t length = std::strlen(pComp);
 	return pView.length() >= length && pView.substr(0, length) == pComp;
 }
 
-void skip_comment(std::string_view& pView, text_position& pPosition)
+inline void skip_comment(std::string_view& pView)
 {
-	auto i = pView.begin();
-	i += 2; // Skip //
-	for (; i != pView.end(); i++)
-	{
-		if (*i == '\n')
-			break;
-		++pPosition.column;
-	}
-	pView.remove_prefix(std::distance(pView.begin(), i));
+	// Skip // and everything up to the end of the line
+	pView.remove_prefix(std::min(pView.find('\n', 2), pView.length()));
 }
 
-void skip_multiline_comment(std::string_view& pView, text_position& pPosition)
+inline void skip_multiline_comment(std::string_view& pView)
 {
-	auto i = pView.begin();
-	i += 2; // Skip /*
-	for (; i != pView.end(); i++)
+	// Skip /*
+	const std::size_t end = 2 + active_scan_kernels()->find_comment_end(pView.data() + 2, pView.length() - 2);
+	if (end < pView.length())
+		pView.remove_prefix(end + 2); // Skip */
+	else
+		pView.remove_prefix(pView.length());
+}
+
+} // namespace detail
+
+// Lazily converts a string into tokens, one at a time, as they are requested.
+// Like tokenize(), this only keeps references into the original string, so
+// you MUST keep the string alive as long as you are using the stream or the
+// tokens it generates.
+// This will throw a tokenization_error exception on an error.
+class token_stream :
+	public token_source
+{
+public:
+	// The offsets of the tokens start at pBase_offset.
+	token_stream(std::string_view pView, std::uint32_t pBase_offset = 0) :
+		mSource(pView),
+		mView(pView),
+		mBase_offset(pBase_offset)
 	{
-		if (*i == '\n')
-			pPosition.new_line();
-		++pPosition.column;
-		if (*i == '*')
+		if (pView.length() >= unknown_offset - pBase_offset)
+			throw exception::tokenization_error("Source is too large");
+		detail::trim_whitespace_prefix(mView);
+	}
+
+	// Returns the next token in the source. Once the source is exhausted,
+	// this will keep returning an eof token.
+	token next() override
+	{
+		using namespace detail;
+
+		while (!mView.empty())
 		{
-			auto peek = i + 1;
-			if (peek != pView.end() && *peek == '/')
+			token result;
+			const char c = mView.front();
+			const std::uint32_t offset = current_offset();
+			if (is_letter(c))
+				result = tokenize_identifier(mView, offset);
+			else if (is_digit(c))
+				result = tokenize_number(mView, offset);
+			else if (query_multichar(mView, "//"))
+			{
+				skip_comment(mView);
+				trim_whitespace_prefix(mView);
+				continue;
+			}
+			else if (query_multichar(mView, "/*"))
 			{
-				i += 2; // Skip */
-				pPosition.column += 2;
-				break;
+				skip_multiline_comment(mView);
+				trim_whitespace_prefix(mView);
+				continue;
 			}
+			else if (c == '\"')
+				result = tokenize_string(mView, offset);
+			else
+			{
+				const auto[type, length] = find_operator(mView);
+				if (type == token_type::unknown)
+					throw exception::tokenization_error("Unknown character", offset);
+				result = tokenize_char(mView, offset, type, length);
+			}
+			trim_whitespace_prefix(mView);
+			return result;
 		}
+		token eof(token_type::eof);
+		eof.offset = current_offset();
+		return eof;
 	}
-	pView.remove_prefix(std::distance(pView.begin(), i));
-}
 
-} // namespace detail
+private:
+	std::uint32_t current_offset() const
+	{
+		return mBase_offset + static_cast<std::uint32_t>(mView.data() - mSource.data());
+	}
+
+private:
+	std::string_view mSource;
+	std::string_view mView;
+	std::uint32_t mBase_offset;
+};
 
 // Convert a string into an array of tokens for the parser.
 // To ensure efficiency, the tokenizer does not store strings copied
 // from the original. It only keeps references to sections of it, so
 // you MUST keep the string alive as long as you are using the tokens
 // generated.
+// If you only need to parse the string, prefer parser::parse(std::string_view)
+// which pulls tokens from a token_stream without building this array.
 // This will throw a tokenization_error exception on an error.
-token_array tokenize(std::string_view pView)
+inline token_array tokenize(std::string_view pView)
 {
-	using namespace detail;
-
 	token_array result;
-	text_position current_position;
-
-	trim_whitespace_prefix(pView, current_position);
-	while (!pView.empty())
-	{
-		const char c = pView.front();
-		if (is_letter(c))
-			result.push_back(tokenize_identifier(pView, current_position));
-		else if (is_digit(c))
-			result.push_back(tokenize_number(pView, current_position));
-		else if (query_multichar(pView, "//"))
-			skip_comment(pView, current_position);
-		else if (query_multichar(pView, "/*"))
-			skip_multiline_comment(pView, current_position);
-		else if (query_multichar(pView, "=="))
-			result.push_back(tokenize_char(pView, current_position, token_type::equ, 2));
-		else if (query_multichar(pView, "!="))
-			result.push_back(tokenize_char(pView, current_position, token_type::not_equ, 2));
-		else if (query_multichar(pView, "++"))
-			result.push_back(tokenize_char(pView, current_position, token_type::increment, 2));
-		else if (query_multichar(pView, "--"))
-			result.push_back(tokenize_char(pView, current_position, token_type::decrement, 2));
-		else if (query_multichar(pView, "+="))
-			result.push_back(tokenize_char(pView, current_position, token_type::add_assign, 2));
-		else if (query_multichar(pView, "-="))
-			result.push_back(tokenize_char(pView, current_position, token_type::sub_assign, 2));
-		else if (query_multichar(pView, "*="))
-			result.push_back(tokenize_char(pView, current_position, token_type::mul_assign, 2));
-		else if (query_multichar(pView, "/="))
-			result.push_back(tokenize_char(pView, current_position, token_type::div_assign, 2));
-		else if (query_multichar(pView, "||"))
-			result.push_back(tokenize_char(pView, current_position, token_type::logical_or, 2));
-		else if (query_multichar(pView, "<="))
-			result.push_back(tokenize_char(pView, current_position, token_type::less_than_equ_to, 2));
-		else if (query_multichar(pView, ">="))
-			result.push_back(tokenize_char(pView, current_position, token_type::greater_than_equ_to, 2));
-		else if (query_multichar(pView, "::"))
-			result.push_back(tokenize_char(pView, current_position, token_type::namespace_separator, 2));
-		else if (c == '<')
-			result.push_back(tokenize_char(pView, current_position, token_type::less_than));
-		else if (c == '>')
-			result.push_back(tokenize_char(pView, current_position, token_type::greater_than));
-		else if (c == '(')
-			result.push_back(tokenize_char(pView, current_position, token_type::l_parenthesis));
-		else if (c == ')')
-			result.push_back(tokenize_char(pView, current_position, token_type::r_parenthesis));
-		else if (c == '+')
-			result.push_back(tokenize_char(pView, current_position, token_type::add));
-		else if (c == '-')
-			result.push_back(tokenize_char(pView, current_position, token_type::sub));
-		else if (c == '*')
-			result.push_back(tokenize_char(pView, current_position, token_type::mul));
-		else if (c == '/')
-			result.push_back(tokenize_char(pView, current_position, token_type::div));
-		else if (c == '%')
-			result.push_back(tokenize_char(pView, current_position, token_type::mod));
-		else if (c == '=')
-			result.push_back(tokenize_char(pView, current_position, token_type::assign));
-		else if (c == ';')
-			result.push_back(tokenize_char(pView, current_position, token_type::eol));
-		else if (c == ',')
-			result.push_back(tokenize_char(pView, current_position, token_type::separator));
-		else if (c == '{')
-			result.push_back(tokenize_char(pView, current_position, token_type::l_brace));
-		else if (c == '}')
-			result.push_back(tokenize_char(pView, current_position, token_type::r_brace));
-		else if (c == '.')
-			result.push_back(tokenize_char(pView, current_position, token_type::period));
-		else if (c == '\"')
-			result.push_back(tokenize_string(pView, current_position));
-		else
-			throw exception::tokenization_error("Unknown character", current_position);
-		trim_whitespace_prefix(pView, current_position);
-	}
-	result.emplace_back(token_type::eof);
+	token_stream stream(pView);
+	do {
+		result.emplace_back(stream.next());
+	} while (result.back().type != token_type::eof);
 	return result;
 }
 
@@ -0,0 +1,304 @@
+#pragma once
+
+#include "ast.hpp"
+#include "callable.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <typeinfo>
+#include <vector>
+
+namespace wolfscript
+{
+
+namespace detail
+{
+
+inline known_type to_known_type(const type_info& pType)
+{
+	if (!pType.is_arithmetic)
+		return known_type::unknown;
+	if (pType.bare_equal(typeid(bool)))
+		return known_type::boolean;
+	if (pType.bare_equal(typeid(int)))
+		return known_type::integer;
+	if (pType.bare_equal(typeid(float)))
+		return known_type::floating;
+	return known_type::unknown;
+}
+
+} // namespace detail
+
+// A number that isn't boxed in a value_type. The type inferred for the
+// node it comes from tells which member is set.
+union scalar
+{
+	bool b;
+	int i;
+	float f;
+};
+
+// Reads the number in a value if it has the type
+inline bool unbox(const value_type& pValue, known_type pType, scalar& pResult)
+{
+	const type_info& type = pValue.get_type_info();
+	const void* ptr = pValue.get_data().mPtr_c;
+	switch (pType)
+	{
+	case known_type::boolean:
+		if (!type.bare_equal(typeid(bool)))
+			return false;
+		pResult.b = *static_cast<const bool*>(ptr);
+		return true;
+	case known_type::integer:
+		if (!type.bare_equal(typeid(int)))
+			return false;
+		pResult.i = *static_cast<const int*>(ptr);
+		return true;
+	case known_type::floating:
+		if (!type.bare_equal(typeid(float)))
+			return false;
+		pResult.f = *static_cast<const float*>(ptr);
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Puts a number back in a value_type
+inline value_type box(known_type pType, const scalar& pNumber)
+{
+	switch (pType)
+	{
+	case known_type::boolean:
+		return value_type(pNumber.b);
+	case known_type::integer:
+		return value_type(pNumber.i);
+	default:
+		return value_type(pNumber.f);
+	}
+}
+
+// Works out which expressions can only give an int, a float or a bool, so
+// the interpreter can run them on numbers that aren't boxed in a
+// value_type. The types come from literals, the types of parameters, the
+// values a local is declared with, and the variables and return types of
+// the functions added by the application.
+//
+// A local keeps the type it is declared with since arithmetic assignments
+// cast to it. The interpreter still checks the type of every name it
+// reads, so a guess that turns out wrong, like a global that was replaced,
+// only means the expression is run the normal way.
+class type_inferrer :
+	private AST_walker
+{
+public:
+	// Finds a value the application added
+	using global_finder = std::function<const value_type*(std::string_view)>;
+	// Finds a type by the name scripts use for it
+	using type_finder = std::function<const type_info*(std::string_view)>;
+
+	// The tree has to be resolved first
+	void infer(AST_node* pRoot, global_finder pFind_global, type_finder pFind_type)
+	{
+		mFind_global = std::move(pFind_global);
+		mFind_type = std::move(pFind_type);
+		mFrames.assign(1, {});
+		visit(pRoot);
+		mFrames.clear();
+	}
+
+private:
+	struct slot
+	{
+		known_type type{ known_type::unknown };
+		bool declared{ false };
+	};
+
+private:
+	virtual void dispatch(AST_node_variable* pNode) override
+	{
+		// Numbers are copied into the local with the same type
+		const known_type type = visit(pNode->children[0]);
+		if (slot* s = get_slot(0, pNode->slot))
+			declare(*s, type);
+	}
+
+	virtual void dispatch(AST_node_unary_op* pNode) override
+	{
+		const known_type type = visit(pNode->children[0]);
+		const bool is_pure = mPure;
+		mType = known_type::unknown;
+		mPure = false;
+		if (is_pure && type != known_type::unknown
+			&& (pNode->type == token_type::add || pNode->type == token_type::sub))
+		{
+			mType = type;
+			mPure = true;
+		}
+		pNode->inferred = mType;
+	}
+
+	virtual void dispatch(AST_node_binary_op* pNode) override
+	{
+		const known_type l = visit(pNode->children[0]);
+		const bool l_pure = mPure;
+		const known_type r = visit(pNode->children[1]);
+		const bool r_pure = mPure;
+		mType = known_type::unknown;
+		mPure = false;
+		pNode->inferred = known_type::unknown;
+		if (!l_pure || !r_pure || l == known_type::unknown || r == known_type::unknown)
+			return;
+
+		const bool has_bool = l == known_type::boolean || r == known_type::boolean;
+		const token_type op = pNode->type;
+		if (op == token_type::equ || op == token_type::not_equ)
+		{
+			mType = known_type::boolean;
+		}
+		else if (is_comparison(op))
+		{
+			if (!has_bool)
+				mType = known_type::boolean;
+		}
+		else if (op == token_type::add || op == token_type::sub || op == token_type::mul
+			|| op == token_type::div || op == token_type::mod)
+		{
+			if (!has_bool)
+				mType = l;
+		}
+		else if (is_assignment(op))
+		{
+			// Only locals and globals are assigned to in place
+			if (as_identifier(pNode->children[0]) && (op == token_type::assign || !has_bool))
+				pNode->inferred = l;
+			// The assignment gives the local it assigns to
+			mType = pNode->inferred;
+			return;
+		}
+		mPure = mType != known_type::unknown;
+		pNode->inferred = mType;
+	}
+
+	virtual void dispatch(AST_node_member_accessor* pNode) override
+	{
+		visit(pNode->children[0]);
+		mType = known_type::unknown;
+		mPure = false;
+	}
+
+	virtual void dispatch(AST_node_constant* pNode) override
+	{
+		mType = pNode->value ? detail::to_known_type(pNode->value->get_type_info()) : known_type::unknown;
+		mPure = mType != known_type::unknown;
+		pNode->inferred = mType;
+	}
+
+	virtual void dispatch(AST_node_identifier* pNode) override
+	{
+		mType = known_type::unknown;
+		if (pNode->slot != unresolved_slot)
+		{
+			if (slot* s = get_slot(pNode->depth, pNode->slot))
+				mType = s->type;
+		}
+		else if (const value_type* value = mFind_global(pNode->identifier))
+		{
+			mType = detail::to_known_type(value->get_type_info());
+		}
+		mPure = mType != known_type::unknown;
+		pNode->inferred = mType;
+	}
+
+	virtual void dispatch(AST_node_function_call* pNode) override
+	{
+		for (std::size_t i = 1; i < pNode->children.size(); i++)
+			visit(pNode->children[i]);
+
+		// Functions of the application tell what they return
+		known_type type = known_type::unknown;
+		const AST_node_identifier* callee = as_identifier(pNode->children[0]);
+		if (callee && callee->slot == unresolved_slot)
+		{
+			if (const value_type* value = mFind_global(callee->identifier))
+				type = get_return_type(*value);
+		}
+		mType = type;
+		mPure = false;
+	}
+
+	virtual void dispatch(AST_node_function_declaration* pNode) override
+	{
+		if (!pNode->identifier.empty())
+		{
+			if (slot* s = get_slot(0, pNode->slot))
+				declare(*s, known_type::unknown);
+		}
+
+		mFrames.emplace_back();
+		for (std::size_t i = 0; i < pNode->parameters.size(); i++)
+		{
+			const auto& param = pNode->parameters[i];
+			known_type type = known_type::unknown;
+			if (param.has_type)
+			{
+				// Typed parameters are cast to their type
+				if (const type_info* info = mFind_type(param.type.text))
+					type = detail::to_known_type(*info);
+			}
+			declare(*get_slot(0, static_cast<std::uint32_t>(i)), type);
+		}
+		visit(pNode->children[0]);
+		mFrames.pop_back();
+
+		mType = known_type::unknown;
+		mPure = false;
+	}
+
+private:
+	// Returns the type of the node, mPure tells if it can be run unboxed
+	known_type visit(AST_node* pNode)
+	{
+		mType = known_type::unknown;
+		mPure = false;
+		pNode->visit(this);
+		return mType;
+	}
+
+	known_type get_return_type(const value_type& pValue) const
+	{
+		if (auto c = pValue.get<const callable>())
+			return c->return_type.owning() ? detail::to_known_type(c->return_type) : known_type::unknown;
+		return known_type::unknown;
+	}
+
+	slot* get_slot(std::uint32_t pDepth, std::uint32_t pSlot)
+	{
+		if (pSlot == unresolved_slot || pDepth >= mFrames.size())
+			return nullptr;
+		auto& slots = mFrames[mFrames.size() - 1 - pDepth];
+		if (pSlot >= slots.size())
+			slots.resize(pSlot + 1);
+		return &slots[pSlot];
+	}
+
+	// A local declared again with another type has no known type
+	static void declare(slot& pSlot, known_type pType)
+	{
+		pSlot.type = !pSlot.declared || pSlot.type == pType ? pType : known_type::unknown;
+		pSlot.declared = true;
+	}
+
+private:
+	global_finder mFind_global;
+	type_finder mFind_type;
+	// The types of the slots of each function around the node being visited
+	std::vector<std::vector<slot>> mFrames;
+	known_type mType{ known_type::unknown };
+	// True if the node can be run unboxed
+	bool mPure{ false };
+};
+
+} // namespace wolfscript
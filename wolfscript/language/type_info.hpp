@@ -76,7 +76,7 @@ struct type_info
 	}
 };
 
-type_info const_type(const type_info& pType)
+inline type_info const_type(const type_info& pType)
 {
 	type_info type = pType;
 	type.is_const = true;
@@ -6,6 +6,7 @@
 #include <map>
 #include <any>
 #include <memory>
+#include <new>
 
 namespace wolfscript
 {
@@ -113,17 +114,31 @@ private:
 			mType_info = type_info::create<std::add_pointer_t<T>>();
 		}
 
-		// Create a unique copy of the value
+		// Create a unique copy of the value.
+		// Numbers are kept in the data itself.
 		template <typename T>
 		void set(T pCopy)
 		{
-			auto ptr = std::make_shared<T>(pCopy);
-			mPtr = ptr.get();
+			if constexpr (std::is_arithmetic_v<T>)
+			{
+				static_assert(sizeof(T) <= sizeof(mNumber));
+				mPtr = new (mNumber) T(pCopy);
+			}
+			else
+			{
+				auto ptr = std::make_shared<T>(pCopy);
+				mPtr = ptr.get();
+				mData = std::any(std::move(ptr));
+			}
 			mPtr_c = mPtr;
-			mData = std::any(std::move(ptr));
 			mType_info = type_info::create<T>();
 		}
 
+		bool has_number() const
+		{
+			return mPtr_c == static_cast<const void*>(mNumber);
+		}
+
 		template <typename T>
 		bool has_type() const
 		{
@@ -134,13 +149,14 @@ private:
 		void* mPtr;
 		const void* mPtr_c;
 		std::any mData;
+		alignas(long double) unsigned char mNumber[sizeof(long double)];
 	};
 
 public:
-	value_type()
-	{
-		mData = std::make_shared<data>();
-	}
+	// All void values share their data, nothing changes it
+	value_type() :
+		mData(get_void_data())
+	{}
 
 	value_type(const value_type& pCopy) = default;
 	value_type(value_type&& pCopy) = default;
@@ -190,10 +206,17 @@ public:
 			return static_cast<T*>(mData->mPtr);
 	}
 
+	// True if this holds a number that no other value_type refers to,
+	// so it can be changed without that being seen anywhere else
+	bool is_unique_number() const
+	{
+		return mData.use_count() == 1 && mData->has_number();
+	}
+
 	// Reset this object to a void type
 	void clear()
 	{
-		std::swap(*this, value_type{});
+		*this = value_type{};
 	}
 
 	data& get_data() const
@@ -208,12 +231,22 @@ public:
 	{
 		auto new_data = std::make_shared<data>(*mData);
 		new_data->mType_info.is_const |= mMake_const;
+		// A number is still kept in the original data
+		if (mData->has_number())
+			new_data->mData = std::any(mData);
 
 		value_type new_value_type;
 		new_value_type.mData = new_data;
 		return new_value_type;
 	}
 
+private:
+	static const std::shared_ptr<data>& get_void_data()
+	{
+		static const std::shared_ptr<data> void_data = std::make_shared<data>();
+		return void_data;
+	}
+
 private:
 	std::shared_ptr<data> mData;
 };
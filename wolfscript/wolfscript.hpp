@@ -1,7 +1,12 @@
 #pragma once
 
 #include "language/tokenizer.hpp"
+#include "language/compact_tokens.hpp"
 #include "language/parser.hpp"
+#include "language/incremental_parser.hpp"
+#include "language/batch_parser.hpp"
+#include "language/script_cache.hpp"
+#include "language/flat_ast.hpp"
 #include "language/interpreter.hpp"
 #include "language/function.hpp"
 